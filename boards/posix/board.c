@@ -0,0 +1,426 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "console.h"
+#include "edf_test.h"
+#include "event_group_test.h"
+#include "hrtimer_test.h"
+#include "kernel.h"
+#include "kernel_bench.h"
+#include "libc_glue.h"
+#include "mutex_test.h"
+#include "platform.h"
+#include "queue_test.h"
+#include "readline/history.h"
+#include "ring_test.h"
+#include "semaphore_test.h"
+#include "shell/shell.h"
+#include "task_list_test.h"
+#include "task_pool_test.h"
+#include "timer_test.h"
+#include "wait_test.h"
+#include "work_queue_test.h"
+
+/****************************************************************************
+ * interrupt lines (see IRQ_SIGNAL in platform.h)
+ ****************************************************************************/
+#define IRQ_TICK    SIGALRM
+#define IRQ_HRTIMER SIGRTMIN
+#define IRQ_CONSOLE SIGIO
+#define IRQ_WAKE    SIGUSR1
+#define IRQ_PREEMPT SIGUSR2
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TICK_NS (1000000000ULL / TASK_TICK_HZ)
+
+#ifndef SMP
+#define _smpLock()
+#define _smpUnlock()
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Console console = CONSOLE_CREATE
+(
+   QUEUE_CREATE_PTR("console_rx", 1, 64)
+);
+
+static HistoryData historyData = HISTORY_DATA(10);
+
+#ifdef SMP
+static Task task0[SMP];
+#else
+static Task task0[1];
+#endif
+
+/****************************************************************************
+ * the tick is a one-shot timer on an absolute deadline, base is the clock
+ * time the kernel has been told about
+ ****************************************************************************/
+static struct
+{
+   timer_t timer;
+   unsigned long long base;
+
+} tick;
+
+static timer_t hrtimer;
+static unsigned long long clockStart;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskListCmd(int argc, char* argv[])
+{
+   taskList();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskTopCmd(int argc, char* argv[])
+{
+   taskTop();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void latencyCmd(int argc, char* argv[])
+{
+   if ((argc > 1) && (strcmp(argv[1], "reset") == 0))
+   {
+      TaskLatency latency;
+      signed char i = 0;
+
+      while (taskGetLatency(i++, &latency, true));
+   }
+   else
+   {
+      taskListLatency();
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void traceCmd(int argc, char* argv[])
+{
+   if (argc > 1)
+      kernelTraceEnable(strcmp(argv[1], "off") != 0);
+   else
+      kernelTraceDump();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void cpuListCmd(int argc, char* argv[])
+{
+   taskListCPU();
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static const ShellCmd SHELL_CMDS[] =
+{
+   {"tl", taskListCmd},
+   {"top", taskTopCmd},
+   {"lat", latencyCmd},
+   {"trace", traceCmd},
+#ifdef SMP
+   {"cl", cpuListCmd},
+#endif
+   {"edf_test", edfTestCmd},
+   {"event_group_test", eventGroupTestCmd},
+   {"hrtimer_test", hrtimerTestCmd},
+   {"kernel_bench", kernelBenchCmd},
+   {"mutex_test", mutexTestCmd},
+   {"queue_test", queueTestCmd},
+   {"ring_bench", ringBenchCmd},
+   {"ring_test", ringTestCmd},
+   {"semaphore_test", semaphoreTestCmd},
+   {"task_list_test", taskListTestCmd},
+   {"task_pool_test", taskPoolTestCmd},
+   {"timer_test", timerTestCmd},
+   {"wait_test", waitTestCmd},
+   {"work_queue_test", workQueueTestCmd},
+   {NULL, NULL}
+};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long long clockNs()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/****************************************************************************
+ * Creates a CLOCK_MONOTONIC timer that signals CPU 0.
+ ****************************************************************************/
+static void eventCreate(timer_t* timer, int sig)
+{
+   struct sigevent event;
+
+   memset(&event, 0, sizeof(event));
+   event.sigev_notify = SIGEV_THREAD_ID;
+   event.sigev_signo = sig;
+   event._sigev_un._tid = cpuThread(0);
+
+   timer_create(CLOCK_MONOTONIC, &event, timer);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void eventArm(timer_t timer, unsigned long long ns)
+{
+   struct itimerspec value;
+
+   memset(&value, 0, sizeof(value));
+   value.it_value.tv_sec = ns / 1000000000;
+   value.it_value.tv_nsec = ns % 1000000000;
+
+   timer_settime(timer, TIMER_ABSTIME, &value, NULL);
+}
+
+/****************************************************************************
+ * The signal of a timer that expired while taskScheduleTick() adjusted the
+ * tick may still be delivered, and then there is nothing left to count.
+ ****************************************************************************/
+static void timerCallback(int sig, void* arg)
+{
+   unsigned long ticks;
+
+   /* taskScheduleTick() runs under this lock on the other CPUs */
+   _smpLock();
+   ticks = (clockNs() - tick.base) / TICK_NS;
+   tick.base += ticks * TICK_NS;
+   _smpUnlock();
+
+   if (ticks > 0)
+      _taskTick(ticks);
+
+   _taskPreempt(true);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void hrtimerCallback(int sig, void* arg)
+{
+   _hrtimerExpire();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void smpIRQ(int sig, void* arg)
+{
+   if (sig == IRQ_PREEMPT)
+      _taskPreempt(true);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _cpuWake(int cpu)
+{
+   cpuSignal(cpu, IRQ_WAKE);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _cpuPreempt(int cpu)
+{
+   cpuSignal(cpu, IRQ_PREEMPT);
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long taskScheduleTick(bool adj, unsigned long ticks)
+{
+   unsigned long long now = clockNs();
+   unsigned long elapsed = 0;
+
+   if (adj)
+   {
+      elapsed = (now - tick.base) / TICK_NS;
+      tick.base += elapsed * TICK_NS;
+   }
+   else
+   {
+      tick.base = now;
+   }
+
+   if (ticks > 0)
+      eventArm(tick.timer, tick.base + ticks * TICK_NS);
+   else
+      eventArm(tick.timer, 0);
+
+   return elapsed;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long hrtimerClock()
+{
+   return (clockNs() - clockStart) / 1000;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long taskClock()
+{
+   return hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long kernelBenchClock()
+{
+   return (unsigned long) hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerSchedule(unsigned long long deadline)
+{
+   if (deadline != -1)
+      eventArm(hrtimer, clockStart + deadline * 1000);
+   else
+      eventArm(hrtimer, 0);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskIdle()
+{
+   waitForInterrupt();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void smpMain()
+{
+   taskInit(&task0[cpuID()], "main+", TASK_LOW_PRIORITY, NULL, 0);
+   enableInterrupts();
+
+   for (;;)
+   {
+      volatile unsigned long i = rand() % TASK_TICK_HZ;
+
+      if (i & 1)
+      {
+         i *= 1000;
+         while (i-- > 0);
+      }
+      else
+      {
+         taskSleep(i);
+      }
+   }
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+int main(int argc, char* argv[])
+{
+   clockStart = clockNs();
+
+   taskInit(&task0[cpuID()], "main", TASK_HIGH_PRIORITY, NULL, 0);
+
+   consoleInit(&console);
+   irqAddHandler(IRQ_CONSOLE, consoleIRQ, &console);
+   libcInit(&console.dev);
+
+   eventCreate(&tick.timer, IRQ_TICK);
+   irqAddHandler(IRQ_TICK, timerCallback, NULL);
+
+   eventCreate(&hrtimer, IRQ_HRTIMER);
+   irqAddHandler(IRQ_HRTIMER, hrtimerCallback, NULL);
+
+#ifdef SMP
+   irqAddHandler(IRQ_WAKE, smpIRQ, NULL);
+#if TASK_PREEMPTION
+   irqAddHandler(IRQ_PREEMPT, smpIRQ, NULL);
+#endif
+   smpStart(smpMain);
+#endif
+
+   puts("AliOS on POSIX");
+   enableInterrupts();
+
+#if KERNEL_BENCH_BOOT
+   kernelBench();
+#endif
+
+   edfTest();
+   eventGroupTest();
+   hrtimerTest();
+   mutexTest();
+   queueTest();
+   ringTest();
+   semaphoreTest();
+   taskListTest();
+   taskPoolTest();
+   timerTest();
+   waitTest();
+   workQueueTest();
+
+   taskSetData(HISTORY_DATA_ID, &historyData);
+   shellRun(SHELL_CMDS);
+
+   return 0;
+}
@@ -0,0 +1,139 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <malloc.h>
+#include <stdlib.h>
+
+/****************************************************************************
+ * glibc's printf() alone needs a few KB, and interrupt handlers run on the
+ * stack of the task they interrupt
+ ****************************************************************************/
+#define EDF_TEST1_STACK_SIZE         65536
+#define EDF_TEST2_STACK_SIZE         65536
+#define EDF_TEST3_STACK_SIZE         65536
+#define EVENT_GROUP_TEST1_STACK_SIZE 65536
+#define EVENT_GROUP_TEST2_STACK_SIZE 65536
+#define EVENT_GROUP_TEST3_STACK_SIZE 65536
+#define HRTIMER_TEST1_STACK_SIZE     65536
+#define KERNEL_BENCH1_STACK_SIZE     65536
+#define KERNEL_BENCH2_STACK_SIZE     65536
+#define MUTEX_TEST1_STACK_SIZE       65536
+#define MUTEX_TEST2_STACK_SIZE       65536
+#define QUEUE_TEST1_STACK_SIZE       65536
+#define QUEUE_TEST2_STACK_SIZE       65536
+#define RING_TEST1_STACK_SIZE        65536
+#define RING_TEST2_STACK_SIZE        65536
+#define RING_TEST3_STACK_SIZE        65536
+#define SEMAPHORE_TEST1_STACK_SIZE   65536
+#define SEMAPHORE_TEST2_STACK_SIZE   65536
+#define SEMAPHORE_TEST3_STACK_SIZE   65536
+#define TASK_LIST_TEST1_STACK_SIZE   65536
+#define TASK_LIST_TEST2_STACK_SIZE   65536
+#define TASK_LIST_TEST3_STACK_SIZE   65536
+#define TASK_POOL_TEST1_STACK_SIZE   65536
+#define TASK_POOL_TEST2_STACK_SIZE   65536
+#define TIMER_TEST1_STACK_SIZE       65536
+#define TIMER_TEST2_STACK_SIZE       65536
+#define WAIT_TEST1_STACK_SIZE        65536
+#define WAIT_TEST2_STACK_SIZE        65536
+#define WAIT_TEST3_STACK_SIZE        65536
+#define WORK_QUEUE_TEST1_STACK_SIZE  65536
+#define WORK_QUEUE_TEST2_STACK_SIZE  65536
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TASK_PREEMPTION  1
+#define TASK_LIST        1
+#define TASK_STACK_USAGE 1
+#define TASK_STACK_GUARD 4096
+#define TASK_POOLS       1
+#define TASK_AT_EXIT     1
+#define TASK_STATS       1
+#define TASK_LATENCY     1
+#define KERNEL_TRACE     1
+#define TASK_EDF         1
+#define TASK_TICK_HZ     1000
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TASK_HIGH_PRIORITY  0
+#define TASK_LOW_PRIORITY   1
+#define TASK_NUM_PRIORITIES 2
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOTS  32
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define HRTIMERS 1
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define WORK_QUEUES 1
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define cpuID() _cpuID()
+#define cpuWake(id) _cpuWake(id)
+#define cpuPreempt(id) _cpuPreempt(id)
+#define memoryBarrier() _memoryBarrier()
+
+/****************************************************************************
+ * allow the kernel to use malloc/free (and memalign for guarded stacks)
+ ****************************************************************************/
+#define kmalloc malloc
+#define kmemalign memalign
+#define kfree free
+
+/****************************************************************************
+ * have readline use dynamic memory too
+ ****************************************************************************/
+#define rl_realloc realloc
+#define rl_free free
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _cpuWake(int id);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _cpuPreempt(int id);
+
+#endif
@@ -34,6 +34,7 @@
 #include "fs_utils/fs_utils.h"
 #include "http/http_server.h"
 #include "kernel.h"
+#include "kernel_bench.h"
 #include "libc_glue.h"
 #include "lwip/tcpip.h"
 #include "misc/mem_dev.h"
@@ -66,6 +67,7 @@ static PL011 pl011 = PL011_CREATE
 );
 
 static SP804 sp804 = SP804_CREATE(0x101E2000);
+static SP804Clock sp804Clock = SP804_CLOCK_CREATE(0x101E3000);
 static LAN91C lan91c = LAN91C_CREATE(0x10010000);
 
 static HistoryData historyData = HISTORY_DATA(10);
@@ -85,17 +87,58 @@ static void taskListCmd(int argc, char* argv[])
    taskList();
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskTopCmd(int argc, char* argv[])
+{
+   taskTop();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void latencyCmd(int argc, char* argv[])
+{
+   if ((argc > 1) && (strcmp(argv[1], "reset") == 0))
+   {
+      TaskLatency latency;
+      signed char i = 0;
+
+      while (taskGetLatency(i++, &latency, true));
+   }
+   else
+   {
+      taskListLatency();
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void traceCmd(int argc, char* argv[])
+{
+   if (argc > 1)
+      kernelTraceEnable(strcmp(argv[1], "off") != 0);
+   else
+      kernelTraceDump();
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
 static const ShellCmd SHELL_CMDS[] =
 {
    {"tl", taskListCmd},
+   {"top", taskTopCmd},
+   {"lat", latencyCmd},
+   {"trace", traceCmd},
    {"pwd", fsUtils_pwd},
    {"cd", fsUtils_cd},
    {"ls", fsUtils_ls},
    {"cat", fsUtils_cat},
    {"lsof", vfsInfo},
+   {"kernel_bench", kernelBenchCmd},
    {NULL, NULL}
 };
 
@@ -131,6 +174,14 @@ static void timerCallback(HWTimer* _timer)
    _taskPreempt(true);
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void hrtimerCallback(HWClock* clock)
+{
+   _hrtimerExpire();
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -174,6 +225,46 @@ unsigned long taskScheduleTick(bool adj, unsigned long ticks)
    return elasped;
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long hrtimerClock()
+{
+   unsigned long clksPerUs = sp804Clock.clock.clk / 1000000;
+   return sp804Clock.clock.read(&sp804Clock.clock) / clksPerUs;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long taskClock()
+{
+   /* taskInit() runs before the clocksource is set up */
+   if (sp804Clock.clock.read == NULL)
+      return 0;
+
+   return hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long kernelBenchClock()
+{
+   return (unsigned long) hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerSchedule(unsigned long long deadline)
+{
+   if (deadline != -1)
+      deadline *= sp804Clock.clock.clk / 1000000;
+
+   sp804Clock.clock.program(&sp804Clock.clock, deadline);
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -216,6 +307,10 @@ int main(void* vectors, void* stack, unsigned long stackSize)
    sp804.timer.callback = timerCallback;
    sp804.timer.periodic = false;
 
+   sp804ClockInit(&sp804Clock, 1000000);
+   vic.ctrl.addHandler(&vic.ctrl, 5, sp804ClockIRQ, &sp804Clock, false, 1);
+   sp804Clock.clock.callback = hrtimerCallback;
+
    tcpip_init(NULL, NULL);
    lan91cInit(&lan91c, NULL, NULL, NULL, true);
    sic.ctrl.addHandler(&sic.ctrl, 25, lan91cIRQ, &lan91c, false, 1);
@@ -228,6 +323,10 @@ int main(void* vectors, void* stack, unsigned long stackSize)
    puts("AliOS on ARM");
    enableInterrupts();
 
+#if KERNEL_BENCH_BOOT
+   kernelBench();
+#endif
+
    httpServer.types = NULL;
    httpServer.callbacks = HTTP_CALLBACKS;
    httpServer.root = NULL;
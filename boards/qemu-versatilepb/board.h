@@ -37,6 +37,12 @@
  ****************************************************************************/
 #define BOARD_MEM_SIZE (128 * 1024 * 1024)
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define KERNEL_BENCH1_STACK_SIZE 2048
+#define KERNEL_BENCH2_STACK_SIZE 2048
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -44,6 +50,9 @@
 #define TASK_LIST        1
 #define TASK_STACK_USAGE 1
 #define TASK_AT_EXIT     1
+#define TASK_STATS       1
+#define TASK_LATENCY     1
+#define KERNEL_TRACE     1
 #define TASK_TICK_HZ     1000
 #define TASK0_STACK_SIZE 2048
 #define VFS_INFO         1
@@ -55,6 +64,11 @@
 #define TASK_LOW_PRIORITY   1
 #define TASK_NUM_PRIORITIES 2
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define HRTIMERS 1
+
 /****************************************************************************
  * allow the kernel to use malloc/free
  ****************************************************************************/
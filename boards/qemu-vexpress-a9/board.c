@@ -26,18 +26,34 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  ****************************************************************************/
 #include <stdio.h>
+#include <string.h>
+#include "edf_test.h"
+#include "event_group_test.h"
 #include "gic.h"
+#include "hrtimer_test.h"
 #include "kernel.h"
+#include "kernel_bench.h"
 #include "libc_glue.h"
 #include "mmu/armv7_mmu.h"
 #include "mutex_test.h"
 #include "queue_test.h"
 #include "readline/history.h"
+#include "ring_test.h"
 #include "semaphore_test.h"
 #include "shell/shell.h"
+#include "task_list_test.h"
+#include "task_pool_test.h"
+#include "timer/a9_gtimer.h"
 #include "timer/sp804.h"
 #include "timer_test.h"
 #include "uart/pl011.h"
+#include "wait_test.h"
+#include "work_queue_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define MMU_L2_PAGES 16
 
 /****************************************************************************
  *
@@ -52,6 +68,7 @@ static PL011 pl011 = PL011_CREATE
 );
 
 static SP804 sp804 = SP804_CREATE(0x10011000);
+static A9GTimer a9GTimer = A9_GTIMER_CREATE(0x1E000200);
 static HistoryData historyData = HISTORY_DATA(10);
 
 static MMU mmu;
@@ -69,16 +86,102 @@ static void taskListCmd(int argc, char* argv[])
    taskList();
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskTopCmd(int argc, char* argv[])
+{
+   taskTop();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void latencyCmd(int argc, char* argv[])
+{
+   if ((argc > 1) && (strcmp(argv[1], "reset") == 0))
+   {
+      TaskLatency latency;
+      signed char i = 0;
+
+      while (taskGetLatency(i++, &latency, true));
+   }
+   else
+   {
+      taskListLatency();
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void traceCmd(int argc, char* argv[])
+{
+   if (argc > 1)
+      kernelTraceEnable(strcmp(argv[1], "off") != 0);
+   else
+      kernelTraceDump();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void cpuListCmd(int argc, char* argv[])
+{
+   taskListCPU();
+}
+
+#if SMP_LOCK_STATS
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void lockStatsCmd(int argc, char* argv[])
+{
+   bool reset = (argc > 1) && (strcmp(argv[1], "-r") == 0);
+
+   printf("%-5s%-12s%-12s%s\n", "CPU", "ACQUIRED", "SPINS", "MAX WAIT");
+
+   for (int cpu = 0; cpu < SMP; cpu++)
+   {
+      SMPLockStats stats;
+      smpLockStats(cpu, &stats, reset);
+      printf("%-5d%-12lu%-12lu%lu\n", cpu, stats.acquisitions, stats.spins,
+             stats.maxWait);
+   }
+}
+#endif
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
 static const ShellCmd SHELL_CMDS[] =
 {
    {"tl", taskListCmd},
+   {"top", taskTopCmd},
+   {"lat", latencyCmd},
+   {"trace", traceCmd},
+#ifdef SMP
+   {"cl", cpuListCmd},
+#if SMP_LOCK_STATS
+   {"lock", lockStatsCmd},
+#endif
+#endif
+   {"edf_test", edfTestCmd},
+   {"event_group_test", eventGroupTestCmd},
+   {"hrtimer_test", hrtimerTestCmd},
+   {"kernel_bench", kernelBenchCmd},
    {"mutex_test", mutexTestCmd},
    {"queue_test", queueTestCmd},
+   {"ring_bench", ringBenchCmd},
+   {"ring_test", ringTestCmd},
    {"semaphore_test", semaphoreTestCmd},
+   {"task_list_test", taskListTestCmd},
+   {"task_pool_test", taskPoolTestCmd},
    {"timer_test", timerTestCmd},
+   {"wait_test", waitTestCmd},
+   {"work_queue_test", workQueueTestCmd},
    {NULL, NULL}
 };
 
@@ -90,9 +193,14 @@ static void timerCallback(HWTimer* timer)
    unsigned long tickClks = sp804.timer.clk / TASK_TICK_HZ;
    _taskTick(sp804.timer.loadValue / tickClks);
    _taskPreempt(true);
-#ifdef SMP
-   gicSGI(&gic, -1, 1);
-#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void hrtimerCallback(HWClock* clock)
+{
+   _hrtimerExpire();
 }
 
 #ifdef SMP
@@ -123,15 +231,29 @@ void _cpuWake(int cpu)
 {
    gicSGI(&gic, cpu, 0);
 }
-#endif
 
 /****************************************************************************
  *
  ****************************************************************************/
+void _cpuPreempt(int cpu)
+{
+   gicSGI(&gic, cpu, 1);
+}
+#endif
+
+/****************************************************************************
+ * second level tables for the vectors and for the sections of the heap that
+ * get stack guards (a table covers 1MB)
+ ****************************************************************************/
 void* mmuGetPage(unsigned int count)
 {
-   static unsigned long ALIGNED(4096) mmuPage[1024];
-   return mmuPage;
+   static unsigned long ALIGNED(4096) mmuPage[MMU_L2_PAGES][1024];
+   static unsigned int next = 0;
+
+   if (next >= MMU_L2_PAGES)
+      return NULL;
+
+   return mmuPage[next++];
 }
 
 /****************************************************************************
@@ -139,6 +261,27 @@ void* mmuGetPage(unsigned int count)
  ****************************************************************************/
 void mmuFreePage(void* page) {}
 
+/****************************************************************************
+ * A stack that overflows into its guard page takes a data abort, and
+ * _dataAbort() reports the task.  Splitting a heap section uses up one of
+ * the MMU_L2_PAGES second level tables, and the kernel leaves the stack
+ * unguarded when there is none left.  The guard is given back the mapping
+ * of the stack right above it (the rest of the heap's mapping).
+ ****************************************************************************/
+bool taskStackGuard(void* guard, bool enable)
+{
+   unsigned char* stack = (unsigned char*) guard + TASK_STACK_GUARD;
+   unsigned int count = TASK_STACK_GUARD / MMU_PAGE_SIZE;
+   bool success;
+
+   kernelLock();
+   success = mmuMap(&mmu, enable ? 0 : mmuGetMode(&mmu, stack), guard,
+                    guard, count);
+   kernelUnlock();
+
+   return success;
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -168,6 +311,46 @@ unsigned long taskScheduleTick(bool adj, unsigned long ticks)
    return elasped;
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long hrtimerClock()
+{
+   unsigned long clksPerUs = a9GTimer.clock.clk / 1000000;
+   return a9GTimer.clock.read(&a9GTimer.clock) / clksPerUs;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long long taskClock()
+{
+   /* taskInit() runs before the clocksource is set up */
+   if (a9GTimer.clock.read == NULL)
+      return 0;
+
+   return hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long kernelBenchClock()
+{
+   return (unsigned long) hrtimerClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerSchedule(unsigned long long deadline)
+{
+   if (deadline != -1)
+      deadline *= a9GTimer.clock.clk / 1000000;
+
+   a9GTimer.clock.program(&a9GTimer.clock, deadline);
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -195,6 +378,9 @@ void smpMain(void* stack, unsigned long size)
    vectorsHigh();
 
    gicInitSMP(&gic);
+
+   /* PPIs are banked, so every CPU enables the global timer interrupt */
+   gic.ctrl.addHandler(&gic.ctrl, 27, a9GTimerIRQ, &a9GTimer, true, -1);
    taskInit(&task0[cpuID()], "main+", TASK_LOW_PRIORITY, stack, size);
    enableInterrupts();
 
@@ -238,6 +424,11 @@ int main(void* vectors, void* stack, unsigned long stackSize)
    sp804.timer.callback = timerCallback;
    sp804.timer.periodic = false;
 
+   /* QEMU runs the global timer at 100MHz */
+   a9GTimerInit(&a9GTimer, 100000000);
+   gic.ctrl.addHandler(&gic.ctrl, 27, a9GTimerIRQ, &a9GTimer, true, -1);
+   a9GTimer.clock.callback = hrtimerCallback;
+
 #ifdef SMP
    gic.ctrl.addHandler(&gic.ctrl, 0, smpIRQ, NULL, true, -1);
 #if TASK_PREEMPTION
@@ -249,10 +440,22 @@ int main(void* vectors, void* stack, unsigned long stackSize)
    puts("AliOS on ARM");
    enableInterrupts();
 
+#if KERNEL_BENCH_BOOT
+   kernelBench();
+#endif
+
+   edfTest();
+   eventGroupTest();
+   hrtimerTest();
    mutexTest();
    queueTest();
+   ringTest();
    semaphoreTest();
+   taskListTest();
+   taskPoolTest();
    timerTest();
+   waitTest();
+   workQueueTest();
 
    taskSetData(HISTORY_DATA_ID, &historyData);
    shellRun(SHELL_CMDS);
@@ -29,6 +29,7 @@
 #define BOARD_H
 
 #ifndef __ASM__
+#include <malloc.h>
 #include <stdlib.h>
 #endif
 
@@ -40,15 +41,37 @@
 /****************************************************************************
  *
  ****************************************************************************/
-#define MUTEX_TEST1_STACK_SIZE     2048
-#define MUTEX_TEST2_STACK_SIZE     2048
-#define QUEUE_TEST1_STACK_SIZE     2048
-#define QUEUE_TEST2_STACK_SIZE     2048
-#define SEMAPHORE_TEST1_STACK_SIZE 2048
-#define SEMAPHORE_TEST2_STACK_SIZE 2048
-#define SEMAPHORE_TEST3_STACK_SIZE 2048
-#define TIMER_TEST1_STACK_SIZE     2048
-#define TIMER_TEST2_STACK_SIZE     2048
+#define EDF_TEST1_STACK_SIZE         2048
+#define EDF_TEST2_STACK_SIZE         2048
+#define EDF_TEST3_STACK_SIZE         2048
+#define EVENT_GROUP_TEST1_STACK_SIZE 2048
+#define EVENT_GROUP_TEST2_STACK_SIZE 2048
+#define EVENT_GROUP_TEST3_STACK_SIZE 2048
+#define HRTIMER_TEST1_STACK_SIZE     2048
+#define KERNEL_BENCH1_STACK_SIZE     2048
+#define KERNEL_BENCH2_STACK_SIZE     2048
+#define MUTEX_TEST1_STACK_SIZE       2048
+#define MUTEX_TEST2_STACK_SIZE       2048
+#define QUEUE_TEST1_STACK_SIZE       2048
+#define QUEUE_TEST2_STACK_SIZE       2048
+#define RING_TEST1_STACK_SIZE        2048
+#define RING_TEST2_STACK_SIZE        2048
+#define RING_TEST3_STACK_SIZE        2048
+#define SEMAPHORE_TEST1_STACK_SIZE   2048
+#define SEMAPHORE_TEST2_STACK_SIZE   2048
+#define SEMAPHORE_TEST3_STACK_SIZE   2048
+#define TASK_LIST_TEST1_STACK_SIZE   2048
+#define TASK_LIST_TEST2_STACK_SIZE   2048
+#define TASK_LIST_TEST3_STACK_SIZE   2048
+#define TASK_POOL_TEST1_STACK_SIZE   2048
+#define TASK_POOL_TEST2_STACK_SIZE   2048
+#define TIMER_TEST1_STACK_SIZE       2048
+#define TIMER_TEST2_STACK_SIZE       2048
+#define WAIT_TEST1_STACK_SIZE        2048
+#define WAIT_TEST2_STACK_SIZE        2048
+#define WAIT_TEST3_STACK_SIZE        2048
+#define WORK_QUEUE_TEST1_STACK_SIZE  2048
+#define WORK_QUEUE_TEST2_STACK_SIZE  2048
 
 /****************************************************************************
  *
@@ -56,7 +79,13 @@
 #define TASK_PREEMPTION  1
 #define TASK_LIST        1
 #define TASK_STACK_USAGE 1
+#define TASK_STACK_GUARD 4096
+#define TASK_POOLS       1
 #define TASK_AT_EXIT     1
+#define TASK_STATS       1
+#define TASK_LATENCY     1
+#define KERNEL_TRACE     1
+#define TASK_EDF         1
 #define TASK_TICK_HZ     1000
 #define TASK0_STACK_SIZE 2048
 
@@ -67,16 +96,40 @@
 #define TASK_LOW_PRIORITY   1
 #define TASK_NUM_PRIORITIES 2
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOTS  32
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define HRTIMERS 1
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define WORK_QUEUES 1
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define SMP_LOCK_STATS 1
+
 /****************************************************************************
  *
  ****************************************************************************/
 #define cpuID() _cpuID()
 #define cpuWake(id) _cpuWake(id)
+#define cpuPreempt(id) _cpuPreempt(id)
+#define memoryBarrier() _memoryBarrier()
 
 /****************************************************************************
- * allow the kernel to use malloc/free
+ * allow the kernel to use malloc/free (and memalign for guarded stacks)
  ****************************************************************************/
 #define kmalloc malloc
+#define kmemalign memalign
 #define kfree free
 
 /****************************************************************************
@@ -90,6 +143,11 @@
  *
  ****************************************************************************/
 void _cpuWake(int id);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _cpuPreempt(int id);
 #endif
 
 #endif
@@ -31,16 +31,20 @@
 #include <avr/sleep.h>
 #include <stdio.h>
 #include "board.h"
+#include "event_group_test.h"
 #include "kernel.h"
+#include "kernel_bench.h"
 #include "libc_glue.h"
 #include "mutex_test.h"
 #include "queue_test.h"
 #include "readline/history.h"
 #include "readline/readline.h"
+#include "ring_test.h"
 #include "semaphore_test.h"
 #include "shell/shell.h"
 #include "timer_test.h"
 #include "uart/avr_uart0.h"
+#include "wait_test.h"
 
 /****************************************************************************
  *
@@ -54,6 +58,7 @@ static ReadlineData readlineData = READLINE_DATA(256);
 static HistoryData historyData = HISTORY_DATA(4);
 static Task task0;
 static CharDev uart0;
+static volatile unsigned int timer1Overflows;
 
 /****************************************************************************
  *
@@ -69,10 +74,14 @@ static void taskListCmd(int argc, char* argv[])
 static const ShellCmd SHELL_CMDS[] =
 {
    {"tl", taskListCmd},
+   {"event_group_test", eventGroupTestCmd},
+   {"kernel_bench", kernelBenchCmd},
    {"mutex_test", mutexTestCmd},
    {"queue_test", queueTestCmd},
+   {"ring_test", ringTestCmd},
    {"semaphore_test", semaphoreTestCmd},
    {"timer_test", timerTestCmd},
+   {"wait_test", waitTestCmd},
    {NULL, NULL}
 };
 
@@ -114,6 +123,34 @@ ISR(TIMER2_COMPA_vect)
    _taskPreempt(true);
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+ISR(TIMER1_OVF_vect)
+{
+   timer1Overflows++;
+}
+
+/****************************************************************************
+ * timer1 counts at F_CPU / 8 (1MHz), the overflows extend it to 32 bits
+ ****************************************************************************/
+unsigned long kernelBenchClock()
+{
+   uint8_t sreg = SREG;
+   cli();
+
+   unsigned long high = timer1Overflows;
+   unsigned int low = TCNT1;
+
+   /* overflowed, but the interrupt has not been taken yet */
+   if ((TIFR1 & _BV(TOV1)) && (low < 0x8000))
+      high++;
+
+   SREG = sreg;
+
+   return (high << 16) | low;
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -130,15 +167,27 @@ int main()
    TCCR2A = 0x02;
    TIMSK2 = 0x02;
 
+   /* timer1 free running clock (1us) */
+   TCCR1A = 0x00;
+   TCCR1B = 0x02;
+   TIMSK1 = 0x01;
+
    set_sleep_mode(SLEEP_MODE_IDLE);
 
    puts("AliOS on AVR");
    sei();
 
+#if KERNEL_BENCH_BOOT
+   kernelBench();
+#endif
+
+   eventGroupTest();
    mutexTest();
    queueTest();
+   ringTest();
    semaphoreTest();
    timerTest();
+   waitTest();
 
    taskSetData(READLINE_DATA_ID, &readlineData);
    taskSetData(HISTORY_DATA_ID, &historyData);
@@ -31,15 +31,24 @@
 /****************************************************************************
  *
  ****************************************************************************/
-#define MUTEX_TEST1_STACK_SIZE     256
-#define MUTEX_TEST2_STACK_SIZE     256
-#define QUEUE_TEST1_STACK_SIZE     256
-#define QUEUE_TEST2_STACK_SIZE     256
-#define SEMAPHORE_TEST1_STACK_SIZE 256
-#define SEMAPHORE_TEST2_STACK_SIZE 256
-#define SEMAPHORE_TEST3_STACK_SIZE 256
-#define TIMER_TEST1_STACK_SIZE     256
-#define TIMER_TEST2_STACK_SIZE     256
+#define EVENT_GROUP_TEST1_STACK_SIZE 256
+#define EVENT_GROUP_TEST2_STACK_SIZE 256
+#define EVENT_GROUP_TEST3_STACK_SIZE 256
+#define KERNEL_BENCH1_STACK_SIZE     256
+#define KERNEL_BENCH2_STACK_SIZE     256
+#define MUTEX_TEST1_STACK_SIZE       256
+#define MUTEX_TEST2_STACK_SIZE       256
+#define QUEUE_TEST1_STACK_SIZE       256
+#define QUEUE_TEST2_STACK_SIZE       256
+#define RING_TEST1_STACK_SIZE        256
+#define SEMAPHORE_TEST1_STACK_SIZE   256
+#define SEMAPHORE_TEST2_STACK_SIZE   256
+#define SEMAPHORE_TEST3_STACK_SIZE   256
+#define TIMER_TEST1_STACK_SIZE       256
+#define TIMER_TEST2_STACK_SIZE       256
+#define WAIT_TEST1_STACK_SIZE        256
+#define WAIT_TEST2_STACK_SIZE        256
+#define WAIT_TEST3_STACK_SIZE        256
 
 /****************************************************************************
  *
@@ -59,4 +68,14 @@
 #define TASK_HIGH_PRIORITY     1
 #define TASK_LOW_PRIORITY      0
 
+/****************************************************************************
+ * keep the queue benchmark small enough for 8K of RAM
+ ****************************************************************************/
+#define KERNEL_BENCH_QUEUE_DEPTH 2
+
+/****************************************************************************
+ * ring indices must be single byte loads/stores on an 8-bit CPU
+ ****************************************************************************/
+#define RING_INDEX_TYPE unsigned char
+
 #endif
@@ -27,6 +27,7 @@
  ****************************************************************************/
 #include <stdio.h>
 #include "board.h"
+#include "event_group_test.h"
 #include "heap/heap.h"
 #include "kernel.h"
 #include "libc_glue.h"
@@ -39,10 +40,12 @@
 #include "readline/readline.h"
 #include "readline/history.h"
 //#include "rspi.h"
+#include "ring_test.h"
 #include "semaphore_test.h"
 #include "shell/shell.h"
 #include "timer_test.h"
 #include "uart/rx62n_uart.h"
+#include "wait_test.h"
 
 /****************************************************************************
  *
@@ -97,10 +100,13 @@ static const ShellCmd SHELL_CMDS[] =
 {
    {"tl", taskListCmd},
    {"heap", heapInfoCmd},
+   {"event_group_test", eventGroupTestCmd},
    {"mutex_test", mutexTestCmd},
    {"queue_test", queueTestCmd},
+   {"ring_test", ringTestCmd},
    {"semaphore_test", semaphoreTestCmd},
    {"timer_test", timerTestCmd},
+   {"wait_test", waitTestCmd},
    {NULL, NULL}
 };
 
@@ -269,10 +275,13 @@ int main(void* stack, unsigned long size)
    puts("AliOS on RX");
    enableInterrupts();
 
+   eventGroupTest();
    mutexTest();
    queueTest();
+   ringTest();
    semaphoreTest();
    timerTest();
+   waitTest();
 
    taskSetData(HISTORY_DATA_ID, &historyData);
    shellRun(SHELL_CMDS);
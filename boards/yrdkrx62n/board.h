@@ -35,15 +35,22 @@
 /****************************************************************************
  *
  ****************************************************************************/
-#define MUTEX_TEST1_STACK_SIZE     512
-#define MUTEX_TEST2_STACK_SIZE     512
-#define QUEUE_TEST1_STACK_SIZE     512
-#define QUEUE_TEST2_STACK_SIZE     512
-#define SEMAPHORE_TEST1_STACK_SIZE 512
-#define SEMAPHORE_TEST2_STACK_SIZE 512
-#define SEMAPHORE_TEST3_STACK_SIZE 512
-#define TIMER_TEST1_STACK_SIZE     512
-#define TIMER_TEST2_STACK_SIZE     512
+#define EVENT_GROUP_TEST1_STACK_SIZE 512
+#define EVENT_GROUP_TEST2_STACK_SIZE 512
+#define EVENT_GROUP_TEST3_STACK_SIZE 512
+#define MUTEX_TEST1_STACK_SIZE       512
+#define MUTEX_TEST2_STACK_SIZE       512
+#define QUEUE_TEST1_STACK_SIZE       512
+#define QUEUE_TEST2_STACK_SIZE       512
+#define RING_TEST1_STACK_SIZE        512
+#define SEMAPHORE_TEST1_STACK_SIZE   512
+#define SEMAPHORE_TEST2_STACK_SIZE   512
+#define SEMAPHORE_TEST3_STACK_SIZE   512
+#define TIMER_TEST1_STACK_SIZE       512
+#define TIMER_TEST2_STACK_SIZE       512
+#define WAIT_TEST1_STACK_SIZE        512
+#define WAIT_TEST2_STACK_SIZE        512
+#define WAIT_TEST3_STACK_SIZE        512
 
 /****************************************************************************
  *
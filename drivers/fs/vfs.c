@@ -70,6 +70,7 @@ typedef struct FD
    unsigned long offset;
    File* file;
    struct FD* next;
+   struct FD* prev;
 
 } FD;
 
@@ -89,20 +90,14 @@ static FD* fds = NULL;
 /****************************************************************************
  *
  ****************************************************************************/
-static FD* fdFind(int id, FD** _previous)
+static FD* fdFind(int id)
 {
-   FD* previous = NULL;
    FD* current = fds;
 
    while (current != NULL)
    {
       if (current->id == id)
-      {
-         if (_previous != NULL)
-            *_previous = previous;
-
          break;
-      }
 
       if (current->id > id)
       {
@@ -110,7 +105,6 @@ static FD* fdFind(int id, FD** _previous)
          break;
       }
 
-      previous = current;
       current = current->next;
    }
 
@@ -142,14 +136,12 @@ static FD* fdCreate(File* file)
       }
 
       fd->id = fd0->id + 1;
-      fd->next = fd1;
-      fd0->next = fd;
+      LIST_INSERT(fds, fd0, fd);
    }
    else
    {
       fd->id = VFS_FD_START;
-      fd->next = NULL;
-      fds = fd;
+      LIST_INSERT(fds, NULL, fd);
    }
 
    return fd;
@@ -513,7 +505,7 @@ int vfsOpen2(int id, const vfs_char_t* path)
 
    mutexLock(&lock, -1);
 
-   fd = fdFind(id, NULL);
+   fd = fdFind(id);
 
    if (fd != NULL)
    {
@@ -539,19 +531,15 @@ int vfsOpen2(int id, const vfs_char_t* path)
  ****************************************************************************/
 void vfsClose(int id)
 {
-   FD* previous = NULL;
    FD* fd = NULL;
 
    mutexLock(&lock, -1);
 
-   fd = fdFind(id, &previous);
+   fd = fdFind(id);
 
    if (fd != NULL)
    {
-      if (previous != NULL)
-         previous->next = fd->next;
-      else
-         fds = fd->next;
+      LIST_REMOVE(fds, fd);
 
       pathClose(fd->file);
       free(fd);
@@ -569,7 +557,7 @@ vfs_char_t* vfsIter(int id, void** iter)
    FD* fd = NULL;
 
    mutexLock(&lock, -1);
-   fd = fdFind(id, NULL);
+   fd = fdFind(id);
    mutexUnlock(&lock);
 
    if (fd != NULL)
@@ -586,7 +574,7 @@ void vfsIterStop(int id, void* iter)
    FD* fd = NULL;
 
    mutexLock(&lock, -1);
-   fd = fdFind(id, NULL);
+   fd = fdFind(id);
    mutexUnlock(&lock);
 
    if (fd != NULL)
@@ -601,7 +589,7 @@ unsigned long vfsRead(int id, void* buffer, unsigned long count)
    FD* fd = NULL;
 
    mutexLock(&lock, -1);
-   fd = fdFind(id, NULL);
+   fd = fdFind(id);
    mutexUnlock(&lock);
 
    if (fd != NULL)
@@ -667,7 +655,7 @@ int vfsStat2(int id, const vfs_char_t* path, unsigned int* mode,
 
    mutexLock(&lock, -1);
 
-   fd = fdFind(id, NULL);
+   fd = fdFind(id);
 
    if (fd != NULL)
    {
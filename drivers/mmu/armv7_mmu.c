@@ -27,6 +27,25 @@
  ****************************************************************************/
 #include "armv7_mmu.h"
 
+/****************************************************************************
+ * Makes a page table change visible: drains the write to the table, drops
+ * any TLB entry (on every CPU with SMP) for the address and flushes the
+ * prefetch buffer.
+ ****************************************************************************/
+static void tlbFlush(unsigned long vAddr)
+{
+   __asm__ __volatile__("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory");
+#ifdef SMP
+   __asm__ __volatile__("mcr p15, 0, %0, c8, c3, 1" : : "r" (vAddr));
+#else
+   __asm__ __volatile__("mcr p15, 0, %0, c8, c7, 1" : : "r" (vAddr));
+#endif
+   __asm__ __volatile__("mcr p15, 0, %0, c7, c10, 4" : : "r" (0));
+#if __ARM_ARCH >= 6
+   __asm__ __volatile__("mcr p15, 0, %0, c7, c5, 4" : : "r" (0) : "memory");
+#endif
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -45,7 +64,7 @@ bool mmuMap(MMU* mmu, unsigned int mode, void* _vAddr, void* _pAddr,
 
       if ((vAddr & 0x000FFFFF) || (pAddr & 0x000FFFFF) || (count < 256))
       {
-         unsigned long* l2 = NULL;
+         unsigned long* l2 = (unsigned long*) (mmu->l1[i] & 0xFFFFFC00);
          unsigned long j;
 
          if ((mmu->l1[i] & 0x00000003) != 0x00000001)
@@ -57,10 +76,12 @@ bool mmuMap(MMU* mmu, unsigned int mode, void* _vAddr, void* _pAddr,
 
             if ((mmu->l1[i] & 0x00000003) == 0x00000002)
             {
+               /* same attributes as small pages: AP, TEX, AP2, S and nG
+                  move down 6 bits, XN moves to bit 0 */
                unsigned long b = mmu->l1[i] & 0xFFF00000;
-               unsigned long m = ((mmu->l1[i] & 0x00008C00) >> 6) |
+               unsigned long m = ((mmu->l1[i] & 0x0003FC00) >> 6) |
                                  ((mmu->l1[i] & 0x00000010) >> 4) |
-                                 (mmu->l1[i] & 0x0000000C) | 0x00000001;
+                                 (mmu->l1[i] & 0x0000000C) | 0x00000002;
 
                for (j = 0; j < 256; j++)
                   l2[j] = (b + j * MMU_PAGE_SIZE) | m;
@@ -70,21 +91,31 @@ bool mmuMap(MMU* mmu, unsigned int mode, void* _vAddr, void* _pAddr,
          }
 
          j = (vAddr >> 12) & 0x000000FF;
-         l2[j] = pAddr | 0x00000002;
 
-         if ((mode & MMU_MODE_X) == 0)
-            l2[i] |= 0x00000001;
+         if (mode == 0)
+         {
+            l2[j] = 0;
+         }
+         else
+         {
+            l2[j] = pAddr | 0x00000002;
 
-         if (mode & MMU_MODE_KW)
-            l2[i] |= 0x00000010;
-         else if (mode & MMU_MODE_KR)
-            l2[i] |= 0x00000210;
+            if ((mode & MMU_MODE_X) == 0)
+               l2[j] |= 0x00000001;
 
-         if (mode & MMU_MODE_C)
-            l2[i] |= 0x00000008;
+            if (mode & MMU_MODE_KW)
+               l2[j] |= 0x00000010;
+            else if (mode & MMU_MODE_KR)
+               l2[j] |= 0x00000210;
 
-         if (mode & MMU_MODE_B)
-            l2[i] |= 0x00000004;
+            if (mode & MMU_MODE_C)
+               l2[j] |= 0x00000008;
+
+            if (mode & MMU_MODE_B)
+               l2[j] |= 0x00000004;
+         }
+
+         tlbFlush(vAddr);
 
          vAddr += MMU_PAGE_SIZE;
          pAddr += MMU_PAGE_SIZE;
@@ -94,25 +125,34 @@ bool mmuMap(MMU* mmu, unsigned int mode, void* _vAddr, void* _pAddr,
       {
          if ((mmu->l1[i] & 0x00000003) == 0x00000001)
          {
-            void* page = (void*) (mmu->l1[i] & (MMU_PAGE_SIZE - 1));
+            void* page = (void*) (mmu->l1[i] & 0xFFFFFC00);
             mmuFreePage(page);
          }
 
-         mmu->l1[i] = pAddr | 0x00000002;
+         if (mode == 0)
+         {
+            mmu->l1[i] = 0;
+         }
+         else
+         {
+            mmu->l1[i] = pAddr | 0x00000002;
 
-         if ((mode & MMU_MODE_X) == 0)
-            mmu->l1[i] |= 0x00000010;
+            if ((mode & MMU_MODE_X) == 0)
+               mmu->l1[i] |= 0x00000010;
 
-         if (mode & MMU_MODE_KW)
-            mmu->l1[i] |= 0x00000400;
-         else if (mode & MMU_MODE_KR)
-            mmu->l1[i] |= 0x00008400;
+            if (mode & MMU_MODE_KW)
+               mmu->l1[i] |= 0x00000400;
+            else if (mode & MMU_MODE_KR)
+               mmu->l1[i] |= 0x00008400;
 
-         if (mode & MMU_MODE_C)
-            mmu->l1[i] |= 0x00000008;
+            if (mode & MMU_MODE_C)
+               mmu->l1[i] |= 0x00000008;
 
-         if (mode & MMU_MODE_B)
-            mmu->l1[i] |= 0x00000004;
+            if (mode & MMU_MODE_B)
+               mmu->l1[i] |= 0x00000004;
+         }
+
+         tlbFlush(vAddr);
 
          vAddr += 256 * MMU_PAGE_SIZE;
          pAddr += 256 * MMU_PAGE_SIZE;
@@ -123,6 +163,50 @@ bool mmuMap(MMU* mmu, unsigned int mode, void* _vAddr, void* _pAddr,
    return true;
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int mmuGetMode(MMU* mmu, void* _vAddr)
+{
+   unsigned long vAddr = (unsigned long) _vAddr;
+   unsigned long d = mmu->l1[vAddr >> 20];
+   unsigned int mode = 0;
+
+   if ((d & 0x00000003) == 0x00000002)
+   {
+      if (d & 0x00000C00)
+         mode |= (d & 0x00008000) ? MMU_MODE_KR : MMU_MODE_KR | MMU_MODE_KW;
+
+      if ((d & 0x00000010) == 0)
+         mode |= MMU_MODE_X;
+   }
+   else if ((d & 0x00000003) == 0x00000001)
+   {
+      d = ((unsigned long*) (d & 0xFFFFFC00))[(vAddr >> 12) & 0x000000FF];
+
+      if ((d & 0x00000002) == 0)
+         return 0;
+
+      if (d & 0x00000030)
+         mode |= (d & 0x00000200) ? MMU_MODE_KR : MMU_MODE_KR | MMU_MODE_KW;
+
+      if ((d & 0x00000001) == 0)
+         mode |= MMU_MODE_X;
+   }
+   else
+   {
+      return 0;
+   }
+
+   if (d & 0x00000008)
+      mode |= MMU_MODE_C;
+
+   if (d & 0x00000004)
+      mode |= MMU_MODE_B;
+
+   return mode;
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
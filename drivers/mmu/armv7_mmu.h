@@ -77,11 +77,31 @@ void* mmuGetPage(unsigned int count);
 void mmuFreePage(void* page);
 
 /****************************************************************************
- *
+ * Function: mmuMap
+ *    - Maps pages (whole 1MB sections where possible).
+ * Arguments:
+ *    mmu   - translation table
+ *    mode  - MMU_MODE_* flags, 0 unmaps the pages (any access aborts)
+ *    vAddr - virtual address (page aligned)
+ *    pAddr - physical address (page aligned)
+ *    count - number of pages
+ * Returns:
+ *    - false if an address is not aligned or mmuGetPage() failed
  ****************************************************************************/
 bool mmuMap(MMU* mmu, unsigned int mode, void* vAddr, void* pAddr,
             unsigned int count);
 
+/****************************************************************************
+ * Function: mmuGetMode
+ *    - Gets the mapping of a page.
+ * Arguments:
+ *    mmu   - translation table
+ *    vAddr - virtual address
+ * Returns:
+ *    - MMU_MODE_* flags, 0 if the page is not mapped
+ ****************************************************************************/
+unsigned int mmuGetMode(MMU* mmu, void* vAddr);
+
 /****************************************************************************
  *
  ****************************************************************************/
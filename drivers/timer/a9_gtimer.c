@@ -0,0 +1,122 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdlib.h>
+#include "a9_gtimer.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define GTCNTLO(t) (*((volatile unsigned long*) (t->base + 0x000)))
+#define GTCNTHI(t) (*((volatile unsigned long*) (t->base + 0x004)))
+#define GTCR(t)    (*((volatile unsigned long*) (t->base + 0x008)))
+#define GTISR(t)   (*((volatile unsigned long*) (t->base + 0x00C)))
+#define GTCMPLO(t) (*((volatile unsigned long*) (t->base + 0x010)))
+#define GTCMPHI(t) (*((volatile unsigned long*) (t->base + 0x014)))
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define GTCR_TIMER_ENABLE 0x01
+#define GTCR_COMP_ENABLE  0x02
+#define GTCR_IRQ_ENABLE   0x04
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long long clockRead(HWClock* clock)
+{
+   A9GTimer* a9GTimer = (A9GTimer*) clock;
+   unsigned long hi;
+   unsigned long lo;
+
+   do
+   {
+      hi = GTCNTHI(a9GTimer);
+      lo = GTCNTLO(a9GTimer);
+
+   } while (GTCNTHI(a9GTimer) != hi);
+
+   return ((unsigned long long) hi << 32) | lo;
+}
+
+/****************************************************************************
+ * Early A9 revisions only fire when the counter equals the comparator, so
+ * a deadline that passes while it is being written is moved just ahead of
+ * the counter instead of being lost.
+ ****************************************************************************/
+static void clockProgram(HWClock* clock, unsigned long long deadline)
+{
+   A9GTimer* a9GTimer = (A9GTimer*) clock;
+
+   GTCR(a9GTimer) &= ~(GTCR_COMP_ENABLE | GTCR_IRQ_ENABLE);
+   GTISR(a9GTimer) = 1;
+
+   if (deadline == -1)
+      return;
+
+   for (;;)
+   {
+      GTCMPLO(a9GTimer) = (unsigned long) deadline;
+      GTCMPHI(a9GTimer) = (unsigned long) (deadline >> 32);
+      GTCR(a9GTimer) |= GTCR_COMP_ENABLE | GTCR_IRQ_ENABLE;
+
+      unsigned long long now = clockRead(clock);
+
+      if ((now < deadline) || (GTISR(a9GTimer) & 1))
+         break;
+
+      GTCR(a9GTimer) &= ~(GTCR_COMP_ENABLE | GTCR_IRQ_ENABLE);
+      deadline = now + clock->clk / 1000000 + 1;
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void a9GTimerIRQ(unsigned int n, void* _a9GTimer)
+{
+   A9GTimer* a9GTimer = (A9GTimer*) _a9GTimer;
+
+   GTCR(a9GTimer) &= ~(GTCR_COMP_ENABLE | GTCR_IRQ_ENABLE);
+   GTISR(a9GTimer) = 1;
+
+   if (a9GTimer->clock.callback != NULL)
+      a9GTimer->clock.callback(&a9GTimer->clock);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void a9GTimerInit(A9GTimer* a9GTimer, unsigned long clk)
+{
+   a9GTimer->clock.read = clockRead;
+   a9GTimer->clock.program = clockProgram;
+   a9GTimer->clock.clk = clk;
+
+   GTCR(a9GTimer) = GTCR_TIMER_ENABLE;
+}
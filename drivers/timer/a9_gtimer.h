@@ -0,0 +1,59 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#ifndef A9_GTIMER_H
+#define A9_GTIMER_H
+
+#include "hw_clock.h"
+
+/****************************************************************************
+ * base - address of the global timer (PERIPHBASE + 0x200)
+ ****************************************************************************/
+#define A9_GTIMER_CREATE(base) {{}, base}
+
+/****************************************************************************
+ * Cortex-A9 MPCore global timer: a 64-bit up counter shared by all CPUs
+ * with a comparator (and interrupt, PPI 27) banked per CPU.
+ ****************************************************************************/
+typedef struct
+{
+   HWClock clock;
+   unsigned long base;
+
+} A9GTimer;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void a9GTimerIRQ(unsigned int n, void* a9GTimer);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void a9GTimerInit(A9GTimer* a9GTimer, unsigned long clk);
+
+#endif
@@ -26,6 +26,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  ****************************************************************************/
 #include <stdlib.h>
+#include "platform.h"
 #include "sp804.h"
 
 /****************************************************************************
@@ -100,3 +101,93 @@ void sp804Init(SP804* sp804, unsigned long clk)
 
    TIMERCONTROL(sp804) |= 0x42;
 }
+
+/****************************************************************************
+ * The counter counts down from 0xFFFFFFFF, so ~value counts up.  It is
+ * extended to 64 bits by accumulating the (modulo 2^32) difference between
+ * reads; its wrap interrupt guarantees a read at least once per wrap.
+ ****************************************************************************/
+static unsigned long long clockRead(HWClock* clock)
+{
+   SP804Clock* sp804Clock = (SP804Clock*) clock;
+   SP804* counter = &sp804Clock->counter;
+
+   bool iFlag = disableInterrupts();
+
+   unsigned long value = ~TIMERVALUE(counter);
+   sp804Clock->count += value - sp804Clock->last;
+   sp804Clock->last = value;
+
+   unsigned long long count = sp804Clock->count;
+
+   if (iFlag)
+      enableInterrupts();
+
+   return count;
+}
+
+/****************************************************************************
+ * Deadlines beyond 32 bits fire early and are simply reprogrammed.
+ ****************************************************************************/
+static void clockProgram(HWClock* clock, unsigned long long deadline)
+{
+   SP804* event = &((SP804Clock*) clock)->event;
+
+   TIMERCONTROL(event) &= ~0x80;
+
+   if (deadline == -1)
+      return;
+
+   unsigned long long now = clockRead(clock);
+   unsigned long long delta = (deadline > now) ? deadline - now : 1;
+
+   if (delta > 0xFFFFFFFF)
+      delta = 0xFFFFFFFF;
+
+   TIMERLOAD(event) = (unsigned long) delta;
+   TIMERCONTROL(event) |= 0x80;
+}
+
+/****************************************************************************
+ * Both timers of the module share one interrupt.
+ ****************************************************************************/
+void sp804ClockIRQ(unsigned int n, void* _sp804Clock)
+{
+   SP804Clock* sp804Clock = (SP804Clock*) _sp804Clock;
+   SP804* counter = &sp804Clock->counter;
+   SP804* event = &sp804Clock->event;
+
+   if (TIMERMIS(counter))
+   {
+      TIMERINTCLR(counter) = 1;
+      clockRead(&sp804Clock->clock);
+   }
+
+   if (TIMERMIS(event))
+   {
+      TIMERINTCLR(event) = 1;
+
+      if (sp804Clock->clock.callback != NULL)
+         sp804Clock->clock.callback(&sp804Clock->clock);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void sp804ClockInit(SP804Clock* sp804Clock, unsigned long clk)
+{
+   SP804* counter = &sp804Clock->counter;
+   SP804* event = &sp804Clock->event;
+
+   sp804Clock->clock.read = clockRead;
+   sp804Clock->clock.program = clockProgram;
+   sp804Clock->clock.clk = clk;
+
+   /* one-shot, 32-bit, interrupt enabled */
+   TIMERCONTROL(event) = 0x23;
+
+   /* periodic, 32-bit, interrupt enabled, running */
+   TIMERLOAD(counter) = 0xFFFFFFFF;
+   TIMERCONTROL(counter) = 0xE2;
+}
@@ -28,6 +28,7 @@
 #ifndef SP804_H
 #define SP804_H
 
+#include "hw_clock.h"
 #include "hw_timer.h"
 
 /****************************************************************************
@@ -45,6 +46,26 @@ typedef struct
 
 } SP804;
 
+/****************************************************************************
+ * base - address of an SP804 module; its first timer is the clock event and
+ *        its second timer the (extended to 64-bit) free running counter
+ ****************************************************************************/
+#define SP804_CLOCK_CREATE(base) \
+   {{}, SP804_CREATE(base), SP804_CREATE((base) + 0x20), 0, 0}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   HWClock clock;
+   SP804 event;
+   SP804 counter;
+   unsigned long long count;
+   unsigned long last;
+
+} SP804Clock;
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -55,4 +76,14 @@ void sp804IRQ(unsigned int n, void* sp804);
  ****************************************************************************/
 void sp804Init(SP804* sp804, unsigned long clk);
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+void sp804ClockIRQ(unsigned int n, void* sp804Clock);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void sp804ClockInit(SP804Clock* sp804Clock, unsigned long clk);
+
 #endif
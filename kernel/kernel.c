@@ -41,6 +41,15 @@
 #error TASK_NUM_PRIORITIES must be at least one.
 #endif
 
+#if TASK_NUM_PRIORITIES > 127
+#error TASK_NUM_PRIORITIES cannot be more than 127.
+#endif
+
+#if TASK_EDF && ((TASK_EDF_PRIORITY < 0) || \
+                 (TASK_EDF_PRIORITY >= TASK_NUM_PRIORITIES))
+#error TASK_EDF_PRIORITY must be a valid priority.
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -59,6 +68,30 @@
 #define TASK_FLAG_IDLE    0x08
 #define TASK_FLAG_MALLOC  0x10
 #define TASK_FLAG_FREE    0x20
+#define TASK_FLAG_GUARD   0x40
+#define TASK_FLAG_POOL    0x80
+
+#if TASK_STACK_GUARD
+#if TASK_STACK_GUARD & (TASK_STACK_GUARD - 1)
+#error "TASK_STACK_GUARD must be a power of 2"
+#endif
+
+/****************************************************************************
+ * taskCreate() allocates a stack aligned (or over-allocates it by enough to
+ * align its guard), and the stack starts right above the guard
+ ****************************************************************************/
+#ifdef kmemalign
+#define TASK_GUARD(t) ((unsigned char*) (t)->stack.alloc)
+#else
+#define TASK_GUARD(t) ((unsigned char*) \
+   (((unsigned long) (t)->stack.alloc + TASK_STACK_GUARD - 1) & \
+    ~(TASK_STACK_GUARD - 1UL)))
+#endif
+#endif
+
+#if WORK_QUEUES && !SEMAPHORES
+#error "WORK_QUEUES requires SEMAPHORES"
+#endif
 
 /****************************************************************************
  *
@@ -67,6 +100,19 @@
 #define TASK_NUM_TASKDATA 0
 #endif
 
+/****************************************************************************
+ * The ready bitmap is indexed by "rank" where rank 0 is always the highest
+ * priority regardless of TASK_PRIORITY_POLARITY.  The mapping is its own
+ * inverse, so it converts both ways.
+ ****************************************************************************/
+#if TASK_PRIORITY_POLARITY
+#define TASK_RANK(p) (TASK_NUM_PRIORITIES - 1 - (p))
+#else
+#define TASK_RANK(p) (p)
+#endif
+
+#define TASK_READY_WORDS ((TASK_NUM_PRIORITIES + 31) / 32)
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -74,6 +120,45 @@
 #define _taskYield(t)
 #endif
 
+/****************************************************************************
+ * Function: countLeadingZeros
+ *    - Counts the leading zero bits of a (non-zero) 32-bit value.
+ * Notes:
+ *    - Platforms with a CLZ instruction should define a countLeadingZeros
+ *      macro in platform.h to replace this nibble table lookup.
+ ****************************************************************************/
+#ifndef countLeadingZeros
+static unsigned char countLeadingZeros(unsigned long value)
+{
+   static const unsigned char CLZ4[16] =
+   {
+      4, 3, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0
+   };
+
+   unsigned char n = 0;
+
+   if ((value & 0xFFFF0000) == 0)
+   {
+      n += 16;
+      value <<= 16;
+   }
+
+   if ((value & 0xFF000000) == 0)
+   {
+      n += 8;
+      value <<= 8;
+   }
+
+   if ((value & 0xF0000000) == 0)
+   {
+      n += 4;
+      value <<= 4;
+   }
+
+   return n + CLZ4[(value >> 28) & 0x0F];
+}
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -81,15 +166,51 @@
 #error SMP cannot be less than 1
 #endif
 
+#if defined(SMP) && (SMP > 32)
+#error SMP cannot be more than 32
+#endif
+
 /****************************************************************************
- *
+ * Each CPU owns a run queue.  Tasks are made ready on the run queue of the
+ * CPU they last ran on, and a CPU steals from another run queue only when
+ * that queue holds a higher priority task than its own (which includes
+ * the case where its own queue is empty).
  ****************************************************************************/
-static struct
+typedef struct
 {
-   Task* head;
-   Task* tail;
+   struct
+   {
+      Task* head;
+      Task* tail;
+
+   } ready[TASK_NUM_PRIORITIES];
+
+#if TASK_READY_WORDS > 1
+   unsigned long group;
+#endif
+   unsigned long map[TASK_READY_WORDS];
 
-} ready[TASK_NUM_PRIORITIES];
+#ifdef SMP
+   unsigned int count;
+   unsigned long steals;
+   unsigned long kicks;
+#endif
+
+} RunQueue;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifdef SMP
+static RunQueue runQueue[SMP];
+#define taskRunQueue(t) (&runQueue[(t)->cpu])
+#define TASK_CPU_MASK (((1UL << (SMP - 1)) << 1) - 1)
+#define taskCpuAllowed(t, c) \
+   (((t)->affinity == 0) || ((t)->affinity & (1UL << (c))))
+#else
+static RunQueue runQueue[1];
+#define taskRunQueue(t) (&runQueue[0])
+#endif
 
 /****************************************************************************
  *
@@ -97,22 +218,81 @@ static struct
 #ifdef SMP
 static Task* _current[SMP];
 #define current _current[cpuID()]
+#define cpuCurrent(cpu) _current[cpu]
 #else
 static Task* current;
+#define cpuCurrent(cpu) current
 #define _smpLock()
 #define _smpUnlock()
 #endif
 
+/****************************************************************************
+ * Lock order (SMP):
+ *
+ *    Queue/Semaphore/Mutex -> scheduler -> timer
+ *
+ * The scheduler lock is _smpLock(), the same lock kernelLock() takes, and
+ * covers the run queues, the sleep queue and task states.  It is the lock
+ * that is handed over on a task switch.  Object locks only cover an object
+ * and its waiters, so operations on unrelated objects run in parallel.
+ * The timer lock covers the timers and is taken inside the scheduler lock
+ * because reprogramming the dynamic tick needs both.
+ *
+ * A task holds one object lock at a time, except kernelWait() (and
+ * semaphoreTake2()) which takes its objects in address order.
+ * __taskPriority() runs with the scheduler lock held, so it only try-locks
+ * the objects a blocked task waits on (and leaves the wait list order alone
+ * if that fails).  Interrupts are disabled before any of these locks are
+ * taken.  Without SMP all of them collapse into kernelLock().
+ ****************************************************************************/
+#ifdef SMP
+#define kernelEnter() disableInterrupts()
+#define kernelLeave(iFlag) ((iFlag) ? enableInterrupts() : (void) 0)
+#define schedLock() _smpLock()
+#define schedUnlock() _smpUnlock()
+#define objectLock(obj) _spinLock(&(obj)->lock)
+#define objectTryLock(obj) _spinTryLock(&(obj)->lock)
+#define objectUnlock(obj) _spinUnlock(&(obj)->lock)
+#else
+#define kernelEnter() (kernelLock(), true)
+#define kernelLeave(iFlag) ((void) (iFlag), kernelUnlock())
+#define schedLock()
+#define schedUnlock()
+#define objectLock(obj)
+#define objectTryLock(obj) true
+#define objectUnlock(obj)
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
-static Task* inactive;
+static struct
+{
+   unsigned long now;
+   Task* heap;
+   Task* forever;
+
+} sleepQueue;
 
 /****************************************************************************
  *
  ****************************************************************************/
 static Task* reap;
 
+#if TASK_POOLS
+/****************************************************************************
+ * Size classes in order of increasing stack size.
+ ****************************************************************************/
+static TaskPool* taskPools = NULL;
+#endif
+
+#if TASK_EDF
+/****************************************************************************
+ * Number of tasks with a period (they need the tick count kept current).
+ ****************************************************************************/
+static unsigned int edfTasks;
+#endif
+
 #if TASK_NUM_TASKDATA > 0
 /****************************************************************************
  *
@@ -131,6 +311,11 @@ static struct
  ****************************************************************************/
 static void taskSetTimeout(unsigned char state, unsigned long ticks);
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskWait();
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -144,12 +329,106 @@ static Task reaper = TASK_CREATE("reaper", TASK_REAPER_PRIORITY,
  ****************************************************************************/
 static void __timerAdd(Timer* timer);
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   Timer* head;
+   Timer* tail;
+
+} TimerQueue;
+
+#if TIMER_WHEEL_LEVELS > 0
+/****************************************************************************
+ *
+ ****************************************************************************/
+#if TIMER_WHEEL_SLOTS == 2
+#define TIMER_WHEEL_BITS 1
+#elif TIMER_WHEEL_SLOTS == 4
+#define TIMER_WHEEL_BITS 2
+#elif TIMER_WHEEL_SLOTS == 8
+#define TIMER_WHEEL_BITS 3
+#elif TIMER_WHEEL_SLOTS == 16
+#define TIMER_WHEEL_BITS 4
+#elif TIMER_WHEEL_SLOTS == 32
+#define TIMER_WHEEL_BITS 5
+#else
+#error TIMER_WHEEL_SLOTS must be 2, 4, 8, 16 or 32.
+#endif
+
+#if (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS) > 32
+#error TIMER_WHEEL_LEVELS * log2(TIMER_WHEEL_SLOTS) cannot be more than 32.
+#endif
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/****************************************************************************
+ * Hierarchical timing wheel.  Level 0 slots are one tick wide and each
+ * level above is TIMER_WHEEL_SLOTS times wider.  A timer is placed by its
+ * absolute expiration and moves down a level when its slot's block begins
+ * (cascade).  Bit maps of the non-empty slots (slot 0 is the MSB) allow
+ * the next event to be found without walking empty slots, which keeps
+ * dynamic ticks cheap.
+ ****************************************************************************/
+static struct
+{
+   unsigned long now;
+   unsigned long map[TIMER_WHEEL_LEVELS];
+   Timer* slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+} wheel;
+#else
 /****************************************************************************
  *
  ****************************************************************************/
 static Timer* timers;
 #endif
 
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long timerSpin;
+#define timerLock() _spinLock(&timerSpin)
+#define timerUnlock() _spinUnlock(&timerSpin)
+#else
+#define timerLock()
+#define timerUnlock()
+#endif
+#endif
+
+#if SEMAPHORES
+/****************************************************************************
+ *
+ ****************************************************************************/
+static int taskPollWait(TaskPoll* poll, int size, unsigned char state,
+                        unsigned long ticks);
+#endif
+
+#if TASK_POOLS
+/****************************************************************************
+ * Puts a reaped task back on the free list of the pool it came from.
+ ****************************************************************************/
+static void taskPoolGive(Task* task)
+{
+   kernelLock();
+
+   for (TaskPool* pool = taskPools; pool != NULL; pool = pool->next)
+   {
+      if ((task >= pool->tasks) && (task < pool->tasks + pool->count))
+      {
+         task->next = pool->free;
+         pool->free = task;
+         pool->available++;
+         break;
+      }
+   }
+
+   kernelUnlock();
+}
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -174,10 +453,23 @@ static bool taskReaper()
          task->flags &= ~TASK_FLAG_RESTART;
          taskStart(task, task->start.fx, task->start.arg);
       }
+#if TASK_POOLS
+      else if (task->flags & TASK_FLAG_POOL)
+      {
+         taskPoolGive(task);
+      }
+#endif
 #ifdef kfree
       else if (task->flags & TASK_FLAG_FREE)
       {
+#if TASK_STACK_GUARD
+         if (task->flags & TASK_FLAG_GUARD)
+            taskStackGuard(TASK_GUARD(task), false);
+
+         kfree(task->stack.alloc);
+#else
          kfree(task->stack.base);
+#endif
          kfree(task);
       }
 #endif
@@ -204,7 +496,10 @@ static void taskReaperFx(void* arg)
       kernelLock();
 
       if (reap == NULL)
+      {
          taskSetTimeout(TASK_STATE_SLEEP, -1);
+         taskWait();
+      }
 
       kernelUnlock();
    }
@@ -214,1262 +509,4642 @@ static void taskReaperFx(void* arg)
 /****************************************************************************
  *
  ****************************************************************************/
-static void taskSetReady(Task* task)
+static void taskReadyMapSet(RunQueue* rq, signed char priority)
 {
-   task->state = TASK_STATE_READY;
-   task->next = NULL;
+   unsigned char rank = TASK_RANK(priority);
 
-   if (ready[task->priority].head != NULL)
-   {
-      ready[task->priority].tail->next = task;
-      ready[task->priority].tail = task;
-   }
-   else
-   {
-      ready[task->priority].head = task;
-      ready[task->priority].tail = task;
-   }
+   rq->map[rank / 32] |= 0x80000000UL >> (rank % 32);
+#if TASK_READY_WORDS > 1
+   rq->group |= 0x80000000UL >> (rank / 32);
+#endif
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-static Task* taskNext(signed char priority)
+static void taskReadyMapClr(RunQueue* rq, signed char priority)
 {
-#if TASK_PRIORITY_POLARITY
-   for (signed char i = TASK_NUM_PRIORITIES - 1; i > priority; i--)
-#else
-   for (signed char i = 0; i < priority; i++)
-#endif
-   {
-      if (ready[i].head != NULL)
-      {
-         Task* task = ready[i].head;
-         ready[i].head = ready[i].head->next;
-         return task;
-      }
-   }
+   unsigned char rank = TASK_RANK(priority);
 
-   return NULL;
+   rq->map[rank / 32] &= ~(0x80000000UL >> (rank % 32));
+#if TASK_READY_WORDS > 1
+   if (rq->map[rank / 32] == 0)
+      rq->group &= ~(0x80000000UL >> (rank / 32));
+#endif
 }
 
 /****************************************************************************
- *
+ * Returns the rank of the highest priority ready task on a run queue
+ * (TASK_NUM_PRIORITIES if the run queue is empty).
  ****************************************************************************/
-static void taskSwitch(Task* task)
+static unsigned char taskReadyMapFirst(RunQueue* rq)
 {
-   Task* previous = current;
+   unsigned char i = 0;
 
-   previous->flags &= ~TASK_FLAG_IDLE;
+#if TASK_READY_WORDS > 1
+   if (rq->group == 0)
+      return TASK_NUM_PRIORITIES;
 
-   switch (previous->state)
-   {
-      case TASK_STATE_RUN:
-         taskSetReady(previous);
-         break;
+   i = countLeadingZeros(rq->group);
+#else
+   if (rq->map[0] == 0)
+      return TASK_NUM_PRIORITIES;
+#endif
 
-      case TASK_STATE_END:
-         previous->next = reap;
-         reap = previous;
-         break;
-   }
+   return i * 32 + countLeadingZeros(rq->map[i]);
+}
 
-   current = task;
-   current->state = TASK_STATE_RUN;
-   current->next = NULL;
+#if TASK_EDF
+/****************************************************************************
+ * Returns true if task "a" has an earlier absolute deadline than task "b".
+ * Tasks without a period sort after every task with one.
+ ****************************************************************************/
+static bool taskEdfBefore(Task* a, Task* b)
+{
+   if (a->edf.period == 0)
+      return false;
 
-   _taskSwitch(previous, current);
+   if (b->edf.period == 0)
+      return true;
 
-#ifdef SMP
-   current->cpu = (unsigned char) cpuID();
-#endif
+   return (long) (a->edf.due - b->edf.due) < 0;
+}
+
+/****************************************************************************
+ * Returns true if the next task of the EDF band should preempt a current
+ * task of the same priority.
+ ****************************************************************************/
+static bool taskEdfPreempt(Task* task, unsigned char rank,
+                           signed char priority)
+{
+   return (rank == TASK_RANK(TASK_EDF_PRIORITY)) &&
+          (priority == TASK_EDF_PRIORITY) && taskEdfBefore(task, current);
 }
+#else
+#define taskEdfPreempt(task, rank, priority) false
+#endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-static void taskAdjTimeout(unsigned long adj)
+static void taskSetReady(Task* task)
 {
-   if ((inactive != NULL) && (inactive->inactive.timeout != -1))
+#ifdef SMP
+   /* a task only waits on the run queue of a CPU it may run on */
+   if (!taskCpuAllowed(task, task->cpu))
    {
-      if (inactive->inactive.timeout > adj)
-         inactive->inactive.timeout -= adj;
-      else
-         inactive->inactive.timeout = 1;
+      task->cpu = 0;
+
+      while (!taskCpuAllowed(task, task->cpu))
+         task->cpu++;
    }
+#endif
 
-#if TIMERS
-   if (timers != NULL)
+   RunQueue* rq = taskRunQueue(task);
+   Task* after = rq->ready[task->priority].tail;
+
+   task->state = TASK_STATE_READY;
+
+   if (rq->ready[task->priority].head == NULL)
+      taskReadyMapSet(rq, task->priority);
+
+#if TASK_EDF
+   /* the EDF band is kept in deadline order, first come first served on a
+      tie, so its head is always the next task to run */
+   if (task->priority == TASK_EDF_PRIORITY)
    {
-      if (timers->timeout[0] > adj)
-         timers->timeout[0] -= adj;
-      else
-         timers->timeout[0] = 1;
+      while ((after != NULL) && taskEdfBefore(task, after))
+         after = after->prev;
    }
 #endif
+
+   LIST_INSERT(rq->ready[task->priority].head, after, task);
+
+   if (after == rq->ready[task->priority].tail)
+      rq->ready[task->priority].tail = task;
+
+#ifdef SMP
+   rq->count++;
+#endif
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-static unsigned long taskGetTimeout()
+static void taskClrReady(Task* task)
 {
-   unsigned long timeout = -1;
+   RunQueue* rq = taskRunQueue(task);
 
-   if ((inactive != NULL) && (inactive->inactive.timeout < timeout))
-      timeout = inactive->inactive.timeout;
+   if (rq->ready[task->priority].tail == task)
+      rq->ready[task->priority].tail = task->prev;
 
-#if TIMERS
-   if ((timers != NULL) && (timers->timeout[0] < timeout))
-      timeout = timers->timeout[0];
+   LIST_REMOVE(rq->ready[task->priority].head, task);
+
+   if (rq->ready[task->priority].head == NULL)
+      taskReadyMapClr(rq, task->priority);
+
+#ifdef SMP
+   rq->count--;
 #endif
+}
 
-   return timeout;
+/****************************************************************************
+ * Gets the first task of a priority rank on a run queue that may run on
+ * this CPU (NULL if there is none).  Tasks pinned to other CPUs are passed
+ * over rather than stolen.
+ ****************************************************************************/
+static Task* taskReadyFirst(RunQueue* rq, unsigned char rank)
+{
+   Task* task = NULL;
+
+   if (rank < TASK_NUM_PRIORITIES)
+   {
+      task = rq->ready[TASK_RANK(rank)].head;
+#ifdef SMP
+      while ((task != NULL) && !taskCpuAllowed(task, cpuID()))
+         task = task->next;
+#endif
+   }
+
+   return task;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-static void taskSetTimeout(unsigned char state, unsigned long ticks)
+static Task* taskNext(signed char priority)
 {
-   Task* task = inactive;
+#ifdef SMP
+   RunQueue* local = &runQueue[cpuID()];
+#else
+   RunQueue* local = &runQueue[0];
+#endif
+   RunQueue* rq = local;
+   unsigned char rank = taskReadyMapFirst(rq);
+   Task* task = taskReadyFirst(rq, rank);
 
-   if (ticks > 0)
+#ifdef SMP
+   for (int cpu = 0; cpu < SMP; cpu++)
    {
-      unsigned long rTicks = ticks;
-      Task* previous = NULL;
+      unsigned char i = taskReadyMapFirst(&runQueue[cpu]);
 
-      if (rTicks != -1)
-         rTicks++;
+      if (i > rank)
+         continue;
 
-      while ((task != NULL) && (task->inactive.timeout != -1))
-      {
-         if (rTicks != -1)
-         {
-            if (rTicks < task->inactive.timeout)
-            {
-               task->inactive.timeout -= rTicks;
-               break;
-            }
-            else
-            {
-               rTicks -= task->inactive.timeout;
-            }
-         }
+      Task* next = taskReadyFirst(&runQueue[cpu], i);
 
-         previous = task;
-         task = task->next;
-      }
+      if (next == NULL)
+         continue;
 
-      current->state = state;
-      current->inactive.timeout = rTicks;
-      current->next = task;
-
-      if (previous != NULL)
+      if (i < rank)
       {
-         previous->next = current;
+         rq = &runQueue[cpu];
+         rank = i;
+         task = next;
       }
-      else
+#if TASK_EDF
+      else if ((i == TASK_RANK(TASK_EDF_PRIORITY)) &&
+               taskEdfBefore(next, task))
       {
-         unsigned long timeout = taskGetTimeout();
-
-         if (current->inactive.timeout < timeout)
-         {
-            bool adj = timeout != -1;
-            timeout = taskScheduleTick(adj, current->inactive.timeout);
-            taskAdjTimeout(timeout);
-         }
-
-         inactive = current;
+         rq = &runQueue[cpu];
+         task = next;
       }
+#endif
    }
+#endif
 
-   do
+   if ((task != NULL) && ((rank < TASK_RANK(priority)) ||
+                          taskEdfPreempt(task, rank, priority)))
    {
-      task = taskNext(TASK_LOWEND_PRIORITY);
-
-      if (task != NULL)
-      {
-         _taskYield(task);
-         taskSwitch(task);
-      }
-      else
-      {
-         current->flags |= TASK_FLAG_IDLE;
+      taskClrReady(task);
 
-         kernelUnlock();
-#if !TASK_REAPER
-         taskReaper();
+#ifdef SMP
+      if (rq != local)
+         local->steals++;
 #endif
-         taskIdle();
-         kernelLock();
+      return task;
+   }
 
-         current->flags &= ~TASK_FLAG_IDLE;
-      }
+   return NULL;
+}
 
-   } while (current->state != TASK_STATE_RUN);
+#ifdef SMP
+/****************************************************************************
+ * Gets the rank of the task running on a CPU (TASK_NUM_PRIORITIES if the
+ * CPU is idle).
+ ****************************************************************************/
+static unsigned char cpuRank(int cpu)
+{
+   if (_current[cpu]->flags & TASK_FLAG_IDLE)
+      return TASK_NUM_PRIORITIES;
+
+   return TASK_RANK(_current[cpu]->priority);
 }
 
 /****************************************************************************
- *
+ * Interrupts another CPU so that it reschedules.
  ****************************************************************************/
-static void taskCancelTimeout(Task* task)
+static void cpuKick(int cpu)
 {
-   Task* previous = NULL;
-   Task* ptr = inactive;
+   runQueue[cpu].kicks++;
 
-   while (ptr != NULL)
+   if (_current[cpu]->flags & TASK_FLAG_IDLE)
+      cpuWake(cpu);
+#if TASK_PREEMPTION
+   else
+      cpuPreempt(cpu);
+#endif
+}
+
+/****************************************************************************
+ * Kicks the CPU that should run a task that was just made ready, which is
+ * the CPU it may run on with the lowest priority work (preferring the CPU
+ * it last ran on), and only if the task outranks that work.  The current
+ * CPU is never kicked because its caller reschedules it anyway.
+ ****************************************************************************/
+static void taskKick(Task* task)
+{
+   unsigned char rank = TASK_RANK(task->priority);
+   int target = -1;
+
+   for (int i = 0; i < SMP; i++)
    {
-      if (ptr == task)
-      {
-         if ((task->inactive.timeout != -1) && (task->next != NULL) &&
-             (task->next->inactive.timeout != -1))
-         {
-            task->next->inactive.timeout += task->inactive.timeout;
-         }
+      int cpu = (task->cpu + i) % SMP;
 
-         if (previous != NULL)
-         {
-            previous->next = task->next;
-         }
-         else
-         {
-            inactive = task->next;
+      if ((_current[cpu] == NULL) || !taskCpuAllowed(task, cpu))
+         continue;
 
-            if ((task->inactive.timeout != -1) && (taskGetTimeout() == -1))
-               taskScheduleTick(false, 0);
-         }
+      unsigned char r = cpuRank(cpu);
 
-         if (task->flags & TASK_FLAG_IDLE)
-         {
-            task->state = TASK_STATE_RUN;
-#ifdef SMP
-            if (task->cpu != (unsigned char) cpuID())
-               cpuWake((int) task->cpu);
+      if (r > rank)
+      {
+         target = cpu;
+         rank = r;
+      }
+#if TASK_EDF
+      else if ((target == -1) && (r == TASK_RANK(TASK_EDF_PRIORITY)) &&
+               (r == rank) && taskEdfBefore(task, _current[cpu]))
+      {
+         target = cpu;
+      }
 #endif
-         }
-         else
-         {
-            taskSetReady(task);
+   }
+
+   if ((target != -1) && (target != (int) cpuID()))
+      cpuKick(target);
+}
+#else
+#define taskKick(task)
+#endif
+
+#if TASK_STATS
+/****************************************************************************
+ * Time (taskClock()) each CPU last charged to its running task or idle time
+ * and the idle time itself.
+ ****************************************************************************/
+static struct
+{
+   unsigned long long start;
+   TaskStats idle;
+
 #ifdef SMP
-            for (int cpu = 0; cpu < SMP; cpu++)
-            {
-               if (_current[cpu]->flags & TASK_FLAG_IDLE)
-               {
-                  cpuWake(cpu);
-                  break;
-               }
-            }
+} cpuStats[SMP];
+#else
+} cpuStats[1];
 #endif
-         }
-         break;
-      }
 
-      previous = ptr;
-      ptr = ptr->next;
+/****************************************************************************
+ * Advances accounting to a window, moving the time run in the windows that
+ * ended into "last" and the moving average.
+ ****************************************************************************/
+static void taskStatsRoll(TaskStats* stats, unsigned long long window)
+{
+   while (stats->window < window)
+   {
+      stats->average = (stats->average * (TASK_STATS_WINDOWS - 1) +
+                        stats->run) / TASK_STATS_WINDOWS;
+      stats->last = stats->run;
+      stats->run = 0;
+      stats->window++;
+
+      /* the windows left are empty and would change nothing */
+      if ((stats->last == 0) && (stats->average == 0))
+         stats->window = window;
    }
 }
 
 /****************************************************************************
- *
+ * Charges the time from "start" to "now" to "stats", split over the windows
+ * it spans.
  ****************************************************************************/
-static void taskPollAdd(TaskPoll** head, TaskPoll* poll)
+static void taskStatsAdd(TaskStats* stats, unsigned long long start,
+                         unsigned long long now)
 {
-   TaskPoll* previous = NULL;
-   TaskPoll* ptr = *head;
-
-   while (ptr != NULL)
+   while (start < now)
    {
-      if (poll->task->priority < ptr->task->priority)
-         break;
+      unsigned long long window = start / TASK_STATS_WINDOW;
+      unsigned long long end = (window + 1) * TASK_STATS_WINDOW;
 
-      previous = ptr;
-      ptr = ptr->next;
+      if (end > now)
+         end = now;
+
+      taskStatsRoll(stats, window);
+      stats->run += end - start;
+      stats->total += end - start;
+      start = end;
    }
+}
 
-   poll->next = ptr;
+/****************************************************************************
+ * Charges the time since the last charge on a CPU to the task it runs, or
+ * to its idle time if the task is idling.
+ ****************************************************************************/
+static void taskStatsCharge(int cpu)
+{
+   unsigned long long now = taskClock();
+   Task* task = cpuCurrent(cpu);
 
-   if (previous != NULL)
-      previous->next = poll;
+   if (task->flags & TASK_FLAG_IDLE)
+      taskStatsAdd(&cpuStats[cpu].idle, cpuStats[cpu].start, now);
    else
-      *head = poll;
+      taskStatsAdd(&task->stats, cpuStats[cpu].start, now);
+
+   cpuStats[cpu].start = now;
 }
 
 /****************************************************************************
- *
+ * Charges every CPU up to now and returns the current window.
  ****************************************************************************/
-static TaskPoll* taskPollDel(TaskPoll** head, Task* task)
+static unsigned long long taskStatsSync()
 {
-   TaskPoll* previous = NULL;
-   TaskPoll* ptr = *head;
-
-   while (ptr != NULL)
+   for (unsigned int cpu = 0; cpu < sizeof(cpuStats) / sizeof(cpuStats[0]);
+        cpu++)
    {
-      if (ptr->task == task)
-      {
-         if (previous != NULL)
-            previous->next = ptr->next;
-         else
-            *head = ptr->next;
+      if (cpuCurrent(cpu) != NULL)
+         taskStatsCharge(cpu);
+   }
 
-         ptr->next = NULL;
+   return cpuStats[cpuID()].start / TASK_STATS_WINDOW;
+}
+#else
+#define taskStatsCharge(cpu)
+#endif
 
-         return ptr;
-      }
+#if TASK_LATENCY
+/****************************************************************************
+ * Interrupt to task latency of each priority and the time (taskClock())
+ * each CPU entered the interrupt variant of an object it is giving (0 if
+ * none).
+ ****************************************************************************/
+static TaskLatency latencies[TASK_NUM_PRIORITIES];
 
-      previous = ptr;
-      ptr = ptr->next;
-   }
+#ifdef SMP
+static unsigned long long latencyStart[SMP];
+#else
+static unsigned long long latencyStart[1];
+#endif
 
-   return NULL;
+#define taskLatencyBegin() (latencyStart[cpuID()] = taskClock())
+#define taskLatencyEnd() (latencyStart[cpuID()] = 0)
+
+/****************************************************************************
+ * Stamps a task woken by the interrupt giving an object on this CPU.  The
+ * first wake up counts if there are several before it runs.
+ ****************************************************************************/
+static void taskLatencyStamp(Task* task)
+{
+   if (task->woken == 0)
+      task->woken = latencyStart[cpuID()];
 }
 
-#ifdef kmalloc
 /****************************************************************************
- *
+ * Adds the latency of a stamped task that is about to run to the histogram
+ * of its priority.
  ****************************************************************************/
-Task* taskCreate(const char* name, signed char priority,
-                 unsigned long stackSize, bool freeOnExit)
+static void taskLatencyAdd(Task* task)
 {
-   Task* task = kmalloc(sizeof(Task));
+   if (task->woken != 0)
+   {
+      TaskLatency* hist = &latencies[task->priority];
+      unsigned long long now = taskClock();
+      unsigned long delta = now > task->woken ? now - task->woken : 0;
+      unsigned int bucket = 0;
 
-   memset(task, 0, sizeof(Task));
+      while ((bucket < (TASK_LATENCY_BUCKETS - 1)) &&
+             ((delta >> bucket) != 0))
+      {
+         bucket++;
+      }
 
-   task->name = name;
-   task->priority = priority;
-   task->state = TASK_STATE_INIT;
-   task->flags = TASK_FLAG_MALLOC;
-   task->stack.size = stackSize;
-   task->stack.base = kmalloc(stackSize);
+      if ((hist->count == 0) || (delta < hist->min))
+         hist->min = delta;
+      if (delta > hist->max)
+         hist->max = delta;
 
-   if (freeOnExit)
-      task->flags |= TASK_FLAG_FREE;
+      hist->count++;
+      hist->sum += delta;
+      hist->buckets[bucket]++;
 
-   return task;
+      task->woken = 0;
+   }
 }
+#else
+#define taskLatencyBegin()
+#define taskLatencyEnd()
+#define taskLatencyStamp(task)
+#define taskLatencyAdd(task)
 #endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-static void __taskEntry()
-{
-   current->flags |= TASK_FLAG_STARTED;
-#ifdef SMP
-   current->cpu = (unsigned char) cpuID();
-#endif
-   _taskEntry(current);
-   current->start.fx(current->start.arg);
-   taskExit();
-}
+static void taskSliceStart(Task* task);
 
 /****************************************************************************
  *
  ****************************************************************************/
-static bool __taskStart(Task* task, void (*fx)(void*), void* arg)
+static void taskSwitch(Task* task)
 {
-   if (task->state != TASK_STATE_INIT)
-      return false;
+   Task* previous = current;
 
-   if (task->priority >= TASK_NUM_PRIORITIES)
-      task->priority = TASK_NUM_PRIORITIES - 1;
+   taskStatsCharge(cpuID());
 
-#if TASK_PREEMPTION
-   task->flags |= TASK_FLAG_PREEMPT;
-#endif
+   if (previous->flags & TASK_FLAG_IDLE)
+   {
+      kernelTrace(TRACE_RESUME, 0, previous->name);
+      previous->flags &= ~TASK_FLAG_IDLE;
+   }
 
-   task->start.fx = fx;
-   task->start.arg = arg;
+   switch (previous->state)
+   {
+      case TASK_STATE_RUN:
+         taskSetReady(previous);
+         taskKick(previous);
+         break;
 
-   taskSetup(task, __taskEntry);
+      case TASK_STATE_END:
+         previous->next = reap;
+         reap = previous;
+         break;
+   }
 
-   taskSetReady(task);
+   kernelTrace(TRACE_SWITCH, previous->state, task->name);
 
-   return true;
-}
+   current = task;
+   current->state = TASK_STATE_RUN;
+   current->next = NULL;
+#if TASK_STATS
+   current->stats.switches++;
+#endif
+   taskLatencyAdd(current);
 
-/****************************************************************************
- *
- ****************************************************************************/
-bool _taskStart(Task* task, void (*fx)(void*), void* arg)
-{
-   _smpLock();
-   bool success = __taskStart(task, fx, arg);
-   _smpUnlock();
+   taskSliceStart(current);
 
-   return success;
+   _taskSwitch(previous, current);
+
+#ifdef SMP
+   current->cpu = (unsigned char) cpuID();
+#endif
 }
 
+#if TIMERS
+#if TIMER_WHEEL_LEVELS > 0
 /****************************************************************************
  *
  ****************************************************************************/
-bool taskStart(Task* task, void (*fx)(void*), void* arg)
+static void timerWheelAdd(Timer* timer)
 {
-   kernelLock();
-
-   bool success = __taskStart(task, fx, arg);
+   unsigned long delta = timer->wheel.expire - wheel.now;
+   unsigned long expire = timer->wheel.expire;
+   unsigned char level = 0;
 
-   if (success)
+   while ((level < (TIMER_WHEEL_LEVELS - 1)) &&
+          ((delta >> (TIMER_WHEEL_BITS * (level + 1))) != 0))
    {
-      task = taskNext(current->priority);
+      level++;
+   }
 
-      if (task != NULL)
-         taskSwitch(task);
+   /* beyond the range of the wheel, park it in the farthest slot */
+   if ((delta >> (TIMER_WHEEL_BITS * level)) > TIMER_WHEEL_MASK)
+   {
+      expire = wheel.now +
+               ((unsigned long) TIMER_WHEEL_MASK << (TIMER_WHEEL_BITS * level));
    }
 
-   kernelUnlock();
+   unsigned char i = (expire >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
 
-   return success;
+   LIST_INSERT(wheel.slot[level][i], NULL, timer);
+   wheel.map[level] |= 0x80000000UL >> i;
+
+   timer->wheel.slot = level * TIMER_WHEEL_SLOTS + i + 1;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void taskExit()
+static bool timerWheelDel(Timer* timer)
 {
-#if TASK_AT_EXIT && defined(krealloc)
-   while (current->exit.size > 0)
-      current->exit.fx[--current->exit.size]();
-#ifdef kfree
-   kfree(current->exit.fx);
-#endif
-#endif
-
-   while (current->data != NULL)
-      taskSetData(current->data->id, NULL);
+   if (timer->wheel.slot == 0)
+      return false;
 
-#if TASK_REAPER
-   kernelLock();
-   if (reaper.state == TASK_STATE_SLEEP)
-      taskCancelTimeout(&reaper);
-#else
-   while (taskReaper());
-   kernelLock();
-#endif
+   unsigned char level = (timer->wheel.slot - 1) / TIMER_WHEEL_SLOTS;
+   unsigned char i = (timer->wheel.slot - 1) % TIMER_WHEEL_SLOTS;
 
-   for (;;)
-   {
-      Task* task = taskNext(TASK_LOWEND_PRIORITY);
+   LIST_REMOVE(wheel.slot[level][i], timer);
 
-      if (task != NULL)
-      {
-         current->state = TASK_STATE_END;
-         taskSwitch(task);
-      }
-      else
-      {
-         current->flags |= TASK_FLAG_IDLE;
+   if (wheel.slot[level][i] == NULL)
+      wheel.map[level] &= ~(0x80000000UL >> i);
 
-         kernelUnlock();
-#if !TASK_REAPER
-         taskReaper();
-#endif
-         taskIdle();
-         kernelLock();
+   timer->wheel.slot = 0;
 
-         current->flags &= ~TASK_FLAG_IDLE;
-      }
-   }
+   return true;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void taskChain(void (*fx)(void*), void* arg)
+static Timer* timerWheelTake(unsigned char level, unsigned char i)
 {
-   current->flags |= TASK_FLAG_RESTART;
-   current->start.fx = fx;
-   current->start.arg = arg;
+   Timer* timer = wheel.slot[level][i];
 
-   taskExit();
+   wheel.slot[level][i] = NULL;
+   wheel.map[level] &= ~(0x80000000UL >> i);
+
+   return timer;
 }
 
-#if TASK_AT_EXIT && defined(krealloc)
 /****************************************************************************
- *
+ * Returns the number of ticks until the wheel has work to do (-1 if the
+ * wheel is empty).  This can be a cascade rather than an expiration, which
+ * is fine as the tick is allowed to happen early.
  ****************************************************************************/
-int taskAtExit(void (*callback)())
+static unsigned long timerGetTimeout()
 {
-   unsigned int size = ++current->exit.size * sizeof(void*);
+   unsigned long timeout = -1;
 
-   current->exit.fx = krealloc(current->exit.fx, size);
-   current->exit.fx[current->exit.size - 1] = callback;
+   for (unsigned char level = 0; level < TIMER_WHEEL_LEVELS; level++)
+   {
+      unsigned long map = wheel.map[level];
 
-   return 0;
+      if (map == 0)
+         continue;
+
+      unsigned long block = (wheel.now >> (TIMER_WHEEL_BITS * level)) + 1;
+      unsigned char r = block & TIMER_WHEEL_MASK;
+      unsigned long ahead = map & (0xFFFFFFFFUL >> r);
+      unsigned char distance;
+
+      if (ahead != 0)
+         distance = countLeadingZeros(ahead) - r;
+      else
+         distance = countLeadingZeros(map) + TIMER_WHEEL_SLOTS - r;
+
+      block += distance;
+
+      unsigned long ticks = (block << (TIMER_WHEEL_BITS * level)) - wheel.now;
+
+      if (ticks < timeout)
+         timeout = ticks;
+   }
+
+   return timeout;
 }
-#endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-void taskSleep(unsigned long ticks)
+static void timerAdjTimeout(unsigned long adj)
 {
-   kernelLock();
-   taskSetTimeout(TASK_STATE_SLEEP, ticks);
-   kernelUnlock();
-}
+   unsigned long timeout = timerGetTimeout();
 
+   if ((timeout != -1) && (adj >= timeout))
+      adj = timeout - 1;
+
+   wheel.now += adj;
+}
+#else
 /****************************************************************************
  *
  ****************************************************************************/
-static void __taskPriority(Task* task, signed char priority)
+static unsigned long timerGetTimeout()
 {
-   if (task == NULL)
-      task = current;
-
-   if (task->priority == priority)
-      return;
+   return (timers != NULL) ? timers->timeout[0] : -1;
+}
 
-   switch (task->state)
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerAdjTimeout(unsigned long adj)
+{
+   if (timers != NULL)
    {
-      case TASK_STATE_READY:
-      {
-         Task* previous = NULL;
-         Task* ptr = ready[task->priority].head;
-
-         while (ptr != NULL)
-         {
-            if (ptr == task)
-            {
-               if (previous != NULL)
-                  previous->next = task->next;
-               else
-                  ready[task->priority].head = task->next;
-
-               if (task->next == NULL)
-                  ready[task->priority].tail = previous;
-
-               task->priority = priority;
-
-               taskSetReady(task);
-               break;
-            }
-
-            previous = ptr;
-            ptr = ptr->next;
-         }
-
-         break;
-      }
-
-      case TASK_STATE_RUN:
-      case TASK_STATE_SLEEP:
-         task->priority = priority;
-         break;
-
-#if QUEUES
-      case TASK_STATE_QUEUE:
-         task->priority = priority;
-         for (unsigned int i = 0; i < task->inactive.size; i++)
-         {
-            Queue* queue = task->inactive.poll[i].source;
-            TaskPoll* poll = taskPollDel(&queue->poll, task);
-            taskPollAdd(&queue->poll, poll);
-         }
-         break;
-#endif
-
-#if SEMAPHORES
-      case TASK_STATE_SEMAPHORE:
-         task->priority = priority;
-         for (unsigned int i = 0; i < task->inactive.size; i++)
-         {
-            Semaphore* semaphore = task->inactive.poll[i].source;
-            TaskPoll* poll = taskPollDel(&semaphore->poll, task);
-            taskPollAdd(&semaphore->poll, poll);
-         }
-         break;
-#endif
-
-#if MUTEXES
-      case TASK_STATE_MUTEX:
-         task->priority = priority;
-         for (unsigned int i = 0; i < task->inactive.size; i++)
-         {
-            Mutex* mutex = task->inactive.poll[i].source;
-            TaskPoll* poll = taskPollDel(&mutex->poll, task);
-            taskPollAdd(&mutex->poll, poll);
-         }
-         break;
-#endif
+      if (timers->timeout[0] > adj)
+         timers->timeout[0] -= adj;
+      else
+         timers->timeout[0] = 1;
    }
 }
+#endif
+#endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-void _taskPriority(Task* task, signed char priority)
+static bool taskSleepBefore(Task* a, Task* b)
 {
-   _smpLock();
-   __taskPriority(task, priority);
-   _smpUnlock();
+   return (long) (a->inactive.timeout - b->inactive.timeout) < 0;
 }
 
 /****************************************************************************
- *
+ * The root of a heap always has a NULL "prev" (it is the only node that has
+ * no parent or older sibling).
  ****************************************************************************/
-void taskPriority(Task* task, signed char priority)
+static Task* taskSleepMeld(Task* a, Task* b)
 {
-   kernelLock();
+   if (a == NULL)
+   {
+      if (b != NULL)
+         b->prev = NULL;
 
-   __taskPriority(task, priority);
+      return b;
+   }
 
-   task = taskNext(current->priority);
+   if (b == NULL)
+   {
+      a->prev = NULL;
+      return a;
+   }
 
-   if (task != NULL)
-      taskSwitch(task);
+   if (taskSleepBefore(b, a))
+   {
+      Task* tmp = a;
+      a = b;
+      b = tmp;
+   }
 
-   kernelUnlock();
+   b->next = a->inactive.child;
+   b->prev = a;
+
+   if (b->next != NULL)
+      b->next->prev = b;
+
+   a->inactive.child = b;
+   a->prev = NULL;
+
+   return a;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-bool taskSetData(int id, void* ptr)
+static Task* taskSleepMerge(Task* task)
 {
-   TaskData* previous = NULL;
-   TaskData* data = current->data;
+   Task* pairs = NULL;
+   Task* heap = NULL;
 
-   while (data != NULL)
+   while (task != NULL)
    {
-      if (data->id == id)
-         break;
-
-      previous = data;
-      data = data->next;
-   }
+      Task* a = task;
+      Task* b = task->next;
 
-   if (data != NULL)
-   {
-      if (ptr != NULL)
+      if (b != NULL)
       {
-         data->ptr = ptr;
+         task = b->next;
+         a->next = NULL;
+         b->next = NULL;
+         a = taskSleepMeld(a, b);
       }
       else
       {
-#if TASK_NUM_TASKDATA > 0
-         if (previous != NULL)
-            previous->next = data->next;
-         else
-            current->data = data->next;
+         task = NULL;
+      }
 
-         data->id = 0;
-         data->ptr = NULL;
+      a->next = pairs;
+      pairs = a;
+   }
 
-         kernelLock();
+   while (pairs != NULL)
+   {
+      task = pairs;
+      pairs = pairs->next;
+      task->next = NULL;
+      heap = taskSleepMeld(heap, task);
+   }
 
-         data->next = taskData.head;
-         taskData.head = data;
+   return heap;
+}
 
-         kernelUnlock();
-#elif defined(kmalloc) && defined(kfree)
-         kfree(data);
-#endif
-      }
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskSleepAdd(Task* task, unsigned long ticks)
+{
+   if (ticks != -1)
+   {
+      task->inactive.timeout = sleepQueue.now + ticks;
+
+      /* -1 is reserved for infinite waits, sleep one tick longer instead */
+      if (task->inactive.timeout == -1)
+         task->inactive.timeout = 0;
+
+      task->next = NULL;
+      task->prev = NULL;
+      task->inactive.child = NULL;
+      sleepQueue.heap = taskSleepMeld(sleepQueue.heap, task);
    }
-   else if (ptr != NULL)
+   else
    {
-#if TASK_NUM_TASKDATA > 0
-      kernelLock();
+      task->inactive.timeout = -1;
+      LIST_INSERT(sleepQueue.forever, NULL, task);
+   }
+}
 
-      if (taskData.head != NULL)
-      {
-         data = taskData.head;
-         taskData.head = taskData.head->next;
-      }
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskSleepDel(Task* task)
+{
+   if (task->inactive.timeout == -1)
+   {
+      LIST_REMOVE(sleepQueue.forever, task);
+   }
+   else if (task == sleepQueue.heap)
+   {
+      sleepQueue.heap = taskSleepMerge(task->inactive.child);
+   }
+   else
+   {
+      if (task->prev->inactive.child == task)
+         task->prev->inactive.child = task->next;
+      else
+         task->prev->next = task->next;
 
-      kernelUnlock();
-#elif defined(kmalloc)
-      data = kmalloc(sizeof(TaskData));
-#endif
-      if (data != NULL)
-      {
-         data->id = id;
-         data->ptr = ptr;
-         data->next = NULL;
+      if (task->next != NULL)
+         task->next->prev = task->prev;
 
-         if (previous != NULL)
-            previous->next = data;
-         else
-            current->data = data;
-      }
+      task->next = NULL;
+      sleepQueue.heap = taskSleepMeld(sleepQueue.heap,
+                                      taskSleepMerge(task->inactive.child));
    }
 
-   return data != NULL;
+   task->next = NULL;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void* taskGetData(int id)
+static void taskAdjTimeout(unsigned long adj)
 {
-   TaskData* data = current->data;
+   unsigned long now = adj;
 
-   while (data != NULL)
+   if (sleepQueue.heap != NULL)
    {
-      if (data->id == id)
-         return data->ptr;
+      unsigned long timeout = sleepQueue.heap->inactive.timeout -
+                              sleepQueue.now;
 
-      data = data->next;
+      if (timeout <= now)
+         now = timeout - 1;
    }
 
-   return NULL;
+   sleepQueue.now += now;
+
+#if TIMERS
+   timerLock();
+   timerAdjTimeout(adj);
+   timerUnlock();
+#endif
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void _taskPreempt(bool yield)
+static unsigned long taskGetTimeout()
 {
-   if (current->flags & TASK_FLAG_PREEMPT)
-   {
-      signed char priority = current->priority;
+   unsigned long timeout = -1;
 
-      if (yield)
-      {
-#if TASK_PRIORITY_POLARITY
-         priority--;
-#else
-         priority++;
-#endif
-      }
+   if (sleepQueue.heap != NULL)
+      timeout = sleepQueue.heap->inactive.timeout - sleepQueue.now;
 
-      _smpLock();
+#if TIMERS
+   timerLock();
+   unsigned long timerTimeout = timerGetTimeout();
+   timerUnlock();
 
-      Task* task = taskNext(priority);
+   if (timerTimeout < timeout)
+      timeout = timerTimeout;
+#endif
 
-      if (task != NULL)
-         taskSwitch(task);
+#if TASK_EDF
+   /* a running job is timed against the tick count, so it cannot stop */
+   if ((timeout == -1) && (edfTasks > 0))
+      timeout = (unsigned long) -1 >> 1;
+#endif
 
-      _smpUnlock();
+   return timeout;
+}
+
+/****************************************************************************
+ * Returns true if a task of the given priority is waiting on a run queue.
+ ****************************************************************************/
+static bool taskPeerReady(signed char priority)
+{
+   for (unsigned int i = 0; i < sizeof(runQueue) / sizeof(RunQueue); i++)
+   {
+      if (runQueue[i].ready[priority].head != NULL)
+         return true;
    }
+
+   return false;
 }
 
 /****************************************************************************
- *
+ * Gets the number of ticks left in the time slice of a task (-1 if the task
+ * is not time sliced).
  ****************************************************************************/
-void _taskTick(unsigned long _ticks)
+static unsigned long taskSliceLeft(Task* task)
 {
-   unsigned long ticks = _ticks;
+   unsigned long used = sleepQueue.now - task->slice.start;
 
-   if (ticks == -1)
-      return;
+   if (task->slice.quantum == 0)
+      return -1;
 
-   _smpLock();
+#if TASK_EDF
+   /* periodic tasks run in deadline order instead */
+   if ((task->priority == TASK_EDF_PRIORITY) && (task->edf.period != 0))
+      return -1;
+#endif
 
-   while (inactive != NULL)
-   {
-      if (inactive->inactive.timeout <= ticks)
-      {
-         Task* task = inactive;
-         inactive = inactive->next;
+   if (used >= task->slice.quantum)
+      return 0;
 
-         ticks -= task->inactive.timeout;
+   return task->slice.quantum - used;
+}
 
-         if (task->flags & TASK_FLAG_IDLE)
-         {
-            task->state = TASK_STATE_RUN;
+/****************************************************************************
+ * Shortens a tick timeout so that running time slices end on time.  A task
+ * with no other task of its priority waiting keeps running, so its slice
+ * never needs a tick of its own.
+ ****************************************************************************/
+static unsigned long taskSliceTimeout(unsigned long timeout)
+{
 #ifdef SMP
-            if (task->cpu != (unsigned char) cpuID())
-               cpuWake((int) task->cpu);
+   for (int cpu = 0; cpu < SMP; cpu++)
+   {
+      Task* task = _current[cpu];
+#else
+   {
+      Task* task = current;
 #endif
-         }
-         else
-         {
-            taskSetReady(task);
-         }
-      }
-      else
+      if ((task != NULL) && !(task->flags & TASK_FLAG_IDLE) &&
+          taskPeerReady(task->priority))
       {
-         if (inactive->inactive.timeout != -1)
-            inactive->inactive.timeout -= ticks;
+         unsigned long left = taskSliceLeft(task);
 
-         break;
+         if (left == 0)
+            left = 1;
+
+         if (left < timeout)
+            timeout = left;
       }
    }
 
-#if TIMERS
-   ticks = _ticks;
-
-   struct
-   {
-      Timer* head;
-      Timer* tail;
+   return timeout;
+}
 
-   } async = {NULL, NULL};
+/****************************************************************************
+ * Starts a new time slice for a task that is about to run.  A task made
+ * ready at the same priority while it runs gets its turn at the next tick.
+ ****************************************************************************/
+static void taskSliceStart(Task* task)
+{
+   task->slice.start = sleepQueue.now;
 
-   while (timers != NULL)
+   if (taskPeerReady(task->priority))
    {
-      if (timers->timeout[0] <= ticks)
-      {
-         Timer* timer = timers;
-         timers = timers->next;
-
-         ticks -= timer->timeout[0];
-
-         timer->timeout[0] = timer->timeout[1];
-         timer->next = NULL;
-
-         if (timer->flags & TIMER_FLAG_EXPIRED)
-            timer->flags |= TIMER_FLAG_OVERFLOW;
-         else
-            timer->flags |= TIMER_FLAG_EXPIRED;
+      unsigned long timeout = taskGetTimeout();
+      unsigned long slice = taskSliceTimeout(timeout);
 
-         if (timer->fx != NULL)
-         {
-            if (timer->task != NULL)
-            {
-               void (*fx)(void*) = (void (*)(void*)) timer->fx;
-
-               if (!__taskStart(timer->task, fx, timer))
-               {
-                  timer->task->flags |= TASK_FLAG_RESTART;
-                  timer->task->start.fx = fx;
-                  timer->task->start.arg = timer;
-               }
-
-               if (timer->flags & TIMER_FLAG_PERIODIC)
-                  __timerAdd(timer);
-            }
-            else
-            {
-               if (async.head != NULL)
-               {
-                  async.tail->next = timer;
-                  async.tail = timer;
-               }
-               else
-               {
-                  async.head = timer;
-                  async.tail = timer;
-               }
-            }
-         }
-         else if (timer->flags & TIMER_FLAG_PERIODIC)
-         {
-            __timerAdd(timer);
-         }
-      }
-      else
+      if (slice < timeout)
       {
-         timers->timeout[0] -= ticks;
-         break;
+         bool adj = timeout != -1;
+         timeout = taskScheduleTick(adj, slice);
+         taskAdjTimeout(timeout);
+
+         task->slice.start = sleepQueue.now;
       }
    }
+}
 
-   while (async.head != NULL)
+/****************************************************************************
+ * Sleeps the current task until "ticks" tick events from now (or forever
+ * if -1).
+ ****************************************************************************/
+static void taskSetWakeup(unsigned char state, unsigned long ticks)
+{
+   if (ticks != -1)
    {
-      Timer* timer = async.head;
-      async.head = async.head->next;
+      unsigned long timeout = taskGetTimeout();
 
-      _smpUnlock();
-      timer->fx(timer);
-      _smpLock();
-
-      if (timer->flags & TIMER_FLAG_PERIODIC)
-         __timerAdd(timer);
+      if (ticks < timeout)
+      {
+         bool adj = timeout != -1;
+         timeout = taskScheduleTick(adj, ticks);
+         taskAdjTimeout(timeout);
+      }
    }
-#endif
 
-   taskScheduleTick(false, taskGetTimeout());
-   _smpUnlock();
+   kernelTrace(TRACE_BLOCK, state, current->name);
+
+   current->state = state;
+   taskSleepAdd(current, ticks);
 }
 
-#if TASK_LIST
 /****************************************************************************
  *
  ****************************************************************************/
-static void taskPrint(Task* task)
+static void taskSetTimeout(unsigned char state, unsigned long ticks)
 {
-   const char* state = NULL;
-   const char* inactive = NULL;
-   unsigned long timeout = -1;
+   /* part of the current tick has already elapsed, so add a whole one */
+   if (ticks == -1)
+      taskSetWakeup(state, ticks);
+   else if (ticks > 0)
+      taskSetWakeup(state, ticks + 1);
+}
 
-   printf("%-18s", task->name);
+#if QUEUES
+/****************************************************************************
+ * Gets the number of ticks left until the timeout the current task last
+ * waited with, so a wait that was woken too early can be repeated.
+ ****************************************************************************/
+static unsigned long taskTimeoutLeft()
+{
+   unsigned long ticks = current->inactive.timeout;
 
-   switch (task->state)
+   if (ticks != -1)
    {
-      case TASK_STATE_INIT:
-         state = "init";
-         break;
-
-      case TASK_STATE_END:
-         state = "end";
-         break;
-
-      case TASK_STATE_RUN:
-         state = "run";
-         break;
-
-      case TASK_STATE_READY:
-         state = "ready";
-         break;
+      schedLock();
+      ticks -= sleepQueue.now + 1;
+      schedUnlock();
 
-      case TASK_STATE_SLEEP:
-         state = "sleep";
-         timeout = task->inactive.timeout;
-         break;
+      if ((long) ticks < 0)
+         ticks = 0;
+   }
 
-#if QUEUES
-      case TASK_STATE_QUEUE:
-         state = "queue";
-         inactive = ((Queue*) task->inactive.poll->source)->name;
-         timeout = task->inactive.timeout;
-         break;
+   return ticks;
+}
 #endif
 
-#if SEMAPHORES
-      case TASK_STATE_SEMAPHORE:
-         state = "semaphore";
-         inactive = ((Semaphore*) task->inactive.poll->source)->name;
-         timeout = task->inactive.timeout;
-         break;
+/****************************************************************************
+ * Idles with the scheduler lock released.  With SMP the lock may have been
+ * taken through kernelEnter(), which keeps the interrupt state itself, so
+ * interrupts are enabled directly (blocking calls require them enabled)
+ * rather than restored from the last kernelLock().
+ ****************************************************************************/
+static void taskIdleUnlocked()
+{
+#ifdef SMP
+   schedUnlock();
+   enableInterrupts();
+#else
+   kernelUnlock();
 #endif
-
-#if MUTEXES
-      case TASK_STATE_MUTEX:
-         state = "mutex";
-         inactive = ((Mutex*) task->inactive.poll->source)->name;
-         timeout = task->inactive.timeout;
-         break;
+#if !TASK_REAPER
+   taskReaper();
 #endif
-   }
-
+   taskIdle();
 #ifdef SMP
-   int i = printf("%s/%d", state, task->cpu);
-   while (i++ < 12)
-      putchar(' ');
+   disableInterrupts();
+   schedLock();
 #else
-   printf("%-12s", state);
+   kernelLock();
 #endif
+}
 
-   printf("%-5d", task->priority);
-   printf("%-5X", task->flags);
+/****************************************************************************
+ * Runs other tasks (or idles) until the current task is woken up.  This is
+ * called with the scheduler lock held and returns with it held.
+ ****************************************************************************/
+static void taskWait()
+{
+   Task* task;
 
-   if (inactive != NULL)
+   do
    {
-      int j = printf("%s", inactive);
+      task = taskNext(TASK_LOWEND_PRIORITY);
 
-      if (task->inactive.size > 1)
-         j += printf("*");
+      if (task != NULL)
+      {
+         _taskYield(task);
+         taskSwitch(task);
+      }
+      else
+      {
+         taskStatsCharge(cpuID());
+         current->flags |= TASK_FLAG_IDLE;
+         kernelTrace(TRACE_IDLE, 0, current->name);
 
-      while (j++ < 17)
-         putchar(' ');
-   }
-   else
-   {
-      printf("%-17s", "");
-   }
+         taskIdleUnlocked();
 
-   if (timeout != -1)
-      printf("%-10lu", timeout);
-   else
-      printf("%-10s", "");
+         kernelTrace(TRACE_RESUME, 0, current->name);
+         taskStatsCharge(cpuID());
+         current->flags &= ~TASK_FLAG_IDLE;
 
-#if TASK_STACK_USAGE
-   printf("%lu/%lu", taskStackUsage(task), task->stack.size);
-#endif
+         /* woken here without a scheduling decision (another CPU may
+            have made a better task ready at the same time) */
+         if (current->state == TASK_STATE_RUN)
+         {
+            task = taskNext(current->priority);
 
-   printf("\n");
+            if (task != NULL)
+               taskSwitch(task);
+            else
+               taskLatencyAdd(current);
+         }
+      }
+
+   } while (current->state != TASK_STATE_RUN);
 }
 
 /****************************************************************************
- *
+ * Wakes a task that was just taken off the sleep queue.  A task idling in
+ * its own context is simply resumed.
  ****************************************************************************/
-void taskList()
+static void taskWake(Task* task)
 {
-   Task* task = NULL;
-   int i;
-
-   kernelLock();
+   kernelTrace(TRACE_WAKE, task->priority, task->name);
 
-   printf("%-18s%-12s%-5s%-5s%-17s%-10s", "NAME", "STATE", "PRI", "FLG",
-          "WAIT", "TIMEOUT");
-#if TASK_STACK_USAGE
-   printf("STACK");
-#endif
-   printf("\n");
-
-   taskPrint(current);
-
-#ifdef SMP
-   for (i = 0; i < SMP; i++)
+   if (task->flags & TASK_FLAG_IDLE)
    {
-      if ((i != (int) cpuID()) && (_current[i]->state == TASK_STATE_RUN))
-         taskPrint(_current[i]);
-   }
+      task->state = TASK_STATE_RUN;
+#ifdef SMP
+      if (task->cpu != (unsigned char) cpuID())
+         cpuWake((int) task->cpu);
 #endif
-
-   for (i = 0; i < TASK_NUM_PRIORITIES; i++)
+   }
+   else
    {
-      task = ready[i].head;
-
-      while (task != NULL)
-      {
-         taskPrint(task);
-         task = task->next;
-      }
+      taskSetReady(task);
+      taskKick(task);
    }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskCancelTimeout(Task* task)
+{
+   /* tasks that already woke up are no longer on the sleep queue */
+   if (task->state < TASK_STATE_SLEEP)
+      return;
 
-   task = inactive;
+   taskSleepDel(task);
 
-   while (task != NULL)
+   if ((task->inactive.timeout != -1) &&
+       (taskSliceTimeout(taskGetTimeout()) == -1))
    {
-      taskPrint(task);
-      task = task->next;
+      taskScheduleTick(false, 0);
    }
 
-   task = reap;
+   taskWake(task);
+}
 
-   while (task != NULL)
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskPollAdd(TaskPoll** head, TaskPoll* poll)
+{
+   TaskPoll* previous = NULL;
+   TaskPoll* ptr = *head;
+
+   while (ptr != NULL)
    {
-      taskPrint(task);
-      task = task->next;
+      if (poll->task->priority < ptr->task->priority)
+         break;
+
+      previous = ptr;
+      ptr = ptr->next;
    }
 
-   kernelUnlock();
+   LIST_INSERT(*head, previous, poll);
 }
-#endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-void taskInit(Task* task, const char* name, signed char priority,
-              void* stackBase, unsigned long stackSize)
+static void taskPollDel(TaskPoll** head, TaskPoll* poll)
 {
-   task->name = name;
-   task->state = TASK_STATE_RUN;
-   task->flags = TASK_FLAG_STARTED;
-   task->priority = priority;
-   task->next = NULL;
+   /* already unlinked by taskPollWake() */
+   if ((poll->prev == NULL) && (*head != poll))
+      return;
 
-   _taskInit(task, stackBase, stackSize);
+   LIST_REMOVE(*head, poll);
+   poll->next = NULL;
+   poll->prev = NULL;
+}
 
-   current = task;
+/****************************************************************************
+ * Hands an object to its first waiter (object lock held) and returns that
+ * waiter, or NULL if there is none.  Waiters whose task was already woken
+ * (by another object of a kernelWait() or a timeout) are dropped, so an
+ * object is never handed to a task that will not consume it.  The waiter
+ * cannot return before the object lock is released, so the caller may
+ * still fill in its data.
+ ****************************************************************************/
+static TaskPoll* taskPollWake(TaskPoll** head)
+{
+   TaskPoll* poll;
 
-#ifdef SMP
-   if (cpuID() == 0)
-#endif
+   schedLock();
+
+   while ((poll = *head) != NULL)
    {
-#if TASK_NUM_TASKDATA > 0
-      taskData.head = &taskData.data[0];
+      taskPollDel(head, poll);
 
-      for (unsigned int i = 0; i < (TASK_NUM_TASKDATA - 1); i++)
-         taskData.data[i].next = &taskData.data[i + 1];
+      if (poll->task->state >= TASK_STATE_SLEEP)
+      {
+         poll->success = true;
+         taskLatencyStamp(poll->task);
+         taskCancelTimeout(poll->task);
+         break;
+      }
+   }
 
-      taskData.data[TASK_NUM_TASKDATA - 1].next = NULL;
-#endif
-#if TASK_REAPER
-      __taskStart(&reaper, taskReaperFx, NULL);
+   schedUnlock();
+
+   return poll;
+}
+
+#if QUEUES || SEMAPHORES || MUTEXES
+/****************************************************************************
+ * Gets the wait list of a kernelWait() object.
+ ****************************************************************************/
+static TaskPoll** taskPollHead(TaskPoll* poll)
+{
+   switch (poll->type)
+   {
+#if SEMAPHORES
+      case KERNEL_WAIT_SEMAPHORE:
+         return &((Semaphore*) poll->source)->poll;
+#endif
+#if MUTEXES
+      case KERNEL_WAIT_MUTEX:
+         return &((Mutex*) poll->source)->poll;
+#endif
+#if QUEUES
+      case KERNEL_WAIT_QUEUE_POP:
+      case KERNEL_WAIT_QUEUE_PUSH:
+         return &((Queue*) poll->source)->poll;
+#endif
+   }
+
+   return NULL;
+}
+
+#ifdef SMP
+/****************************************************************************
+ * Gets the object lock of a kernelWait() object.
+ ****************************************************************************/
+static unsigned long* taskPollLock(TaskPoll* poll)
+{
+   switch (poll->type)
+   {
+#if SEMAPHORES
+      case KERNEL_WAIT_SEMAPHORE:
+         return &((Semaphore*) poll->source)->lock;
+#endif
+#if MUTEXES
+      case KERNEL_WAIT_MUTEX:
+         return &((Mutex*) poll->source)->lock;
+#endif
+#if QUEUES
+      case KERNEL_WAIT_QUEUE_POP:
+      case KERNEL_WAIT_QUEUE_PUSH:
+         return &((Queue*) poll->source)->lock;
+#endif
+   }
+
+   return NULL;
+}
+
+#define taskPollTryLock(poll) _spinTryLock(taskPollLock(poll))
+#define taskPollUnlock(poll) _spinUnlock(taskPollLock(poll))
+#else
+#define taskPollTryLock(poll) true
+#define taskPollUnlock(poll)
+#endif
+#endif
+
+/****************************************************************************
+ * Switches to a higher priority task that an object operation made ready.
+ ****************************************************************************/
+static void taskReschedule()
+{
+   schedLock();
+
+   Task* task = taskNext(current->priority);
+
+   if (task != NULL)
+      taskSwitch(task);
+
+   schedUnlock();
+}
+
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Task* taskCreate(const char* name, signed char priority,
+                 unsigned long stackSize, bool freeOnExit)
+{
+   Task* task = kmalloc(sizeof(Task));
+
+   memset(task, 0, sizeof(Task));
+
+   task->name = name;
+   task->priority = priority;
+   task->state = TASK_STATE_INIT;
+   task->flags = TASK_FLAG_MALLOC;
+   task->slice.quantum = TASK_QUANTUM;
+   task->stack.size = stackSize;
+#if TASK_STACK_GUARD
+#ifdef kmemalign
+   task->stack.alloc = kmemalign(TASK_STACK_GUARD,
+                                 TASK_STACK_GUARD + stackSize);
+#else
+   task->stack.alloc = kmalloc(TASK_STACK_GUARD * 2 - 1 + stackSize);
+#endif
+   task->stack.base = TASK_GUARD(task) + TASK_STACK_GUARD;
+
+   if (taskStackGuard(TASK_GUARD(task), true))
+      task->flags |= TASK_FLAG_GUARD;
+#else
+   task->stack.base = kmalloc(stackSize);
+#endif
+
+   if (freeOnExit)
+      task->flags |= TASK_FLAG_FREE;
+
+   return task;
+}
+#endif
+
+#if TASK_POOLS
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskPoolAdd(TaskPool* pool)
+{
+   TaskPool* prev = NULL;
+
+   pool->free = NULL;
+   pool->available = pool->count;
+
+   for (unsigned int i = pool->count; i-- > 0;)
+   {
+      pool->tasks[i].next = pool->free;
+      pool->free = &pool->tasks[i];
+   }
+
+   kernelLock();
+
+   for (TaskPool* next = taskPools; next != NULL; next = next->next)
+   {
+      if (next->stackSize > pool->stackSize)
+         break;
+
+      prev = next;
+   }
+
+   if (prev != NULL)
+   {
+      pool->next = prev->next;
+      prev->next = pool;
+   }
+   else
+   {
+      pool->next = taskPools;
+      taskPools = pool;
+   }
+
+   kernelUnlock();
+}
+
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+TaskPool* taskPoolCreate(unsigned long stackSize, unsigned int count)
+{
+   TaskPool* pool = kmalloc(sizeof(TaskPool));
+
+   memset(pool, 0, sizeof(TaskPool));
+
+   pool->stackSize = stackSize;
+   pool->count = count;
+   pool->tasks = kmalloc(sizeof(Task) * count);
+   pool->stacks = kmalloc(stackSize * count);
+
+   taskPoolAdd(pool);
+
+   return pool;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+Task* taskPoolTake(const char* name, signed char priority,
+                   unsigned long stackSize)
+{
+   TaskPool* pool = taskPools;
+   Task* task = NULL;
+
+   kernelLock();
+
+   while ((pool != NULL) && (pool->stackSize < stackSize))
+      pool = pool->next;
+
+   if (pool != NULL)
+   {
+      task = pool->free;
+
+      if (task != NULL)
+      {
+         pool->free = task->next;
+         pool->available--;
+         pool->hits++;
+      }
+      else
+      {
+         pool->misses++;
+      }
+   }
+
+   kernelUnlock();
+
+   if (task == NULL)
+   {
+#ifdef kmalloc
+      return taskCreate(name, priority, stackSize, true);
+#else
+      return NULL;
+#endif
+   }
+
+   memset(task, 0, sizeof(Task));
+
+   task->name = name;
+   task->priority = priority;
+   task->state = TASK_STATE_INIT;
+   task->flags = TASK_FLAG_POOL;
+   task->slice.quantum = TASK_QUANTUM;
+   task->stack.size = pool->stackSize;
+   task->stack.base = pool->stacks + pool->stackSize * (task - pool->tasks);
+
+   return task;
+}
+#endif
+
+#if TASK_STACK_GUARD
+/****************************************************************************
+ *
+ ****************************************************************************/
+Task* taskStackFault(void* addr)
+{
+   Task* task = current;
+   unsigned char* guard;
+
+   if ((task == NULL) || !(task->flags & TASK_FLAG_GUARD))
+      return NULL;
+
+   guard = TASK_GUARD(task);
+
+   if (((unsigned char*) addr < guard) ||
+       ((unsigned char*) addr >= guard + TASK_STACK_GUARD))
+   {
+      return NULL;
+   }
+
+   return task;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void __taskEntry()
+{
+   current->flags |= TASK_FLAG_STARTED;
+#ifdef SMP
+   current->cpu = (unsigned char) cpuID();
+#endif
+   _taskEntry(current);
+   current->start.fx(current->start.arg);
+   taskExit();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __taskStart(Task* task, void (*fx)(void*), void* arg)
+{
+   if (task->state != TASK_STATE_INIT)
+      return false;
+
+   if (task->priority >= TASK_NUM_PRIORITIES)
+      task->priority = TASK_NUM_PRIORITIES - 1;
+
+#if TASK_PREEMPTION
+   task->flags |= TASK_FLAG_PREEMPT;
+#endif
+
+#ifdef SMP
+   task->cpu = (unsigned char) cpuID();
+#endif
+
+   task->start.fx = fx;
+   task->start.arg = arg;
+
+#if TASK_STATS
+   memset(&task->stats, 0, sizeof(TaskStats));
+#endif
+#if TASK_LATENCY
+   task->woken = 0;
+#endif
+
+   taskSetup(task, __taskEntry);
+
+   taskSetReady(task);
+   taskKick(task);
+
+   return true;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _taskStart(Task* task, void (*fx)(void*), void* arg)
+{
+   _smpLock();
+   bool success = __taskStart(task, fx, arg);
+   _smpUnlock();
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool taskStart(Task* task, void (*fx)(void*), void* arg)
+{
+   kernelLock();
+
+   bool success = __taskStart(task, fx, arg);
+
+   if (success)
+   {
+      task = taskNext(current->priority);
+
+      if (task != NULL)
+         taskSwitch(task);
+   }
+
+   kernelUnlock();
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskExit()
+{
+#if TASK_AT_EXIT && defined(krealloc)
+   while (current->exit.size > 0)
+      current->exit.fx[--current->exit.size]();
+#ifdef kfree
+   kfree(current->exit.fx);
+#endif
+#endif
+
+   while (current->data != NULL)
+      taskSetData(current->data->id, NULL);
+
+#if TASK_REAPER
+   kernelLock();
+   if (reaper.state == TASK_STATE_SLEEP)
+      taskCancelTimeout(&reaper);
+#else
+   while (taskReaper());
+   kernelLock();
+#endif
+
+#if TASK_EDF
+   if (current->edf.period != 0)
+   {
+      current->edf.period = 0;
+      edfTasks--;
+   }
+#endif
+
+   /* ended before idling, so an interrupt that preempts the idle loop
+      reaps the task rather than making it ready again */
+   current->state = TASK_STATE_END;
+
+   for (;;)
+   {
+      Task* task = taskNext(TASK_LOWEND_PRIORITY);
+
+      if (task != NULL)
+      {
+         taskSwitch(task);
+      }
+      else
+      {
+         taskStatsCharge(cpuID());
+         current->flags |= TASK_FLAG_IDLE;
+         kernelTrace(TRACE_IDLE, 0, current->name);
+
+         taskIdleUnlocked();
+
+         kernelTrace(TRACE_RESUME, 0, current->name);
+         taskStatsCharge(cpuID());
+         current->flags &= ~TASK_FLAG_IDLE;
+      }
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskChain(void (*fx)(void*), void* arg)
+{
+   current->flags |= TASK_FLAG_RESTART;
+   current->start.fx = fx;
+   current->start.arg = arg;
+
+   taskExit();
+}
+
+#if TASK_AT_EXIT && defined(krealloc)
+/****************************************************************************
+ *
+ ****************************************************************************/
+int taskAtExit(void (*callback)())
+{
+   unsigned int size = ++current->exit.size * sizeof(void*);
+
+   current->exit.fx = krealloc(current->exit.fx, size);
+   current->exit.fx[current->exit.size - 1] = callback;
+
+   return 0;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskSleep(unsigned long ticks)
+{
+   kernelLock();
+   taskSetTimeout(TASK_STATE_SLEEP, ticks);
+   taskWait();
+   kernelUnlock();
+}
+
+#if TASK_EDF
+/****************************************************************************
+ * Brings the tick count up to date.  With a dynamic tick the count only
+ * advances when a tick event fires, so the elapsed part of the pending one
+ * is folded in and the next event is brought forward to a tick away.
+ ****************************************************************************/
+static unsigned long taskEdfNow()
+{
+   if (taskGetTimeout() != -1)
+      taskAdjTimeout(taskScheduleTick(true, 1));
+
+   return sleepQueue.now;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskSetPeriod(Task* task, unsigned long period, unsigned long deadline)
+{
+   if (task == NULL)
+      task = current;
+
+   if (deadline == 0)
+      deadline = period;
+
+   kernelLock();
+
+   unsigned long now = taskEdfNow();
+
+   if ((task->edf.period == 0) && (period != 0))
+   {
+      /* the tick may have been stopped with nothing left to time */
+      bool stopped = taskGetTimeout() == -1;
+
+      edfTasks++;
+
+      if (stopped)
+         taskScheduleTick(false, taskGetTimeout());
+   }
+   else if ((task->edf.period != 0) && (period == 0))
+   {
+      edfTasks--;
+   }
+
+   task->edf.period = period;
+   task->edf.deadline = deadline;
+   task->edf.release = now;
+   task->edf.due = now + deadline;
+
+   if (task->state == TASK_STATE_READY)
+   {
+      taskClrReady(task);
+      taskSetReady(task);
+   }
+
+   task = taskNext(current->priority);
+
+   if (task != NULL)
+      taskSwitch(task);
+
+   kernelUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskWaitPeriod()
+{
+   kernelLock();
+
+   unsigned long now = taskEdfNow();
+
+   current->edf.jobs++;
+
+   if ((long) (now - current->edf.due) > 0)
+      current->edf.misses++;
+
+   current->edf.release += current->edf.period;
+
+   if ((long) (current->edf.release - now) < 0)
+      current->edf.release = now;
+
+   current->edf.due = current->edf.release + current->edf.deadline;
+
+   if (current->edf.release != now)
+   {
+      taskSetWakeup(TASK_STATE_SLEEP, current->edf.release - now);
+      taskWait();
+   }
+   else
+   {
+      /* released again at once, but with a later deadline */
+      Task* task = taskNext(current->priority);
+
+      if (task != NULL)
+         taskSwitch(task);
+   }
+
+   kernelUnlock();
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void __taskPriority(Task* task, signed char priority)
+{
+   if (task == NULL)
+      task = current;
+
+   if (task->priority == priority)
+      return;
+
+   switch (task->state)
+   {
+      case TASK_STATE_READY:
+         taskClrReady(task);
+         task->priority = priority;
+         taskSetReady(task);
+         taskKick(task);
+         break;
+
+      case TASK_STATE_RUN:
+      case TASK_STATE_SLEEP:
+      case TASK_STATE_RING:
+      case TASK_STATE_EVENT:
+         task->priority = priority;
+         break;
+
+#if QUEUES
+      case TASK_STATE_QUEUE:
+         task->priority = priority;
+         for (unsigned int i = 0; i < task->inactive.size; i++)
+         {
+            Queue* queue = task->inactive.poll[i].source;
+            TaskPoll* poll = &task->inactive.poll[i];
+
+            if (objectTryLock(queue))
+            {
+               taskPollDel(&queue->poll, poll);
+               taskPollAdd(&queue->poll, poll);
+               objectUnlock(queue);
+            }
+         }
+         break;
+#endif
+
+#if SEMAPHORES
+      case TASK_STATE_SEMAPHORE:
+         task->priority = priority;
+         for (unsigned int i = 0; i < task->inactive.size; i++)
+         {
+            Semaphore* semaphore = task->inactive.poll[i].source;
+            TaskPoll* poll = &task->inactive.poll[i];
+
+            if (objectTryLock(semaphore))
+            {
+               taskPollDel(&semaphore->poll, poll);
+               taskPollAdd(&semaphore->poll, poll);
+               objectUnlock(semaphore);
+            }
+         }
+         break;
+#endif
+
+#if MUTEXES
+      case TASK_STATE_MUTEX:
+         task->priority = priority;
+         for (unsigned int i = 0; i < task->inactive.size; i++)
+         {
+            Mutex* mutex = task->inactive.poll[i].source;
+            TaskPoll* poll = &task->inactive.poll[i];
+
+            if (objectTryLock(mutex))
+            {
+               taskPollDel(&mutex->poll, poll);
+               taskPollAdd(&mutex->poll, poll);
+               objectUnlock(mutex);
+            }
+         }
+         break;
+#endif
+
+#if QUEUES || SEMAPHORES || MUTEXES
+      case TASK_STATE_WAIT:
+         task->priority = priority;
+         for (unsigned int i = 0; i < task->inactive.size; i++)
+         {
+            TaskPoll* poll = &task->inactive.poll[i];
+
+            if (taskPollTryLock(poll))
+            {
+               taskPollDel(taskPollHead(poll), poll);
+               taskPollAdd(taskPollHead(poll), poll);
+               taskPollUnlock(poll);
+            }
+         }
+         break;
+#endif
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskPriority(Task* task, signed char priority)
+{
+   _smpLock();
+   __taskPriority(task, priority);
+   _smpUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskPriority(Task* task, signed char priority)
+{
+   kernelLock();
+
+   __taskPriority(task, priority);
+
+   task = taskNext(current->priority);
+
+   if (task != NULL)
+      taskSwitch(task);
+
+   kernelUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskSetQuantum(Task* task, unsigned long ticks)
+{
+   if (task == NULL)
+      task = current;
+
+   kernelLock();
+   task->slice.quantum = ticks;
+   kernelUnlock();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool taskSetAffinity(Task* task, unsigned long mask)
+{
+   Task* next;
+
+   mask &= TASK_CPU_MASK;
+
+   if (mask == 0)
+      return false;
+
+   if (task == NULL)
+      task = current;
+
+   kernelLock();
+
+   if (task->state == TASK_STATE_READY)
+   {
+      taskClrReady(task);
+      task->affinity = mask;
+      taskSetReady(task);
+      taskKick(task);
+   }
+   else
+   {
+      task->affinity = mask;
+   }
+
+   if ((task == current) && !taskCpuAllowed(current, cpuID()))
+   {
+      /* move now if this CPU has something else to run, otherwise the
+         task moves the next time it is switched out */
+      next = taskNext(TASK_LOWEND_PRIORITY);
+
+      if (next != NULL)
+      {
+         taskSetReady(current);
+         taskKick(current);
+         taskSwitch(next);
+      }
+   }
+   else
+   {
+      next = taskNext(current->priority);
+
+      if (next != NULL)
+         taskSwitch(next);
+   }
+
+   kernelUnlock();
+
+   return true;
+}
+#endif
+
+#if TASK_STATS
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskGetStats(Task* task, int cpu, TaskStats* stats)
+{
+   kernelLock();
+
+   unsigned long long window = taskStatsSync();
+
+   if (task == NULL)
+   {
+      taskStatsRoll(&cpuStats[cpu].idle, window);
+      *stats = cpuStats[cpu].idle;
+   }
+   else
+   {
+      taskStatsRoll(&task->stats, window);
+      *stats = task->stats;
+   }
+
+   kernelUnlock();
+}
+#endif
+
+#if TASK_LATENCY
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool taskGetLatency(signed char priority, TaskLatency* latency, bool reset)
+{
+   if ((priority < 0) || (priority >= TASK_NUM_PRIORITIES))
+      return false;
+
+   kernelLock();
+
+   *latency = latencies[priority];
+
+   if (reset)
+      memset(&latencies[priority], 0, sizeof(TaskLatency));
+
+   kernelUnlock();
+
+   return true;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long taskLatencyPercentile(const TaskLatency* latency,
+                                    unsigned int percent)
+{
+   unsigned long long rank = ((unsigned long long) latency->count * percent +
+                              99) / 100;
+   unsigned long long seen = 0;
+   unsigned long bound = 0;
+
+   if (latency->count == 0)
+      return 0;
+
+   for (unsigned int i = 0; i < TASK_LATENCY_BUCKETS; i++)
+   {
+      seen += latency->buckets[i];
+
+      if ((seen >= rank) && (seen > 0))
+         break;
+
+      bound = (bound << 1) | 1;
+   }
+
+   return (bound < latency->max) ? bound : latency->max;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool taskSetData(int id, void* ptr)
+{
+   TaskData* previous = NULL;
+   TaskData* data = current->data;
+
+   while (data != NULL)
+   {
+      if (data->id == id)
+         break;
+
+      previous = data;
+      data = data->next;
+   }
+
+   if (data != NULL)
+   {
+      if (ptr != NULL)
+      {
+         data->ptr = ptr;
+      }
+      else
+      {
+#if TASK_NUM_TASKDATA > 0
+         if (previous != NULL)
+            previous->next = data->next;
+         else
+            current->data = data->next;
+
+         data->id = 0;
+         data->ptr = NULL;
+
+         kernelLock();
+
+         data->next = taskData.head;
+         taskData.head = data;
+
+         kernelUnlock();
+#elif defined(kmalloc) && defined(kfree)
+         kfree(data);
+#endif
+      }
+   }
+   else if (ptr != NULL)
+   {
+#if TASK_NUM_TASKDATA > 0
+      kernelLock();
+
+      if (taskData.head != NULL)
+      {
+         data = taskData.head;
+         taskData.head = taskData.head->next;
+      }
+
+      kernelUnlock();
+#elif defined(kmalloc)
+      data = kmalloc(sizeof(TaskData));
+#endif
+      if (data != NULL)
+      {
+         data->id = id;
+         data->ptr = ptr;
+         data->next = NULL;
+
+         if (previous != NULL)
+            previous->next = data;
+         else
+            current->data = data;
+      }
+   }
+
+   return data != NULL;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* taskGetData(int id)
+{
+   TaskData* data = current->data;
+
+   while (data != NULL)
+   {
+      if (data->id == id)
+         return data->ptr;
+
+      data = data->next;
+   }
+
+   return NULL;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskPreempt(bool yield)
+{
+   if (current->flags & TASK_FLAG_PREEMPT)
+   {
+      signed char priority = current->priority;
+
+      if (yield && (taskSliceLeft(current) != 0))
+         yield = false;
+
+      if (yield)
+      {
+#if TASK_PRIORITY_POLARITY
+         priority--;
+#else
+         priority++;
+#endif
+      }
+
+      _smpLock();
+
+      Task* task = taskNext(priority);
+
+      if (task != NULL)
+         taskSwitch(task);
+
+      _smpUnlock();
+   }
+}
+
+#if TIMERS
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerExpire(Timer* timer, TimerQueue* async)
+{
+   timer->timeout[0] = timer->timeout[1];
+   timer->next = NULL;
+
+   if (timer->flags & TIMER_FLAG_EXPIRED)
+      timer->flags |= TIMER_FLAG_OVERFLOW;
+   else
+      timer->flags |= TIMER_FLAG_EXPIRED;
+
+   if (timer->fx != NULL)
+   {
+      kernelTrace(TRACE_TIMER, 0, timer->fx);
+
+      if (timer->task != NULL)
+      {
+         void (*fx)(void*) = (void (*)(void*)) timer->fx;
+
+         if (!__taskStart(timer->task, fx, timer))
+         {
+            timer->task->flags |= TASK_FLAG_RESTART;
+            timer->task->start.fx = fx;
+            timer->task->start.arg = timer;
+         }
+
+         if (timer->flags & TIMER_FLAG_PERIODIC)
+            __timerAdd(timer);
+      }
+      else
+      {
+         if (async->head != NULL)
+         {
+            async->tail->next = timer;
+            async->tail = timer;
+         }
+         else
+         {
+            async->head = timer;
+            async->tail = timer;
+         }
+      }
+   }
+   else if (timer->flags & TIMER_FLAG_PERIODIC)
+   {
+      __timerAdd(timer);
+   }
+}
+
+#if TIMER_WHEEL_LEVELS > 0
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerTick(unsigned long ticks, TimerQueue* async)
+{
+   while (ticks > 0)
+   {
+      unsigned long timeout = timerGetTimeout();
+
+      if (timeout > ticks)
+      {
+         wheel.now += ticks;
+         break;
+      }
+
+      wheel.now += timeout;
+      ticks -= timeout;
+
+      for (unsigned char level = 1; level < TIMER_WHEEL_LEVELS; level++)
+      {
+         unsigned long mask = (1UL << (TIMER_WHEEL_BITS * level)) - 1;
+
+         if (wheel.now & mask)
+            break;
+
+         unsigned char i = (wheel.now >> (TIMER_WHEEL_BITS * level)) &
+                           TIMER_WHEEL_MASK;
+         Timer* timer = timerWheelTake(level, i);
+
+         while (timer != NULL)
+         {
+            Timer* next = timer->next;
+            timerWheelAdd(timer);
+            timer = next;
+         }
+      }
+
+      Timer* timer = timerWheelTake(0, wheel.now & TIMER_WHEEL_MASK);
+
+      while (timer != NULL)
+      {
+         Timer* next = timer->next;
+         timer->wheel.slot = 0;
+         timerExpire(timer, async);
+         timer = next;
+      }
+   }
+}
+#else
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerTick(unsigned long ticks, TimerQueue* async)
+{
+   while (timers != NULL)
+   {
+      if (timers->timeout[0] <= ticks)
+      {
+         Timer* timer = timers;
+         LIST_REMOVE(timers, timer);
+
+         ticks -= timer->timeout[0];
+
+         timerExpire(timer, async);
+      }
+      else
+      {
+         timers->timeout[0] -= ticks;
+         break;
+      }
+   }
+}
+#endif
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskTick(unsigned long ticks)
+{
+   if (ticks == -1)
+      return;
+
+   _smpLock();
+
+   sleepQueue.now += ticks;
+
+   while ((sleepQueue.heap != NULL) &&
+          ((long) (sleepQueue.heap->inactive.timeout - sleepQueue.now) <= 0))
+   {
+      Task* task = sleepQueue.heap;
+      taskSleepDel(task);
+      taskWake(task);
+   }
+
+#if defined(SMP) && TASK_PREEMPTION
+   /* other CPUs only take a tick interrupt to end a time slice that a
+      task of equal priority is waiting on */
+   for (int cpu = 0; cpu < SMP; cpu++)
+   {
+      if ((cpu != (int) cpuID()) && (_current[cpu] != NULL) &&
+          !(_current[cpu]->flags & TASK_FLAG_IDLE) &&
+          (taskSliceLeft(_current[cpu]) == 0) &&
+          taskPeerReady(_current[cpu]->priority))
+      {
+         cpuKick(cpu);
+      }
+   }
+#endif
+
+#if TIMERS
+   TimerQueue async = {NULL, NULL};
+
+   timerLock();
+   timerTick(ticks, &async);
+   timerUnlock();
+
+   while (async.head != NULL)
+   {
+      Timer* timer = async.head;
+      async.head = async.head->next;
+
+      _smpUnlock();
+      timer->fx(timer);
+      _smpLock();
+
+      if (timer->flags & TIMER_FLAG_PERIODIC)
+      {
+         timerLock();
+         __timerAdd(timer);
+         timerUnlock();
+      }
+   }
+#endif
+
+   taskScheduleTick(false, taskSliceTimeout(taskGetTimeout()));
+   _smpUnlock();
+}
+
+#if TASK_LIST
+#if QUEUES || SEMAPHORES || MUTEXES
+/****************************************************************************
+ * Gets the name of a kernelWait() object.
+ ****************************************************************************/
+static const char* taskPollName(TaskPoll* poll)
+{
+   switch (poll->type)
+   {
+#if SEMAPHORES
+      case KERNEL_WAIT_SEMAPHORE:
+         return ((Semaphore*) poll->source)->name;
+#endif
+#if MUTEXES
+      case KERNEL_WAIT_MUTEX:
+         return ((Mutex*) poll->source)->name;
+#endif
+#if QUEUES
+      case KERNEL_WAIT_QUEUE_POP:
+      case KERNEL_WAIT_QUEUE_PUSH:
+         return ((Queue*) poll->source)->name;
+#endif
+   }
+
+   return NULL;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskPrint(Task* task)
+{
+   const char* state = NULL;
+   const char* inactive = NULL;
+   unsigned long timeout = -1;
+
+   printf("%-18s", task->name);
+
+   switch (task->state)
+   {
+      case TASK_STATE_INIT:
+         state = "init";
+         break;
+
+      case TASK_STATE_END:
+         state = "end";
+         break;
+
+      case TASK_STATE_RUN:
+         state = "run";
+         break;
+
+      case TASK_STATE_READY:
+         state = "ready";
+         break;
+
+      case TASK_STATE_SLEEP:
+         state = "sleep";
+         timeout = task->inactive.timeout;
+         break;
+
+#if QUEUES
+      case TASK_STATE_QUEUE:
+         state = "queue";
+         inactive = ((Queue*) task->inactive.poll->source)->name;
+         timeout = task->inactive.timeout;
+         break;
+#endif
+
+#if SEMAPHORES
+      case TASK_STATE_SEMAPHORE:
+         state = "semaphore";
+         inactive = ((Semaphore*) task->inactive.poll->source)->name;
+         timeout = task->inactive.timeout;
+         break;
+#endif
+
+#if MUTEXES
+      case TASK_STATE_MUTEX:
+         state = "mutex";
+         inactive = ((Mutex*) task->inactive.poll->source)->name;
+         timeout = task->inactive.timeout;
+         break;
+#endif
+
+#if RINGS
+      case TASK_STATE_RING:
+         state = "ring";
+         inactive = ((Ring*) task->inactive.poll->source)->name;
+         timeout = task->inactive.timeout;
+         break;
+#endif
+
+#if EVENT_GROUPS
+      case TASK_STATE_EVENT:
+         state = "event";
+         inactive = ((EventGroup*) task->inactive.poll->source)->name;
+         timeout = task->inactive.timeout;
+         break;
+#endif
+
+#if QUEUES || SEMAPHORES || MUTEXES
+      case TASK_STATE_WAIT:
+         state = "wait";
+         inactive = taskPollName(task->inactive.poll);
+         timeout = task->inactive.timeout;
+         break;
+#endif
+   }
+
+   if (timeout != -1)
+      timeout -= sleepQueue.now;
+
+#ifdef SMP
+   int i = printf("%s/%d", state, task->cpu);
+   while (i++ < 12)
+      putchar(' ');
+#else
+   printf("%-12s", state);
+#endif
+
+   printf("%-5d", task->priority);
+   printf("%-5X", task->flags);
+
+   if (inactive != NULL)
+   {
+      int j = printf("%s", inactive);
+
+      if (task->inactive.size > 1)
+         j += printf("*");
+
+      while (j++ < 17)
+         putchar(' ');
+   }
+   else
+   {
+      printf("%-17s", "");
+   }
+
+   if (timeout != -1)
+      printf("%-10lu", timeout);
+   else
+      printf("%-10s", "");
+
+#ifdef SMP
+   printf("%-6lX", task->affinity ? task->affinity : TASK_CPU_MASK);
+#endif
+
+#if TASK_EDF
+   if (task->edf.period != 0)
+   {
+      int k = printf("%lu/%lu", task->edf.misses, task->edf.jobs);
+
+      while (k++ < 12)
+         putchar(' ');
+   }
+   else
+   {
+      printf("%-12s", "");
+   }
+#endif
+
+#if TASK_STACK_USAGE
+   printf("%lu/%lu", taskStackUsage(task), task->stack.size);
+#endif
+
+   printf("\n");
+}
+
+/****************************************************************************
+ * Calls "fx" for every task the kernel knows of (running, ready, inactive
+ * and waiting to be reaped).
+ ****************************************************************************/
+static void taskListWalk(void (*fx)(Task*))
+{
+   Task* task = NULL;
+   int i;
+
+   fx(current);
+
+#ifdef SMP
+   for (i = 0; i < SMP; i++)
+   {
+      if ((i != (int) cpuID()) && (_current[i]->state == TASK_STATE_RUN))
+         fx(_current[i]);
+   }
+#endif
+
+   for (unsigned int j = 0; j < sizeof(runQueue) / sizeof(RunQueue); j++)
+   {
+      for (i = 0; i < TASK_NUM_PRIORITIES; i++)
+      {
+         task = runQueue[j].ready[i].head;
+
+         while (task != NULL)
+         {
+            fx(task);
+            task = task->next;
+         }
+      }
+   }
+
+   task = sleepQueue.forever;
+
+   while (task != NULL)
+   {
+      fx(task);
+      task = task->next;
+   }
+
+   task = sleepQueue.heap;
+
+   while (task != NULL)
+   {
+      fx(task);
+
+      if (task->inactive.child != NULL)
+      {
+         task = task->inactive.child;
+      }
+      else
+      {
+         /* Task.prev is shared with the run and forever lists, so never
+            follow it (or next) from the root */
+         while ((task != sleepQueue.heap) && (task->next == NULL))
+         {
+            while (task->prev->inactive.child != task)
+               task = task->prev;
+
+            task = task->prev;
+         }
+
+         task = (task != sleepQueue.heap) ? task->next : NULL;
+      }
+   }
+
+   task = reap;
+
+   while (task != NULL)
+   {
+      fx(task);
+      task = task->next;
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskList()
+{
+   kernelLock();
+
+   printf("%-18s%-12s%-5s%-5s%-17s%-10s", "NAME", "STATE", "PRI", "FLG",
+          "WAIT", "TIMEOUT");
+#ifdef SMP
+   printf("%-6s", "CPUS");
+#endif
+#if TASK_EDF
+   printf("%-12s", "MISS/JOBS");
+#endif
+#if TASK_STACK_USAGE
+   printf("STACK");
+#endif
+   printf("\n");
+
+   taskListWalk(taskPrint);
+
+   kernelUnlock();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskListCPU()
+{
+   kernelLock();
+
+   printf("%-5s%-18s%-7s%-10s%s\n", "CPU", "TASK", "READY", "STEALS",
+          "KICKS");
+
+   for (int cpu = 0; cpu < SMP; cpu++)
+   {
+      printf("%-5d%-18s%-7u%-10lu%lu\n", cpu, _current[cpu]->name,
+             runQueue[cpu].count, runQueue[cpu].steals, runQueue[cpu].kicks);
+   }
+
+   kernelUnlock();
+}
+#endif
+
+#if TASK_STATS
+/****************************************************************************
+ * Prints the last window and average shares of one CPU used by "stats".
+ ****************************************************************************/
+static void taskTopLoad(TaskStats* stats)
+{
+   unsigned long load[2] = {stats->last, stats->average};
+
+   for (int i = 0; i < 2; i++)
+   {
+      unsigned long permille = (unsigned long long) load[i] * 1000 /
+                               TASK_STATS_WINDOW;
+      int j = printf("%lu.%lu", permille / 10, permille % 10);
+
+      while (j++ < 7)
+         putchar(' ');
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskTopPrint(Task* task)
+{
+   taskStatsRoll(&task->stats, cpuStats[cpuID()].start / TASK_STATS_WINDOW);
+
+   printf("%-18s", task->name);
+   taskTopLoad(&task->stats);
+   printf("%-10lu%lu.%03lu\n", task->stats.switches,
+          (unsigned long) (task->stats.total / 1000000),
+          (unsigned long) (task->stats.total / 1000 % 1000));
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskTop()
+{
+   kernelLock();
+
+   unsigned long long window = taskStatsSync();
+
+   printf("%-18s%-7s%-7s%-10s%s\n", "NAME", "CPU%", "AVG%", "SWITCHES",
+          "TIME");
+
+   taskListWalk(taskTopPrint);
+
+   for (unsigned int cpu = 0; cpu < sizeof(cpuStats) / sizeof(cpuStats[0]);
+        cpu++)
+   {
+      TaskStats* idle = &cpuStats[cpu].idle;
+
+      taskStatsRoll(idle, window);
+
+#ifdef SMP
+      int i = printf("idle/%u", cpu);
+      while (i++ < 18)
+         putchar(' ');
+#else
+      printf("%-18s", "idle");
+#endif
+      taskTopLoad(idle);
+      printf("%-10s%lu.%03lu\n", "", (unsigned long) (idle->total / 1000000),
+             (unsigned long) (idle->total / 1000 % 1000));
+   }
+
+   kernelUnlock();
+}
+#endif
+
+#if TASK_POOLS
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskPoolList()
+{
+   kernelLock();
+
+   printf("%-10s%-8s%-8s%-10s%s\n", "STACK", "COUNT", "FREE", "HITS",
+          "MISSES");
+
+   for (TaskPool* pool = taskPools; pool != NULL; pool = pool->next)
+   {
+      printf("%-10lu%-8u%-8u%-10lu%lu\n", pool->stackSize, pool->count,
+             pool->available, pool->hits, pool->misses);
+   }
+
+   kernelUnlock();
+}
+#endif
+
+#if TASK_LATENCY
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskListLatency()
+{
+   kernelLock();
+
+   printf("%-6s%-10s%-8s%-8s%-8s%-8s%-8s%s\n", "PRIO", "COUNT", "MIN", "AVG",
+          "P50", "P90", "P99", "MAX");
+
+   for (int i = 0; i < TASK_NUM_PRIORITIES; i++)
+   {
+      TaskLatency* hist = &latencies[i];
+
+      if (hist->count == 0)
+         continue;
+
+      printf("%-6d%-10lu%-8lu%-8lu%-8lu%-8lu%-8lu%lu\n", i, hist->count,
+             hist->min, (unsigned long) (hist->sum / hist->count),
+             taskLatencyPercentile(hist, 50), taskLatencyPercentile(hist, 90),
+             taskLatencyPercentile(hist, 99), hist->max);
+   }
+
+   kernelUnlock();
+}
+#endif
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskInit(Task* task, const char* name, signed char priority,
+              void* stackBase, unsigned long stackSize)
+{
+   task->name = name;
+   task->state = TASK_STATE_RUN;
+   task->flags = TASK_FLAG_STARTED;
+   task->priority = priority;
+   task->slice.quantum = TASK_QUANTUM;
+   task->next = NULL;
+#ifdef SMP
+   task->cpu = (unsigned char) cpuID();
+#endif
+
+   _taskInit(task, stackBase, stackSize);
+
+   current = task;
+#if TASK_STATS
+   cpuStats[cpuID()].start = taskClock();
+#endif
+
+#ifdef SMP
+   if (cpuID() == 0)
+#endif
+   {
+#if TASK_NUM_TASKDATA > 0
+      taskData.head = &taskData.data[0];
+
+      for (unsigned int i = 0; i < (TASK_NUM_TASKDATA - 1); i++)
+         taskData.data[i].next = &taskData.data[i + 1];
+
+      taskData.data[TASK_NUM_TASKDATA - 1].next = NULL;
+#endif
+#if TASK_REAPER
+      __taskStart(&reaper, taskReaperFx, NULL);
+#endif
+   }
+}
+
+#if KERNEL_TRACE
+#if KERNEL_TRACE_RECORDS & (KERNEL_TRACE_RECORDS - 1)
+#error "KERNEL_TRACE_RECORDS must be a power of 2"
+#endif
+
+/****************************************************************************
+ * Each CPU writes only its own ring (with interrupts disabled) and counts
+ * the records it has written in "head".  The slot after the newest record
+ * may be mid-write, so readers use at most KERNEL_TRACE_RECORDS - 1.
+ ****************************************************************************/
+typedef struct
+{
+   unsigned long head;
+   TraceRecord record[KERNEL_TRACE_RECORDS];
+
+} TraceRing;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifdef SMP
+static TraceRing traceRing[SMP];
+#else
+static TraceRing traceRing[1];
+#endif
+static volatile bool traceOn = true;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelTrace(unsigned short event, unsigned short data, const void* arg)
+{
+   if (!traceOn)
+      return;
+
+   TraceRing* ring = &traceRing[cpuID()];
+   TraceRecord* record =
+      &ring->record[ring->head & (KERNEL_TRACE_RECORDS - 1)];
+
+   record->time = taskClock();
+   record->event = event;
+   record->data = data;
+   record->arg = arg;
+
+   memoryBarrier();
+   ring->head++;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool kernelTraceEnable(bool enable)
+{
+   bool enabled = traceOn;
+
+   traceOn = enable;
+   memoryBarrier();
+
+   return enabled;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int kernelTraceRead(int cpu, TraceRecord* records,
+                             unsigned int count)
+{
+   TraceRing* ring = &traceRing[cpu];
+   unsigned long head = ring->head;
+   unsigned long written;
+   unsigned int i;
+
+   memoryBarrier();
+
+   if (count > KERNEL_TRACE_RECORDS - 1)
+      count = KERNEL_TRACE_RECORDS - 1;
+   if (count > head)
+      count = head;
+
+   for (i = 0; i < count; i++)
+   {
+      records[i] =
+         ring->record[(head - count + i) & (KERNEL_TRACE_RECORDS - 1)];
+   }
+
+   memoryBarrier();
+
+   /* every record written meanwhile overwrote the oldest slot (and the
+      next one may be mid-write) */
+   written = ring->head - head;
+
+   if (written + 1 + count > KERNEL_TRACE_RECORDS)
+   {
+      i = written + 1 + count - KERNEL_TRACE_RECORDS;
+
+      if (i >= count)
+         return 0;
+
+      memmove(records, &records[i], (count - i) * sizeof(TraceRecord));
+      count -= i;
+   }
+
+   return count;
+}
+
+/****************************************************************************
+ * Prints one CPU's ring as Trace Event Format events.  The CPU's tasks are
+ * on tid 2 * cpu and its interrupts on tid 2 * cpu + 1.
+ ****************************************************************************/
+static void traceDumpCPU(int cpu, unsigned long long base)
+{
+   TraceRing* ring = &traceRing[cpu];
+   unsigned long head = ring->head;
+   unsigned long count = head;
+   const char* task = NULL;
+   bool idling = false;
+   unsigned long start = 0;
+   unsigned long idle = 0;
+   unsigned long ts = 0;
+   int tid = cpu * 2;
+
+   if (count > KERNEL_TRACE_RECORDS - 1)
+      count = KERNEL_TRACE_RECORDS - 1;
+
+   if (count > 0)
+   {
+      start = (unsigned long) (ring->record[(head - count) &
+                                            (KERNEL_TRACE_RECORDS - 1)].time -
+                               base);
+   }
+
+   printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+          "\"args\":{\"name\":\"cpu%d\"}}", tid, cpu);
+   printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+          "\"args\":{\"name\":\"cpu%d irq\"}}", tid + 1, cpu);
+
+   for (unsigned long i = head - count; i != head; i++)
+   {
+      TraceRecord* record = &ring->record[i & (KERNEL_TRACE_RECORDS - 1)];
+      const char* name = (const char*) record->arg;
+
+      ts = (unsigned long) (record->time - base);
+
+      /* the task that was running when the oldest record was written is
+         named by its first block or idle record */
+      if ((task == NULL) && ((record->event == TRACE_BLOCK) ||
+                             (record->event == TRACE_IDLE) ||
+                             (record->event == TRACE_RESUME)))
+      {
+         task = name;
+      }
+
+      switch (record->event)
+      {
+         case TRACE_SWITCH:
+            if (task != NULL)
+            {
+               printf(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+                      "\"tid\":%d,\"ts\":%lu,\"dur\":%lu}", task, tid, start,
+                      ts - start);
+            }
+            task = name;
+            start = ts;
+            break;
+
+         case TRACE_WAKE:
+            printf(",\n{\"name\":\"wake %s\",\"ph\":\"i\",\"s\":\"t\","
+                   "\"pid\":0,\"tid\":%d,\"ts\":%lu,"
+                   "\"args\":{\"priority\":%d}}", name, tid, ts,
+                   (signed char) record->data);
+            break;
+
+         case TRACE_BLOCK:
+            printf(",\n{\"name\":\"block %s\",\"ph\":\"i\",\"s\":\"t\","
+                   "\"pid\":0,\"tid\":%d,\"ts\":%lu,"
+                   "\"args\":{\"state\":%u}}", name, tid, ts, record->data);
+            break;
+
+         case TRACE_IDLE:
+            idling = true;
+            idle = ts;
+            break;
+
+         case TRACE_RESUME:
+            if (idling)
+            {
+               printf(",\n{\"name\":\"idle\",\"ph\":\"X\",\"pid\":0,"
+                      "\"tid\":%d,\"ts\":%lu,\"dur\":%lu}", tid, idle,
+                      ts - idle);
+            }
+            idling = false;
+            break;
+
+         case TRACE_IRQ_ENTER:
+            printf(",\n{\"name\":\"irq %u\",\"ph\":\"B\",\"pid\":0,"
+                   "\"tid\":%d,\"ts\":%lu,\"args\":{\"handler\":\"%p\"}}",
+                   record->data, tid + 1, ts, record->arg);
+            break;
+
+         case TRACE_IRQ_EXIT:
+            printf(",\n{\"ph\":\"E\",\"pid\":0,\"tid\":%d,\"ts\":%lu}",
+                   tid + 1, ts);
+            break;
+
+         case TRACE_TIMER:
+            printf(",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,"
+                   "\"tid\":%d,\"ts\":%lu,\"args\":{\"fx\":\"%p\"}}",
+                   record->data ? "hrtimer" : "timer", tid, ts,
+                   record->arg);
+            break;
+      }
+   }
+
+   /* the task still running when the ring was frozen */
+   if (task != NULL)
+   {
+      printf(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+             "\"ts\":%lu,\"dur\":%lu}", task, tid, start, ts - start);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelTraceDump()
+{
+   bool enabled = kernelTraceEnable(false);
+   unsigned long long base = -1;
+   int cpu;
+
+   for (cpu = 0; cpu < (int) (sizeof(traceRing) / sizeof(TraceRing)); cpu++)
+   {
+      TraceRing* ring = &traceRing[cpu];
+      unsigned long count = ring->head;
+
+      if (count > KERNEL_TRACE_RECORDS - 1)
+         count = KERNEL_TRACE_RECORDS - 1;
+
+      if ((count > 0) && (ring->record[(ring->head - count) &
+                          (KERNEL_TRACE_RECORDS - 1)].time < base))
+      {
+         base = ring->record[(ring->head - count) &
+                             (KERNEL_TRACE_RECORDS - 1)].time;
+      }
+   }
+
+   printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+          "\"args\":{\"name\":\"AliOS\"}}");
+
+   for (cpu = 0; cpu < (int) (sizeof(traceRing) / sizeof(TraceRing)); cpu++)
+      traceDumpCPU(cpu, base);
+
+   printf("\n]}\n");
+
+   kernelTraceEnable(enabled);
+}
+#endif
+
+#if TIMERS
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Timer* timerCreate(unsigned char flags, unsigned long timeout, Task* task)
+{
+   Timer* timer = kmalloc(sizeof(Timer));
+
+   memset(timer, 0, sizeof(Timer));
+
+   timer->flags = flags;
+   timer->timeout[0] = timeout;
+   timer->timeout[1] = timeout;
+   timer->task = task;
+
+   return timer;
+}
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ *
+ ****************************************************************************/
+void timerDestroy(Timer* timer)
+{
+   kfree(timer);
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void __timerAdd(Timer* timer)
+{
+   if (timer->timeout[0] == 0)
+      timer->timeout[0] = 1;
+   if (timer->timeout[1] == 0)
+      timer->timeout[1] = 1;
+
+#if TIMER_WHEEL_LEVELS > 0
+   timer->wheel.expire = wheel.now + timer->timeout[0];
+   timerWheelAdd(timer);
+#else
+   Timer* previous = NULL;
+   Timer* ptr = timers;
+
+   while (ptr != NULL)
+   {
+      if (timer->timeout[0] < ptr->timeout[0])
+      {
+         ptr->timeout[0] -= timer->timeout[0];
+         break;
+      }
+      else
+      {
+         timer->timeout[0] -= ptr->timeout[0];
+      }
+
+      previous = ptr;
+      ptr = ptr->next;
+   }
+
+   LIST_INSERT(timers, previous, timer);
+#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _timerAdd(Timer* timer, void (*fx)(Timer*), void* arg)
+{
+   _smpLock();
+
+   timer->fx = fx;
+   timer->arg = arg;
+
+   unsigned long timeout0 = taskGetTimeout();
+   timerLock();
+   __timerAdd(timer);
+   timerUnlock();
+   unsigned long timeout1 = taskGetTimeout();
+
+   if (timeout1 < timeout0)
+      taskAdjTimeout(taskScheduleTick(timeout0 != -1, timeout1));
+
+   _smpUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void timerAdd(Timer* timer, void (*fx)(Timer*), void* arg)
+{
+   kernelLock();
+
+   timer->fx = fx;
+   timer->arg = arg;
+
+   unsigned long timeout0 = taskGetTimeout();
+   timerLock();
+   __timerAdd(timer);
+   timerUnlock();
+   unsigned long timeout1 = taskGetTimeout();
+
+   if (timeout1 < timeout0)
+      taskAdjTimeout(taskScheduleTick(timeout0 != -1, timeout1));
+
+   kernelUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool timerDel(Timer* timer)
+{
+#if TIMER_WHEEL_LEVELS > 0
+   return timerWheelDel(timer);
+#else
+   if ((timer->prev == NULL) && (timers != timer))
+      return false;
+
+   if (timer->next != NULL)
+      timer->next->timeout[0] += timer->timeout[0];
+
+   LIST_REMOVE(timers, timer);
+   timer->prev = NULL;
+
+   return true;
+#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __timerCancel(Timer* timer)
+{
+   timerLock();
+   bool active = timerDel(timer);
+   timerUnlock();
+
+   if (active)
+   {
+      if ((timer->flags & TIMER_FLAG_EXPIRED) && (timer->task != NULL))
+      {
+         timer->task->flags &= ~TASK_FLAG_RESTART;
+
+         if ((timer->task->state == TASK_STATE_READY) &&
+             ((timer->task->flags & TASK_FLAG_STARTED) == 0))
+         {
+            taskClrReady(timer->task);
+         }
+      }
+   }
+
+   return active;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _timerCancel(Timer* timer)
+{
+   _smpLock();
+   __timerCancel(timer);
+   _smpUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void timerCancel(Timer* timer)
+{
+   kernelLock();
+   __timerCancel(timer);
+   kernelUnlock();
+}
+#endif
+
+#if HRTIMERS
+/****************************************************************************
+ * Pending high resolution timers sorted by deadline.  They have their own
+ * lock (and clock event), so they never touch the scheduler or the tick.
+ ****************************************************************************/
+static HRTimer* hrtimers = NULL;
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long hrtimerSpin;
+#define hrtimerLock() _spinLock(&hrtimerSpin)
+#define hrtimerUnlock() _spinUnlock(&hrtimerSpin)
+#else
+#define hrtimerLock()
+#define hrtimerUnlock()
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void __hrtimerCancel(HRTimer* timer)
+{
+   if ((timer->prev == NULL) && (hrtimers != timer))
+      return;
+
+   bool first = (hrtimers == timer);
+
+   LIST_REMOVE(hrtimers, timer);
+   timer->next = NULL;
+   timer->prev = NULL;
+
+   if (first)
+      hrtimerSchedule((hrtimers != NULL) ? hrtimers->deadline : -1);
+}
+
+/****************************************************************************
+ * The clock event is only reprogrammed when the first deadline changes.
+ ****************************************************************************/
+static void __hrtimerAdd(HRTimer* timer, unsigned long long deadline,
+                         void (*fx)(HRTimer*), void* arg)
+{
+   HRTimer* previous = NULL;
+   HRTimer* ptr;
+
+   __hrtimerCancel(timer);
+
+   timer->deadline = deadline;
+   timer->fx = fx;
+   timer->arg = arg;
+
+   for (ptr = hrtimers; ptr != NULL; ptr = ptr->next)
+   {
+      if (deadline < ptr->deadline)
+         break;
+
+      previous = ptr;
+   }
+
+   LIST_INSERT(hrtimers, previous, timer);
+
+   if (previous == NULL)
+      hrtimerSchedule(deadline);
+}
+
+/****************************************************************************
+ * Timer functions run without the hrtimer lock so they can re-add (or
+ * cancel) timers.
+ ****************************************************************************/
+void _hrtimerExpire()
+{
+   hrtimerLock();
+
+   unsigned long long now = hrtimerClock();
+
+   while ((hrtimers != NULL) && (hrtimers->deadline <= now))
+   {
+      HRTimer* timer = hrtimers;
+
+      LIST_REMOVE(hrtimers, timer);
+      timer->next = NULL;
+      timer->prev = NULL;
+
+      hrtimerUnlock();
+      kernelTrace(TRACE_TIMER, 1, timer->fx);
+      timer->fx(timer);
+      hrtimerLock();
+
+      now = hrtimerClock();
+   }
+
+   hrtimerSchedule((hrtimers != NULL) ? hrtimers->deadline : -1);
+
+   hrtimerUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _hrtimerAdd(HRTimer* timer, unsigned long long deadline,
+                 void (*fx)(HRTimer*), void* arg)
+{
+   hrtimerLock();
+   __hrtimerAdd(timer, deadline, fx, arg);
+   hrtimerUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerAdd(HRTimer* timer, unsigned long long deadline,
+                void (*fx)(HRTimer*), void* arg)
+{
+   bool iFlag = kernelEnter();
+   hrtimerLock();
+   __hrtimerAdd(timer, deadline, fx, arg);
+   hrtimerUnlock();
+   kernelLeave(iFlag);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _hrtimerCancel(HRTimer* timer)
+{
+   hrtimerLock();
+   __hrtimerCancel(timer);
+   hrtimerUnlock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerCancel(HRTimer* timer)
+{
+   bool iFlag = kernelEnter();
+   hrtimerLock();
+   __hrtimerCancel(timer);
+   hrtimerUnlock();
+   kernelLeave(iFlag);
+}
+#endif
+
+#if QUEUES
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Queue* queueCreate(const char* name, unsigned int elementSize,
+                   unsigned int maxElements)
+{
+   Queue* queue = kmalloc(sizeof(Queue));
+
+   memset(queue, 0, sizeof(Queue));
+
+   queue->name = name;
+   queue->size = elementSize;
+   queue->max = maxElements;
+   queue->buffer = kmalloc(elementSize * maxElements);
+
+   return queue;
+}
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ *
+ ****************************************************************************/
+void queueDestroy(Queue* queue)
+{
+   kfree(queue->buffer);
+   kfree(queue);
+}
+#endif
+
+/****************************************************************************
+ * Gets the slot of the nth element from the head of a queue.
+ ****************************************************************************/
+static void* queueSlot(Queue* queue, unsigned int n)
+{
+   unsigned long i = (queue->index + n) % queue->max;
+   return &queue->buffer[i * queue->size];
+}
+
+/****************************************************************************
+ * Waiters on a full queue are pushers and waiters on an empty queue are
+ * poppers.  A pusher without data (arg1 == NULL) is a queueReserve() and is
+ * only woken once space is free.  A popper without a destination that
+ * peeks is a queuePeekRef(), so the element is left in the queue for it.
+ ****************************************************************************/
+static bool __queuePush(Queue* queue, bool tail, const void* src)
+{
+   bool success = false;
+
+   if (queue->count < queue->max)
+   {
+      TaskPoll* poll;
+      bool insert = true;
+
+      while (insert && ((poll = taskPollWake(&queue->poll)) != NULL))
+      {
+         if (poll->arg1 != NULL)
+            memcpy(poll->arg1, src, queue->size);
+
+         insert = poll->arg0;
+      }
+
+      if (insert)
+      {
+         void* dst;
+
+         if (tail)
+         {
+            dst = queueSlot(queue, queue->count);
+         }
+         else
+         {
+            queue->index = (queue->index + queue->max - 1) % queue->max;
+            dst = queueSlot(queue, 0);
+         }
+
+         if (dst != src)
+            memcpy(dst, src, queue->size);
+
+         queue->count++;
+      }
+
+      success = true;
+   }
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __queuePop(Queue* queue, bool head, bool peek, void* dst)
+{
+   bool success = false;
+
+   if (queue->count > 0)
+   {
+      TaskPoll* poll = peek ? NULL : taskPollWake(&queue->poll);
+      void* src = NULL;
+
+      if ((poll != NULL) && (poll->arg1 != NULL))
+      {
+         if (head)
+         {
+            if (poll->arg0)
+            {
+               src = queueSlot(queue, 0);
+               queue->index = (queue->index + 1) % queue->max;
+            }
+            else
+            {
+               src = poll->arg1;
+            }
+         }
+         else
+         {
+            if (poll->arg0)
+            {
+               src = poll->arg1;
+            }
+            else
+            {
+               /* the freed tail slot becomes the new head */
+               src = queueSlot(queue, queue->max - 1);
+               queue->index = (queue->index + queue->max - 1) % queue->max;
+            }
+         }
+
+         if (dst != NULL)
+            memcpy(dst, src, queue->size);
+
+         if (src != poll->arg1)
+            memcpy(src, poll->arg1, queue->size);
+      }
+      else
+      {
+         if (head)
+         {
+            src = queueSlot(queue, 0);
+
+            if (!peek)
+               queue->index = (queue->index + 1) % queue->max;
+         }
+         else
+         {
+            src = queueSlot(queue, queue->count - 1);
+         }
+
+         if (dst != NULL)
+            memcpy(dst, src, queue->size);
+
+         if (!peek)
+            queue->count--;
+      }
+
+      success = true;
+   }
+
+   return success;
+}
+
+/****************************************************************************
+ * Blocks until a push or pop completes the operation described by arg0 and
+ * arg1 (see __queuePush()).  Called and returns with the object lock held.
+ ****************************************************************************/
+static bool queueWait(Queue* queue, bool arg0, void* arg1,
+                      unsigned long ticks)
+{
+   TaskPoll poll;
+
+   poll.task = current;
+   poll.source = queue;
+   poll.success = false;
+   poll.arg0 = arg0;
+   poll.arg1 = arg1;
+
+   current->inactive.poll = &poll;
+   current->inactive.size = 1;
+
+   taskPollAdd(&queue->poll, &poll);
+
+   schedLock();
+   taskSetTimeout(TASK_STATE_QUEUE, ticks);
+   objectUnlock(queue);
+   taskWait();
+   schedUnlock();
+
+   objectLock(queue);
+
+   if (!poll.success)
+      taskPollDel(&queue->poll, &poll);
+
+   current->inactive.poll = NULL;
+   current->inactive.size = 0;
+
+   return poll.success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _queuePush(Queue* queue, bool tail, const void* src)
+{
+   taskLatencyBegin();
+   objectLock(queue);
+   bool success = __queuePush(queue, tail, src);
+   objectUnlock(queue);
+   taskLatencyEnd();
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool queuePush(Queue* queue, bool tail, const void* src, unsigned long ticks)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   bool success = __queuePush(queue, tail, src);
+
+   if (success)
+   {
+      objectUnlock(queue);
+      taskReschedule();
+   }
+   else
+   {
+      if (ticks > 0)
+         success = queueWait(queue, tail, (void*) src, ticks);
+
+      objectUnlock(queue);
+   }
+
+   kernelLeave(iFlag);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _queuePop(Queue* queue, bool head, bool peek, void* dst)
+{
+   objectLock(queue);
+   bool success = __queuePop(queue, head, peek, dst);
+   objectUnlock(queue);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool queuePop(Queue* queue, bool head, bool peek, void* dst,
+              unsigned long ticks)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   bool success = __queuePop(queue, head, peek, dst);
+
+   if (success)
+   {
+      objectUnlock(queue);
+      taskReschedule();
+   }
+   else
+   {
+      if (ticks > 0)
+         success = queueWait(queue, peek, dst, ticks);
+
+      objectUnlock(queue);
+   }
+
+   kernelLeave(iFlag);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* _queueReserve(Queue* queue)
+{
+   void* ptr = NULL;
+
+   objectLock(queue);
+
+   if (queue->count < queue->max)
+      ptr = queueSlot(queue, queue->count);
+
+   objectUnlock(queue);
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* queueReserve(Queue* queue, unsigned long ticks)
+{
+   void* ptr = NULL;
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   /* a wake-up does not hold the slot, another reserver or an interrupt may
+      have filled it before this task got to run */
+   while ((queue->count == queue->max) && (ticks > 0) &&
+          queueWait(queue, true, NULL, ticks))
+   {
+      ticks = taskTimeoutLeft();
+   }
+
+   if (queue->count < queue->max)
+      ptr = queueSlot(queue, queue->count);
+
+   objectUnlock(queue);
+   kernelLeave(iFlag);
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _queueCommit(Queue* queue)
+{
+   taskLatencyBegin();
+   objectLock(queue);
+   bool success = __queuePush(queue, true, queueSlot(queue, queue->count));
+   objectUnlock(queue);
+   taskLatencyEnd();
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool queueCommit(Queue* queue)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+   bool success = __queuePush(queue, true, queueSlot(queue, queue->count));
+   objectUnlock(queue);
+   taskReschedule();
+   kernelLeave(iFlag);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* _queuePeekRef(Queue* queue)
+{
+   void* ptr = NULL;
+
+   objectLock(queue);
+
+   if (queue->count > 0)
+      ptr = queueSlot(queue, 0);
+
+   objectUnlock(queue);
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* queuePeekRef(Queue* queue, unsigned long ticks)
+{
+   void* ptr = NULL;
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   /* a wake-up does not hold the element, it may be gone again before this
+      task got to run */
+   while ((queue->count == 0) && (ticks > 0) &&
+          queueWait(queue, true, NULL, ticks))
+   {
+      ticks = taskTimeoutLeft();
+   }
+
+   if (queue->count > 0)
+      ptr = queueSlot(queue, 0);
+
+   objectUnlock(queue);
+   kernelLeave(iFlag);
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _queueRelease(Queue* queue)
+{
+   objectLock(queue);
+   __queuePop(queue, true, false, NULL);
+   objectUnlock(queue);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void queueRelease(Queue* queue)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+   __queuePop(queue, true, false, NULL);
+   objectUnlock(queue);
+   taskReschedule();
+   kernelLeave(iFlag);
+}
+
+/****************************************************************************
+ * Copies n elements to (push) or from the queue starting at the first
+ * element from the head.  The copy wraps around the end of the buffer at
+ * most once.
+ ****************************************************************************/
+static void queueCopy(Queue* queue, unsigned int first, void* data,
+                      unsigned int n, bool push)
+{
+   unsigned char* ptr = data;
+   unsigned long i = (queue->index + first) % queue->max;
+
+   while (n > 0)
+   {
+      unsigned int count = queue->max - i;
+
+      if (count > n)
+         count = n;
+
+      unsigned long size = count * queue->size;
+
+      if (push)
+         memcpy(&queue->buffer[i * queue->size], ptr, size);
+      else
+         memcpy(ptr, &queue->buffer[i * queue->size], size);
+
+      ptr += size;
+      n -= count;
+      i = 0;
+   }
+}
+
+/****************************************************************************
+ * Waiting poppers (empty queue) each take one element straight from src,
+ * the rest is copied into the queue in one go.
+ ****************************************************************************/
+static unsigned int __queuePushN(Queue* queue, const void* src,
+                                 unsigned int n)
+{
+   const unsigned char* ptr = src;
+   unsigned int i = 0;
+
+   if (queue->count == 0)
+   {
+      TaskPoll* poll;
+
+      while ((i < n) && ((poll = taskPollWake(&queue->poll)) != NULL))
+      {
+         if (poll->arg1 != NULL)
+            memcpy(poll->arg1, ptr, queue->size);
+
+         if (!poll->arg0)
+         {
+            ptr += queue->size;
+            i++;
+         }
+      }
+   }
+
+   unsigned int count = queue->max - queue->count;
+
+   if (count > n - i)
+      count = n - i;
+
+   queueCopy(queue, queue->count, (void*) ptr, count, true);
+   queue->count += count;
+
+   return i + count;
+}
+
+/****************************************************************************
+ * The elements are copied out of the queue in one go, then waiting pushers
+ * (full queue) fill the freed slots.  Each waiter woken uses up a slot,
+ * including reservers and kernelWait() callers that carry no data.
+ ****************************************************************************/
+static unsigned int __queuePopN(Queue* queue, void* dst, unsigned int n)
+{
+   unsigned int count = (n < queue->count) ? n : queue->count;
+
+   if (count == 0)
+      return 0;
+
+   if (dst != NULL)
+      queueCopy(queue, 0, dst, count, false);
+
+   queue->index = (queue->index + count) % queue->max;
+   queue->count -= count;
+
+   unsigned int slots = queue->max - queue->count;
+   TaskPoll* poll;
+
+   while ((slots > 0) && ((poll = taskPollWake(&queue->poll)) != NULL))
+   {
+      slots--;
+
+      if (poll->arg1 != NULL)
+      {
+         void* slot;
+
+         if (poll->arg0)
+         {
+            slot = queueSlot(queue, queue->count);
+         }
+         else
+         {
+            queue->index = (queue->index + queue->max - 1) % queue->max;
+            slot = queueSlot(queue, 0);
+         }
+
+         memcpy(slot, poll->arg1, queue->size);
+         queue->count++;
+      }
+   }
+
+   return count;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int _queuePushN(Queue* queue, const void* src, unsigned int n)
+{
+   taskLatencyBegin();
+   objectLock(queue);
+   unsigned int count = __queuePushN(queue, src, n);
+   objectUnlock(queue);
+   taskLatencyEnd();
+
+   return count;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int queuePushN(Queue* queue, const void* src, unsigned int n,
+                        unsigned long ticks)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   unsigned int count = __queuePushN(queue, src, n);
+
+   if ((count == 0) && (n > 0) && (ticks > 0))
+   {
+      if (queueWait(queue, true, (void*) src, ticks))
+      {
+         const unsigned char* ptr = src;
+         count = 1 + __queuePushN(queue, ptr + queue->size, n - 1);
+      }
+   }
+
+   objectUnlock(queue);
+
+   if (count > 0)
+      taskReschedule();
+
+   kernelLeave(iFlag);
+
+   return count;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int _queuePopN(Queue* queue, void* dst, unsigned int n)
+{
+   objectLock(queue);
+   unsigned int count = __queuePopN(queue, dst, n);
+   objectUnlock(queue);
+
+   return count;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned int queuePopN(Queue* queue, void* dst, unsigned int n,
+                       unsigned long ticks)
+{
+   bool iFlag = kernelEnter();
+   objectLock(queue);
+
+   unsigned int count = __queuePopN(queue, dst, n);
+
+   if ((count == 0) && (n > 0) && (ticks > 0))
+   {
+      if (queueWait(queue, false, dst, ticks))
+      {
+         unsigned char* ptr = dst;
+
+         if (ptr != NULL)
+            ptr += queue->size;
+
+         count = 1 + __queuePopN(queue, ptr, n - 1);
+      }
+   }
+
+   objectUnlock(queue);
+
+   if (count > 0)
+      taskReschedule();
+
+   kernelLeave(iFlag);
+
+   return count;
+}
+#endif
+
+#if RINGS
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Ring* ringCreate(const char* name, unsigned int elementSize,
+                 unsigned int maxElements)
+{
+   Ring* ring = kmalloc(sizeof(Ring));
+
+   memset(ring, 0, sizeof(Ring));
+
+   ring->name = name;
+   ring->size = elementSize;
+   ring->max = maxElements;
+   ring->buffer = kmalloc(elementSize * maxElements);
+
+   return ring;
+}
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ *
+ ****************************************************************************/
+void ringDestroy(Ring* ring)
+{
+   kfree(ring->buffer);
+   kfree(ring);
+}
+#endif
+
+/****************************************************************************
+ * The barriers order the element copy before the head update that
+ * publishes it, and the head update before the caller looks for a blocked
+ * consumer (ringPop() orders its registration before re-checking head, so
+ * at least one side always sees the other).
+ ****************************************************************************/
+static bool __ringPush(Ring* ring, const void* src)
+{
+   RING_INDEX_TYPE head = ring->head;
+
+   if ((RING_INDEX_TYPE) (head - ring->tail) >= ring->max)
+      return false;
+
+   memcpy(&ring->buffer[(head & (ring->max - 1)) * ring->size], src,
+          ring->size);
+
+   memoryBarrier();
+   ring->head = head + 1;
+   memoryBarrier();
+
+   return true;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __ringPop(Ring* ring, void* dst)
+{
+   RING_INDEX_TYPE tail = ring->tail;
+
+   if (ring->head == tail)
+      return false;
+
+   memoryBarrier();
+   memcpy(dst, &ring->buffer[(tail & (ring->max - 1)) * ring->size],
+          ring->size);
+
+   memoryBarrier();
+   ring->tail = tail + 1;
+
+   return true;
+}
+
+/****************************************************************************
+ * Wakes the blocked consumer (interrupts disabled).
+ ****************************************************************************/
+static bool ringWake(Ring* ring)
+{
+   bool woken = false;
+
+   objectLock(ring);
+
+   TaskPoll* poll = ring->poll;
+
+   if (poll != NULL)
+   {
+      poll->success = true;
+      ring->poll = NULL;
+
+      schedLock();
+      taskCancelTimeout(poll->task);
+      schedUnlock();
+
+      woken = true;
+   }
+
+   objectUnlock(ring);
+
+   return woken;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _ringPush(Ring* ring, const void* src)
+{
+   bool success = __ringPush(ring, src);
+
+   if (success && (ring->poll != NULL))
+      ringWake(ring);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool ringPush(Ring* ring, const void* src)
+{
+   bool success = __ringPush(ring, src);
+
+   if (success && (ring->poll != NULL))
+   {
+      bool iFlag = kernelEnter();
+
+      if (ringWake(ring))
+         taskReschedule();
+
+      kernelLeave(iFlag);
+   }
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _ringPop(Ring* ring, void* dst)
+{
+   return __ringPop(ring, dst);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool ringPop(Ring* ring, void* dst, unsigned long ticks)
+{
+   bool success = __ringPop(ring, dst);
+
+   if (!success && (ticks > 0))
+   {
+      bool iFlag = kernelEnter();
+      TaskPoll poll;
+
+      poll.task = current;
+      poll.source = ring;
+      poll.success = false;
+
+      current->inactive.poll = &poll;
+      current->inactive.size = 1;
+
+      objectLock(ring);
+      ring->poll = &poll;
+      memoryBarrier();
+
+      if (ring->head == ring->tail)
+      {
+         schedLock();
+         taskSetTimeout(TASK_STATE_RING, ticks);
+         objectUnlock(ring);
+         taskWait();
+         schedUnlock();
+         objectLock(ring);
+      }
+
+      ring->poll = NULL;
+      objectUnlock(ring);
+
+      current->inactive.poll = NULL;
+      current->inactive.size = 0;
+
+      kernelLeave(iFlag);
+
+      success = __ringPop(ring, dst);
+   }
+
+   return success;
+}
+#endif
+
+#if SEMAPHORES
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Semaphore* semaphoreCreate(const char* name, unsigned int count,
+                           unsigned int max)
+{
+   Semaphore* semaphore = kmalloc(sizeof(Semaphore));
+
+   memset(semaphore, 0, sizeof(Semaphore));
+   semaphore->name = name;
+   semaphore->count = count;
+   semaphore->max = max;
+
+   return semaphore;
+}
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ *
+ ****************************************************************************/
+void semaphoreDestroy(Semaphore* semaphore)
+{
+   kfree(semaphore);
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __semaphoreGive(Semaphore* semaphore)
+{
+   bool success = true;
+
+   if (taskPollWake(&semaphore->poll) == NULL)
+   {
+      if (semaphore->count < semaphore->max)
+         semaphore->count++;
+      else
+         success = false;
+   }
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _semaphoreGive(Semaphore* semaphore)
+{
+   taskLatencyBegin();
+   objectLock(semaphore);
+   bool success = __semaphoreGive(semaphore);
+   objectUnlock(semaphore);
+   taskLatencyEnd();
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool semaphoreGive(Semaphore* semaphore)
+{
+   bool iFlag = kernelEnter();
+   objectLock(semaphore);
+
+   bool success = __semaphoreGive(semaphore);
+
+   objectUnlock(semaphore);
+
+   if (success)
+      taskReschedule();
+
+   kernelLeave(iFlag);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool semaphoreTake(Semaphore* semaphore, unsigned long ticks)
+{
+   TaskPoll poll;
+   poll.source = semaphore;
+   return semaphoreTake2(&poll, 1, ticks) != -1;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+int semaphoreTake2(struct TaskPoll* poll, int size, unsigned long ticks)
+{
+   for (int i = 0; i < size; i++)
+      poll[i].type = KERNEL_WAIT_SEMAPHORE;
+
+   return taskPollWait(poll, size, TASK_STATE_SEMAPHORE, ticks);
+}
+#endif
+
+#if MUTEXES
+#ifdef kmalloc
+/****************************************************************************
+ *
+ ****************************************************************************/
+Mutex* mutexCreate(const char* name)
+{
+   Mutex* mutex = kmalloc(sizeof(Mutex));
+
+   memset(mutex, 0, sizeof(Mutex));
+   mutex->name = name;
+
+   return mutex;
+}
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ *
+ ****************************************************************************/
+void mutexDestroy(Mutex* mutex)
+{
+   kfree(mutex);
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool __mutexLock(Mutex* mutex)
+{
+   bool success = true;
+
+   if (mutex->count == 0)
+   {
+      mutex->count = 1;
+      mutex->priority = current->priority;
+      mutex->owner = current;
+   }
+   else if (mutex->owner == current)
+   {
+      mutex->count++;
+   }
+   else
+   {
+      success = false;
+   }
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool mutexLock(Mutex* mutex, unsigned long ticks)
+{
+   bool iFlag = kernelEnter();
+   objectLock(mutex);
+
+   bool success = __mutexLock(mutex);
+
+   if (!success && (ticks > 0))
+   {
+      TaskPoll poll;
+
+      poll.task = current;
+      poll.source = mutex;
+      poll.success = false;
+
+      current->inactive.poll = &poll;
+      current->inactive.size = 1;
+
+      schedLock();
+
+#if TASK_PRIORITY_POLARITY
+      if (current->priority > mutex->owner->priority)
+#else
+      if (current->priority < mutex->owner->priority)
 #endif
+         __taskPriority(mutex->owner, current->priority);
+
+      taskPollAdd(&mutex->poll, &poll);
+
+      taskSetTimeout(TASK_STATE_MUTEX, ticks);
+      objectUnlock(mutex);
+      taskWait();
+      schedUnlock();
+
+      objectLock(mutex);
+      success = poll.success;
+
+      if (!success)
+         taskPollDel(&mutex->poll, &poll);
+
+      current->inactive.poll = NULL;
+      current->inactive.size = 0;
+   }
+
+   objectUnlock(mutex);
+   kernelLeave(iFlag);
+
+   return success;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void mutexUnlock(Mutex* mutex)
+{
+   if (mutex->owner != current)
+      return;
+
+   bool reschedule = false;
+
+   bool iFlag = kernelEnter();
+   objectLock(mutex);
+
+   if (--mutex->count == 0)
+   {
+      TaskPoll* poll = taskPollWake(&mutex->poll);
+
+      /* also undoes a boost by a waiter that has timed out since */
+      if (current->priority != mutex->priority)
+      {
+         schedLock();
+         __taskPriority(current, mutex->priority);
+         schedUnlock();
+      }
+
+      if (poll != NULL)
+      {
+         mutex->count = 1;
+         mutex->priority = poll->task->priority;
+         mutex->owner = poll->task;
+
+         reschedule = true;
+      }
+      else
+      {
+         mutex->owner = NULL;
+      }
    }
-}
-
-#if TIMERS
-#ifdef kmalloc
-/****************************************************************************
- *
- ****************************************************************************/
-Timer* timerCreate(unsigned char flags, unsigned long timeout, Task* task)
-{
-   Timer* timer = kmalloc(sizeof(Timer));
 
-   memset(timer, 0, sizeof(Timer));
+   objectUnlock(mutex);
 
-   timer->flags = flags;
-   timer->timeout[0] = timeout;
-   timer->timeout[1] = timeout;
-   timer->task = task;
+   if (reschedule)
+      taskReschedule();
 
-   return timer;
+   kernelLeave(iFlag);
 }
 #endif
 
-#ifdef kfree
+#if QUEUES || SEMAPHORES || MUTEXES
+#ifdef SMP
 /****************************************************************************
- *
+ * Locks (or unlocks) the objects of a kernelWait() call in address order,
+ * skipping duplicates.
  ****************************************************************************/
-void timerDestroy(Timer* timer)
+static void taskPollLockAll(TaskPoll* poll, int size, bool lock)
 {
-   kfree(timer);
+   unsigned long last = 0;
+
+   for (;;)
+   {
+      unsigned long* next = NULL;
+
+      for (int j = 0; j < size; j++)
+      {
+         unsigned long* spin = taskPollLock(&poll[j]);
+
+         if (((unsigned long) spin > last) &&
+             ((next == NULL) || (spin < next)))
+         {
+            next = spin;
+         }
+      }
+
+      if (next == NULL)
+         break;
+
+      if (lock)
+         _spinLock(next);
+      else
+         _spinUnlock(next);
+
+      last = (unsigned long) next;
+   }
 }
+#else
+#define taskPollLockAll(poll, size, lock)
 #endif
 
 /****************************************************************************
- *
+ * Consumes a kernelWait() object if it is ready (object lock held).
  ****************************************************************************/
-static void __timerAdd(Timer* timer)
+static bool taskPollTake(TaskPoll* poll)
 {
-   Timer* previous = NULL;
-   Timer* ptr = timers;
-
-   if (timer->timeout[0] == 0)
-      timer->timeout[0] = 1;
-   if (timer->timeout[1] == 0)
-      timer->timeout[1] = 1;
+   bool success = false;
 
-   while (ptr != NULL)
+   switch (poll->type)
    {
-      if (timer->timeout[0] < ptr->timeout[0])
+#if SEMAPHORES
+      case KERNEL_WAIT_SEMAPHORE:
       {
-         ptr->timeout[0] -= timer->timeout[0];
+         Semaphore* semaphore = poll->source;
+
+         if (semaphore->count > 0)
+         {
+            semaphore->count--;
+            success = true;
+         }
+
          break;
       }
-      else
-      {
-         timer->timeout[0] -= ptr->timeout[0];
-      }
+#endif
 
-      previous = ptr;
-      ptr = ptr->next;
-   }
+#if MUTEXES
+      case KERNEL_WAIT_MUTEX:
+         success = __mutexLock(poll->source);
+         break;
+#endif
 
-   timer->next = ptr;
+#if QUEUES
+      case KERNEL_WAIT_QUEUE_POP:
+      {
+         Queue* queue = poll->source;
 
-   if (previous != NULL)
-      previous->next = timer;
-   else
-      timers = timer;
-}
+         if (poll->arg1 != NULL)
+            success = __queuePop(queue, true, false, poll->arg1);
+         else
+            success = (queue->count > 0);
 
-/****************************************************************************
- *
- ****************************************************************************/
-void _timerAdd(Timer* timer, void (*fx)(Timer*), void* arg)
-{
-   _smpLock();
+         break;
+      }
 
-   timer->fx = fx;
-   timer->arg = arg;
+      case KERNEL_WAIT_QUEUE_PUSH:
+      {
+         Queue* queue = poll->source;
 
-   unsigned long timeout0 = taskGetTimeout();
-   __timerAdd(timer);
-   unsigned long timeout1 = taskGetTimeout();
+         if (poll->arg1 != NULL)
+            success = __queuePush(queue, true, poll->arg1);
+         else
+            success = (queue->count < queue->max);
 
-   if (timeout1 < timeout0)
-      taskAdjTimeout(taskScheduleTick(timeout0 != -1, timeout1));
+         break;
+      }
+#endif
+   }
 
-   _smpUnlock();
+   return success;
 }
 
 /****************************************************************************
- *
+ * Queues a kernelWait() waiter on its object (object and scheduler locks
+ * held).  Queue waiters use the same arguments as queueWait(): a pop waiter
+ * without data peeks (so the element is left in the queue) and a push
+ * waiter without data is only woken once space is free.
  ****************************************************************************/
-void timerAdd(Timer* timer, void (*fx)(Timer*), void* arg)
+static void taskPollQueue(TaskPoll* poll)
 {
-   kernelLock();
+   poll->task = current;
+   poll->success = false;
+   poll->arg0 = (poll->type != KERNEL_WAIT_QUEUE_POP) ||
+                (poll->arg1 == NULL);
 
-   timer->fx = fx;
-   timer->arg = arg;
-
-   unsigned long timeout0 = taskGetTimeout();
-   __timerAdd(timer);
-   unsigned long timeout1 = taskGetTimeout();
+#if MUTEXES
+   if (poll->type == KERNEL_WAIT_MUTEX)
+   {
+      Mutex* mutex = poll->source;
 
-   if (timeout1 < timeout0)
-      taskAdjTimeout(taskScheduleTick(timeout0 != -1, timeout1));
+#if TASK_PRIORITY_POLARITY
+      if (current->priority > mutex->owner->priority)
+#else
+      if (current->priority < mutex->owner->priority)
+#endif
+         __taskPriority(mutex->owner, current->priority);
+   }
+#endif
 
-   kernelUnlock();
+   taskPollAdd(taskPollHead(poll), poll);
 }
 
 /****************************************************************************
- *
+ * Takes the first ready object or blocks on all of them.  Every waker goes
+ * through taskPollWake(), which skips waiters whose task is already awake,
+ * so only one object is ever handed to the task.
  ****************************************************************************/
-static void __timerCancel(Timer* timer)
+static int taskPollWait(TaskPoll* poll, int size, unsigned char state,
+                        unsigned long ticks)
 {
-   Timer* previous = NULL;
-   Timer* ptr = timers;
+   int i;
 
-   while (ptr != NULL)
+   bool iFlag = kernelEnter();
+   taskPollLockAll(poll, size, true);
+
+   for (i = 0; i < size; i++)
+   {
+      if (taskPollTake(&poll[i]))
+         break;
+   }
+
+   if (i < size)
+   {
+      taskPollLockAll(poll, size, false);
+
+      /* a queue push/pop may have woken a waiter */
+      if (poll[i].type >= KERNEL_WAIT_QUEUE_POP)
+         taskReschedule();
+   }
+   else
    {
-      if (ptr == timer)
+      i = -1;
+
+      if (ticks > 0)
       {
-         if (timer->next != NULL)
-            timer->next->timeout[0] += timer->timeout[0];
+         current->inactive.poll = poll;
+         current->inactive.size = size;
 
-         if (previous != NULL)
-            previous->next = timer->next;
-         else
-            timers = timer->next;
+         schedLock();
 
-         if ((timer->flags & TIMER_FLAG_EXPIRED) && (timer->task != NULL))
-         {
-            timer->task->flags &= ~TASK_FLAG_RESTART;
+         for (int j = 0; j < size; j++)
+            taskPollQueue(&poll[j]);
 
-            if ((timer->task->state == TASK_STATE_READY) &&
-                ((timer->task->flags & TASK_FLAG_STARTED) == 0))
-            {
-               Task* previous = NULL;
-               Task* ptr = ready[timer->task->priority].head;
-
-               while (ptr != NULL)
-               {
-                  if (ptr == timer->task)
-                  {
-                     if (previous != NULL)
-                        previous->next = timer->task->next;
-                     else
-                        ready[timer->task->priority].head = timer->task->next;
-
-                     if (timer->task->next == NULL)
-                        ready[timer->task->priority].tail = previous;
-
-                     break;
-                  }
-
-                  previous = ptr;
-                  ptr = ptr->next;
-               }
-            }
+         taskSetTimeout(state, ticks);
+         taskPollLockAll(poll, size, false);
+         taskWait();
+         schedUnlock();
+
+         taskPollLockAll(poll, size, true);
+
+         for (int j = 0; j < size; j++)
+         {
+            if (poll[j].success)
+               i = j;
+            else
+               taskPollDel(taskPollHead(&poll[j]), &poll[j]);
          }
 
-         break;
+         current->inactive.poll = NULL;
+         current->inactive.size = 0;
       }
 
-      previous = ptr;
-      ptr = ptr->next;
+      taskPollLockAll(poll, size, false);
    }
+
+   kernelLeave(iFlag);
+
+   return i;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void _timerCancel(Timer* timer)
+int kernelWait(TaskPoll* poll, int size, unsigned long ticks)
 {
-   _smpLock();
-   __timerCancel(timer);
-   _smpUnlock();
+   return taskPollWait(poll, size, TASK_STATE_WAIT, ticks);
 }
+#endif
 
+#if EVENT_GROUPS
 /****************************************************************************
- *
+ * What a task waits for on an event group (TaskPoll.arg1).
  ****************************************************************************/
-void timerCancel(Timer* timer)
+typedef struct
 {
-   kernelLock();
-   __timerCancel(timer);
-   kernelUnlock();
-}
-#endif
+   unsigned long flags;
+   unsigned char mode;
+   unsigned long result;
+
+} EventGroupWait;
 
-#if QUEUES
 #ifdef kmalloc
 /****************************************************************************
  *
  ****************************************************************************/
-Queue* queueCreate(const char* name, unsigned int elementSize,
-                   unsigned int maxElements)
+EventGroup* eventGroupCreate(const char* name, unsigned long flags)
 {
-   Queue* queue = kmalloc(sizeof(Queue));
-
-   memset(queue, 0, sizeof(Queue));
+   EventGroup* group = kmalloc(sizeof(EventGroup));
 
-   queue->name = name;
-   queue->size = elementSize;
-   queue->max = maxElements;
-   queue->buffer = kmalloc(elementSize * maxElements);
+   memset(group, 0, sizeof(EventGroup));
+   group->name = name;
+   group->flags = flags;
 
-   return queue;
+   return group;
 }
 #endif
 
@@ -1477,337 +5152,324 @@ Queue* queueCreate(const char* name, unsigned int elementSize,
 /****************************************************************************
  *
  ****************************************************************************/
-void queueDestroy(Queue* queue)
+void eventGroupDestroy(EventGroup* group)
 {
-   kfree(queue->buffer);
-   kfree(queue);
+   kfree(group);
 }
 #endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-static bool __queuePush(Queue* queue, bool tail, const void* src)
+static bool eventGroupReady(unsigned long flags, unsigned long wait,
+                            unsigned char mode)
 {
-   bool success = false;
-
-   if (queue->count < queue->max)
-   {
-      bool insert = true;
+   if (mode & EVENT_GROUP_WAIT_ALL)
+      return (flags & wait) == wait;
+   else
+      return (flags & wait) != 0;
+}
 
-      while ((queue->poll != NULL) && insert)
-      {
-         if (queue->poll->arg1 != NULL)
-            memcpy(queue->poll->arg1, src, queue->size);
+/****************************************************************************
+ * Every waiter is checked against the flags as set, so one event can wake
+ * several tasks; the flags they asked to clear are cleared afterwards.
+ ****************************************************************************/
+static bool __eventGroupSet(EventGroup* group, unsigned long flags)
+{
+   TaskPoll* poll = group->poll;
+   unsigned long clear = 0;
+   bool woken = false;
 
-         insert = queue->poll->arg0;
-         queue->poll->success = true;
+   group->flags |= flags;
 
-         taskCancelTimeout(queue->poll->task);
-         queue->poll = queue->poll->next;
-      }
+   while (poll != NULL)
+   {
+      TaskPoll* next = poll->next;
+      EventGroupWait* wait = poll->arg1;
 
-      if (insert)
+      if (eventGroupReady(group->flags, wait->flags, wait->mode))
       {
-         unsigned long i;
+         wait->result = group->flags;
 
-         if (tail)
-            i = queue->index + queue->count;
-         else
-            i = --queue->index;
+         if (wait->mode & EVENT_GROUP_WAIT_CLEAR)
+            clear |= wait->flags;
 
-         i %= queue->max;
+         poll->success = true;
+         taskPollDel(&group->poll, poll);
 
-         memcpy(&queue->buffer[i * queue->size], src, queue->size);
-         queue->count++;
+         schedLock();
+         taskCancelTimeout(poll->task);
+         schedUnlock();
+
+         woken = true;
       }
 
-      success = true;
+      poll = next;
    }
 
-   return success;
+   group->flags &= ~clear;
+
+   return woken;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-static bool __queuePop(Queue* queue, bool head, bool peek, void* dst)
+unsigned long _eventGroupSet(EventGroup* group, unsigned long flags)
 {
-   bool success = false;
-
-   if (queue->count > 0)
-   {
-      void* src = NULL;
-
-      if ((queue->poll != NULL) && !peek)
-      {
-         if (head)
-         {
-            if (queue->poll->arg0)
-            {
-               unsigned long i = queue->index++ % queue->max;
-               src = &queue->buffer[i * queue->size];
-            }
-            else
-            {
-               src = queue->poll->arg1;
-            }
-         }
-         else
-         {
-            if (queue->poll->arg0)
-            {
-               src = queue->poll->arg1;
-            }
-            else
-            {
-               unsigned long i = (queue->index - 1) % queue->max;
-               src = &queue->buffer[i * queue->size];
-            }
-         }
-
-         if (dst != NULL)
-            memcpy(dst, src, queue->size);
+   objectLock(group);
+   __eventGroupSet(group, flags);
+   flags = group->flags;
+   objectUnlock(group);
 
-         if (src != queue->poll->arg1)
-            memcpy(src, queue->poll->arg1, queue->size);
+   return flags;
+}
 
-         queue->poll->success = true;
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long eventGroupSet(EventGroup* group, unsigned long flags)
+{
+   bool iFlag = kernelEnter();
+   objectLock(group);
 
-         taskCancelTimeout(queue->poll->task);
-         queue->poll = queue->poll->next;
-      }
-      else
-      {
-         if (head)
-         {
-            unsigned long i = queue->index % queue->max;
-            src = &queue->buffer[i * queue->size];
+   bool woken = __eventGroupSet(group, flags);
+   flags = group->flags;
 
-            if (!peek)
-               queue->index++;
-         }
-         else
-         {
-            unsigned long i = (queue->index + queue->count - 1) % queue->max;
-            src = &queue->buffer[i * queue->size];
-         }
+   objectUnlock(group);
 
-         if (dst != NULL)
-            memcpy(dst, src, queue->size);
+   if (woken)
+      taskReschedule();
 
-         if (!peek)
-            queue->count--;
-      }
+   kernelLeave(iFlag);
 
-      success = true;
-   }
+   return flags;
+}
 
-   return success;
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long _eventGroupClear(EventGroup* group, unsigned long flags)
+{
+   objectLock(group);
+   unsigned long previous = group->flags;
+   group->flags &= ~flags;
+   objectUnlock(group);
+
+   return previous;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-bool _queuePush(Queue* queue, bool tail, const void* src)
+unsigned long eventGroupClear(EventGroup* group, unsigned long flags)
 {
-   _smpLock();
-   bool success = __queuePush(queue, tail, src);
-   _smpUnlock();
+   bool iFlag = kernelEnter();
+   unsigned long previous = _eventGroupClear(group, flags);
+   kernelLeave(iFlag);
 
-   return success;
+   return previous;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-bool queuePush(Queue* queue, bool tail, const void* src, unsigned long ticks)
+unsigned long eventGroupWait(EventGroup* group, unsigned long flags,
+                             unsigned char mode, unsigned long ticks)
 {
-   kernelLock();
+   unsigned long result = 0;
 
-   bool success = __queuePush(queue, tail, src);
+   bool iFlag = kernelEnter();
+   objectLock(group);
 
-   if (success)
+   if (eventGroupReady(group->flags, flags, mode))
    {
-      Task* task = taskNext(current->priority);
+      result = group->flags;
 
-      if (task != NULL)
-         taskSwitch(task);
+      if (mode & EVENT_GROUP_WAIT_CLEAR)
+         group->flags &= ~flags;
    }
    else if (ticks > 0)
    {
+      EventGroupWait wait;
       TaskPoll poll;
 
+      wait.flags = flags;
+      wait.mode = mode;
+      wait.result = 0;
+
       poll.task = current;
-      poll.source = queue;
+      poll.source = group;
       poll.success = false;
-      poll.arg0 = tail;
-      poll.arg1 = (void*) src;
+      poll.arg1 = &wait;
 
       current->inactive.poll = &poll;
       current->inactive.size = 1;
 
-      taskPollAdd(&queue->poll, &poll);
+      taskPollAdd(&group->poll, &poll);
 
-      taskSetTimeout(TASK_STATE_QUEUE, ticks);
-      success = poll.success;
+      schedLock();
+      taskSetTimeout(TASK_STATE_EVENT, ticks);
+      objectUnlock(group);
+      taskWait();
+      schedUnlock();
 
-      if (!success)
-         taskPollDel(&queue->poll, current);
+      objectLock(group);
+
+      if (poll.success)
+         result = wait.result;
+      else
+         taskPollDel(&group->poll, &poll);
 
       current->inactive.poll = NULL;
       current->inactive.size = 0;
    }
 
-   kernelUnlock();
+   objectUnlock(group);
+   kernelLeave(iFlag);
 
-   return success;
+   return result;
 }
+#endif
 
+#if WORK_QUEUES
 /****************************************************************************
  *
  ****************************************************************************/
-bool _queuePop(Queue* queue, bool head, bool peek, void* dst)
-{
-   _smpLock();
-   bool success = __queuePop(queue, head, peek, dst);
-   _smpUnlock();
-
-   return success;
-}
+#define WORK_FLAG_QUEUED  0x01
+#define WORK_FLAG_DELAYED 0x02
+#define WORK_FLAG_TIMER   0x04
 
 /****************************************************************************
- *
+ * Takes the work at the head of this CPU's list, sleeping while it is
+ * empty.  Submitting to an empty list wakes the worker, so it only sleeps
+ * once it has seen the list empty.
  ****************************************************************************/
-bool queuePop(Queue* queue, bool head, bool peek, void* dst,
-              unsigned long ticks)
+static void workQueueFx(void* arg)
 {
-   kernelLock();
-
-   bool success = __queuePop(queue, head, peek, dst);
+   WorkQueue* queue = arg;
+   int cpu = cpuID();
 
-   if (success)
-   {
-      Task* task = taskNext(current->priority);
-
-      if (task != NULL)
-         taskSwitch(task);
-   }
-   else if (ticks > 0)
+   for (;;)
    {
-      TaskPoll poll;
+      bool iFlag = kernelEnter();
+      objectLock(queue);
 
-      poll.task = current;
-      poll.source = queue;
-      poll.success = false;
-      poll.arg0 = peek;
-      poll.arg1 = dst;
+      Work* work = queue->cpu[cpu].head;
 
-      current->inactive.poll = &poll;
-      current->inactive.size = 1;
+      if (work != NULL)
+      {
+         LIST_REMOVE(queue->cpu[cpu].head, work);
 
-      taskPollAdd(&queue->poll, &poll);
+         if (queue->cpu[cpu].tail == work)
+            queue->cpu[cpu].tail = NULL;
 
-      taskSetTimeout(TASK_STATE_QUEUE, ticks);
-      success = poll.success;
+         work->flags &= WORK_FLAG_TIMER;
+      }
 
-      if (!success)
-         taskPollDel(&queue->poll, current);
+      objectUnlock(queue);
+      kernelLeave(iFlag);
 
-      current->inactive.poll = NULL;
-      current->inactive.size = 0;
+      if (work != NULL)
+         work->fx(work);
+      else
+         semaphoreTake(&queue->cpu[cpu].semaphore, -1);
    }
-
-   kernelUnlock();
-
-   return success;
 }
-#endif
 
-#if SEMAPHORES
 #ifdef kmalloc
 /****************************************************************************
  *
  ****************************************************************************/
-Semaphore* semaphoreCreate(const char* name, unsigned int count,
-                           unsigned int max)
+WorkQueue* workQueueCreate(const char* name, signed char priority,
+                           unsigned long stackSize)
 {
-   Semaphore* semaphore = kmalloc(sizeof(Semaphore));
+   WorkQueue* queue = kmalloc(sizeof(WorkQueue));
 
-   memset(semaphore, 0, sizeof(Semaphore));
-   semaphore->name = name;
-   semaphore->count = count;
-   semaphore->max = max;
+   memset(queue, 0, sizeof(WorkQueue));
 
-   return semaphore;
-}
-#endif
+   queue->name = name;
+   queue->priority = priority;
+   queue->stackSize = stackSize;
+   queue->tasks = kmalloc(sizeof(Task) * WORK_QUEUE_CPUS);
+   queue->stacks = kmalloc(stackSize * WORK_QUEUE_CPUS);
 
-#ifdef kfree
-/****************************************************************************
- *
- ****************************************************************************/
-void semaphoreDestroy(Semaphore* semaphore)
-{
-   kfree(semaphore);
+   workQueueStart(queue);
+
+   return queue;
 }
 #endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-static bool __semaphoreGive(Semaphore* semaphore)
+void workQueueStart(WorkQueue* queue)
 {
-   bool success = true;
-
-   if (semaphore->poll != NULL)
-   {
-      semaphore->poll->success = true;
-      taskCancelTimeout(semaphore->poll->task);
-      semaphore->poll = semaphore->poll->next;
-   }
-   else if (semaphore->count < semaphore->max)
+   for (int cpu = 0; cpu < WORK_QUEUE_CPUS; cpu++)
    {
-      semaphore->count++;
-   }
-   else
-   {
-      success = false;
-   }
+      Task* task = &queue->tasks[cpu];
 
-   return success;
+      queue->cpu[cpu].head = NULL;
+      queue->cpu[cpu].tail = NULL;
+      queue->cpu[cpu].semaphore =
+         (Semaphore) SEMAPHORE_CREATE(queue->name, 0, 1);
+
+      memset(task, 0, sizeof(Task));
+
+      task->name = queue->name;
+      task->priority = queue->priority;
+      task->state = TASK_STATE_INIT;
+      task->slice.quantum = TASK_QUANTUM;
+      task->stack.size = queue->stackSize;
+      task->stack.base = queue->stacks + queue->stackSize * cpu;
+
+#ifdef SMP
+      /* each worker only ever serves the list of its own CPU */
+      taskSetAffinity(task, 1UL << cpu);
+#endif
+      taskStart(task, workQueueFx, queue);
+   }
 }
 
 /****************************************************************************
- *
+ * Appends work to a CPU's list.  Returns true if the list was empty (so the
+ * worker has to be woken).
  ****************************************************************************/
-bool _semaphoreGive(Semaphore* semaphore)
+static bool workAppend(WorkQueue* queue, Work* work, int cpu)
 {
-   _smpLock();
-   bool success = __semaphoreGive(semaphore);
-   _smpUnlock();
+   bool wake = queue->cpu[cpu].head == NULL;
 
-   return success;
+   LIST_INSERT(queue->cpu[cpu].head, queue->cpu[cpu].tail, work);
+   queue->cpu[cpu].tail = work;
+
+   work->queue = queue;
+   work->flags = (work->flags & WORK_FLAG_TIMER) | WORK_FLAG_QUEUED;
+   work->cpu = (unsigned char) cpu;
+
+   return wake;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-bool semaphoreGive(Semaphore* semaphore)
+bool _workSubmit(WorkQueue* queue, Work* work)
 {
-   kernelLock();
+   int cpu = cpuID();
+   bool success = false;
+   bool wake = false;
 
-   bool success = __semaphoreGive(semaphore);
+   objectLock(queue);
 
-   if (success)
+   if ((work->flags & ~WORK_FLAG_TIMER) == 0)
    {
-      Task* task = taskNext(current->priority);
-
-      if (task != NULL)
-         taskSwitch(task);
+      wake = workAppend(queue, work, cpu);
+      success = true;
    }
 
-   kernelUnlock();
+   objectUnlock(queue);
+
+   if (wake)
+      _semaphoreGive(&queue->cpu[cpu].semaphore);
 
    return success;
 }
@@ -1815,194 +5477,172 @@ bool semaphoreGive(Semaphore* semaphore)
 /****************************************************************************
  *
  ****************************************************************************/
-bool semaphoreTake(Semaphore* semaphore, unsigned long ticks)
+bool workSubmit(WorkQueue* queue, Work* work)
 {
-   TaskPoll poll;
-   poll.source = semaphore;
-   return semaphoreTake2(&poll, 1, ticks) != -1;
+   bool iFlag = kernelEnter();
+   int cpu = cpuID();
+   bool success = false;
+   bool wake = false;
+
+   objectLock(queue);
+
+   if ((work->flags & ~WORK_FLAG_TIMER) == 0)
+   {
+      wake = workAppend(queue, work, cpu);
+      success = true;
+   }
+
+   objectUnlock(queue);
+   kernelLeave(iFlag);
+
+   /* the worker belongs to the CPU the work was queued on, even if this
+      task has moved since */
+   if (wake)
+      semaphoreGive(&queue->cpu[cpu].semaphore);
+
+   return success;
 }
 
+#if TIMERS
 /****************************************************************************
- *
+ * Moves delayed work onto the list of the CPU the timer expired on, unless
+ * it was cancelled in the meantime.  Until this has run the timer may still
+ * be on the tick's list of expired timers, so it cannot be armed again.
  ****************************************************************************/
-int semaphoreTake2(struct TaskPoll* poll, int size, unsigned long ticks)
+static void workTimerFx(Timer* timer)
 {
-   int i;
-
-   kernelLock();
+   Work* work = timer->arg;
+   WorkQueue* queue = work->queue;
+   int cpu = cpuID();
+   bool wake = false;
 
-   for (i = 0; i < size; i++)
-   {
-      Semaphore* semaphore = poll[i].source;
+   objectLock(queue);
 
-      if (semaphore->count > 0)
-      {
-         semaphore->count--;
-         break;
-      }
-   }
+   work->flags &= ~WORK_FLAG_TIMER;
 
-   if (i == size)
-   {
-      i = -1;
+   if (work->flags == WORK_FLAG_DELAYED)
+      wake = workAppend(queue, work, cpu);
 
-      if (ticks > 0)
-      {
-         current->inactive.poll = poll;
-         current->inactive.size = size;
+   objectUnlock(queue);
 
-         for (int j = 0; j < size; j++)
-         {
-            poll[j].task = current;
-            poll[j].success = false;
+   if (wake)
+      _semaphoreGive(&queue->cpu[cpu].semaphore);
+}
 
-            Semaphore* semaphore = poll[j].source;
-            taskPollAdd(&semaphore->poll, &poll[j]);
-         }
+/****************************************************************************
+ * The timer is armed with the queue locked, so workCancel() always finds
+ * it either armed or already expired.  Delayed work is refused until the
+ * callback of a cancelled timer has run.
+ ****************************************************************************/
+static bool __workSubmitDelayed(WorkQueue* queue, Work* work,
+                                unsigned long ticks)
+{
+   bool success = false;
 
-         taskSetTimeout(TASK_STATE_SEMAPHORE, ticks);
+   objectLock(queue);
 
-         for (int j = 0; j < size; j++)
-         {
-            Semaphore* semaphore = poll[j].source;
+   if (work->flags == 0)
+   {
+      work->queue = queue;
+      work->flags = WORK_FLAG_DELAYED | WORK_FLAG_TIMER;
 
-            if (poll[j].success)
-               i = j;
-            else
-               taskPollDel(&semaphore->poll, current);
-         }
+      work->timer.flags = 0;
+      work->timer.task = NULL;
+      work->timer.timeout[0] = ticks;
+      work->timer.timeout[1] = ticks;
 
-         current->inactive.poll = NULL;
-         current->inactive.size = 0;
-      }
+      _timerAdd(&work->timer, workTimerFx, work);
+      success = true;
    }
 
-   kernelUnlock();
+   objectUnlock(queue);
 
-   return i;
+   return success;
 }
-#endif
 
-#if MUTEXES
-#ifdef kmalloc
 /****************************************************************************
  *
  ****************************************************************************/
-Mutex* mutexCreate(const char* name)
+bool _workSubmitDelayed(WorkQueue* queue, Work* work, unsigned long ticks)
 {
-   Mutex* mutex = kmalloc(sizeof(Mutex));
-
-   memset(mutex, 0, sizeof(Mutex));
-   mutex->name = name;
-
-   return mutex;
+   return __workSubmitDelayed(queue, work, ticks);
 }
-#endif
 
-#ifdef kfree
 /****************************************************************************
  *
  ****************************************************************************/
-void mutexDestroy(Mutex* mutex)
+bool workSubmitDelayed(WorkQueue* queue, Work* work, unsigned long ticks)
 {
-   kfree(mutex);
+   bool iFlag = kernelEnter();
+   bool success = __workSubmitDelayed(queue, work, ticks);
+   kernelLeave(iFlag);
+
+   return success;
 }
 #endif
 
 /****************************************************************************
  *
  ****************************************************************************/
-bool mutexLock(Mutex* mutex, unsigned long ticks)
+static bool __workCancel(Work* work)
 {
-   bool success = false;
+   WorkQueue* queue = work->queue;
+   bool pending = true;
 
-   kernelLock();
+   /* never submitted */
+   if (queue == NULL)
+      return false;
 
-   if (mutex->count == 0)
-   {
-      mutex->count = 1;
-      mutex->priority = current->priority;
-      mutex->owner = current;
-      success = true;
-   }
-   else
+   objectLock(queue);
+
+   if (work->flags & WORK_FLAG_QUEUED)
    {
-      if (mutex->owner == current)
-      {
-         mutex->count++;
-         success = true;
-      }
-      else if (ticks > 0)
-      {
-         TaskPoll poll;
+      LIST_REMOVE(queue->cpu[work->cpu].head, work);
 
-         poll.task = current;
-         poll.source = mutex;
-         poll.success = false;
+      if (queue->cpu[work->cpu].tail == work)
+         queue->cpu[work->cpu].tail = work->prev;
 
-         current->inactive.poll = &poll;
-         current->inactive.size = 1;
+      work->flags &= WORK_FLAG_TIMER;
+   }
+#if TIMERS
+   else if (work->flags & WORK_FLAG_DELAYED)
+   {
+      work->flags &= ~WORK_FLAG_DELAYED;
 
-#if TASK_PRIORITY_POLARITY
-         if (current->priority > mutex->owner->priority)
-#else
-         if (current->priority < mutex->owner->priority)
+      /* a timer that already expired still has its callback to come */
+      _smpLock();
+      if (__timerCancel(&work->timer))
+         work->flags &= ~WORK_FLAG_TIMER;
+      _smpUnlock();
+   }
 #endif
-            __taskPriority(mutex->owner, current->priority);
-
-         taskPollAdd(&mutex->poll, &poll);
-
-         taskSetTimeout(TASK_STATE_MUTEX, ticks);
-         success = poll.success;
-
-         if (!success)
-            taskPollDel(&mutex->poll, current);
-
-         current->inactive.poll = NULL;
-         current->inactive.size = 0;
-      }
+   else
+   {
+      pending = false;
    }
 
-   kernelUnlock();
+   objectUnlock(queue);
 
-   return success;
+   return pending;
 }
 
 /****************************************************************************
  *
  ****************************************************************************/
-void mutexUnlock(Mutex* mutex)
+bool _workCancel(Work* work)
 {
-   if (mutex->owner != current)
-      return;
-
-   kernelLock();
-
-   if (--mutex->count == 0)
-   {
-      if (mutex->poll != NULL)
-      {
-         __taskPriority(current, mutex->priority);
-
-         mutex->count = 1;
-         mutex->priority = mutex->poll->task->priority;
-         mutex->owner = mutex->poll->task;
-         mutex->poll->success = true;
-         mutex->poll = mutex->poll->next;
-
-         taskCancelTimeout(mutex->owner);
-
-         Task* task = taskNext(current->priority);
+   return __workCancel(work);
+}
 
-         if (task != NULL)
-            taskSwitch(task);
-      }
-      else
-      {
-         mutex->owner = NULL;
-      }
-   }
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool workCancel(Work* work)
+{
+   bool iFlag = kernelEnter();
+   bool pending = __workCancel(work);
+   kernelLeave(iFlag);
 
-   kernelUnlock();
+   return pending;
 }
 #endif
@@ -69,6 +69,28 @@
 #define TASK_STACK_USAGE 0
 #endif
 
+/****************************************************************************
+ * Size (a power of two, 0 for none) of an inaccessible guard placed right
+ * below each stack taskCreate() allocates, so an overflow faults at once.
+ * The port makes the guard fault with taskStackGuard() (the MMU page size
+ * is the natural choice) and can find the task from its fault handler with
+ * taskStackFault().  Stacks are allocated aligned with kmemalign() when the
+ * board defines it (like kmalloc), otherwise taskCreate() over-allocates
+ * each one by up to TASK_STACK_GUARD - 1 bytes to align the guard.
+ ****************************************************************************/
+#ifndef TASK_STACK_GUARD
+#define TASK_STACK_GUARD 0
+#endif
+
+/****************************************************************************
+ * Pools of preallocated task containers and stacks (one pool per stack size
+ * class) that taskPoolTake() hands out and the reaper takes back, so short
+ * lived tasks can come and go without touching the heap.
+ ****************************************************************************/
+#ifndef TASK_POOLS
+#define TASK_POOLS 0
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -76,6 +98,109 @@
 #define TASK_LIST 0
 #endif
 
+/****************************************************************************
+ * Default time slice (in system ticks) given to a task before _taskPreempt()
+ * rotates it with a ready task of equal priority (0 runs until it blocks).
+ ****************************************************************************/
+#ifndef TASK_QUANTUM
+#define TASK_QUANTUM 1
+#endif
+
+/****************************************************************************
+ * Tasks in the TASK_EDF_PRIORITY band that declare a period with
+ * taskSetPeriod() run in earliest absolute deadline order instead of first
+ * come first served.  All other bands keep fixed priority scheduling.
+ ****************************************************************************/
+#ifndef TASK_EDF
+#define TASK_EDF 0
+#endif
+
+#if TASK_EDF && !defined(TASK_EDF_PRIORITY)
+#define TASK_EDF_PRIORITY 0
+#endif
+
+/****************************************************************************
+ * Accounts the CPU time used by each task (and each CPU's idle time) at
+ * every task switch with taskClock().  Usage is summed over windows of
+ * TASK_STATS_WINDOW microseconds and averaged over TASK_STATS_WINDOWS.
+ ****************************************************************************/
+#ifndef TASK_STATS
+#define TASK_STATS 0
+#endif
+
+#if TASK_STATS && !defined(TASK_STATS_WINDOW)
+#define TASK_STATS_WINDOW 1000000
+#endif
+
+#if TASK_STATS && !defined(TASK_STATS_WINDOWS)
+#define TASK_STATS_WINDOWS 8
+#endif
+
+/****************************************************************************
+ * Measures the latency from an interrupt waking a task (_semaphoreGive(),
+ * _queuePush(), _queuePushN() or _queueCommit()) to the task running, with
+ * taskClock().  Latencies are kept in a histogram per priority of
+ * TASK_LATENCY_BUCKETS power of two buckets of microseconds.
+ ****************************************************************************/
+#ifndef TASK_LATENCY
+#define TASK_LATENCY 0
+#endif
+
+#if TASK_LATENCY && !defined(TASK_LATENCY_BUCKETS)
+#define TASK_LATENCY_BUCKETS 20
+#endif
+
+/****************************************************************************
+ * Macro: LIST_INSERT
+ *    - Links a node into an intrusive doubly linked list.  Any structure
+ *      with "next" and "prev" members can be a node and the list itself is
+ *      just a head pointer (the head's "prev" is NULL).
+ * Arguments:
+ *    head  - head of the list
+ *    after - node to insert after (NULL to insert at the head)
+ *    node  - node to insert
+ ****************************************************************************/
+#define LIST_INSERT(head, after, node)          \
+do                                              \
+{                                               \
+   (node)->prev = (after);                      \
+                                                \
+   if ((node)->prev != NULL)                    \
+   {                                            \
+      (node)->next = (node)->prev->next;        \
+      (node)->prev->next = (node);              \
+   }                                            \
+   else                                         \
+   {                                            \
+      (node)->next = (head);                    \
+      (head) = (node);                          \
+   }                                            \
+                                                \
+   if ((node)->next != NULL)                    \
+      (node)->next->prev = (node);              \
+                                                \
+} while (0)
+
+/****************************************************************************
+ * Macro: LIST_REMOVE
+ *    - Unlinks a node from an intrusive doubly linked list in constant time.
+ * Arguments:
+ *    head - head of the list
+ *    node - node to remove (must be on the list)
+ ****************************************************************************/
+#define LIST_REMOVE(head, node)                 \
+do                                              \
+{                                               \
+   if ((node)->prev != NULL)                    \
+      (node)->prev->next = (node)->next;        \
+   else                                         \
+      (head) = (node)->next;                    \
+                                                \
+   if ((node)->next != NULL)                    \
+      (node)->next->prev = (node)->prev;        \
+                                                \
+} while (0)
+
 /****************************************************************************
  * Macro: TASK_CREATE
  *    - Creates a statically allocated task container.
@@ -87,15 +212,17 @@
  ****************************************************************************/
 #define TASK_CREATE(name, priority, stackSize)       \
 {                                                    \
+   NULL,                                             \
    NULL,                                             \
    name,                                             \
    priority,                                         \
    TASK_STATE_INIT,                                  \
    0,                                                \
    0,                                                \
+   {TASK_QUANTUM, 0},                                \
    {NULL, NULL},                                     \
    {stackSize, (unsigned char[stackSize]) {}, NULL}, \
-   {0, NULL, 0},                                     \
+   {0, NULL, 0, NULL},                               \
    {},                                               \
    NULL                                              \
 }
@@ -117,6 +244,9 @@
 #define TASK_STATE_QUEUE     5
 #define TASK_STATE_SEMAPHORE 6
 #define TASK_STATE_MUTEX     7
+#define TASK_STATE_RING      8
+#define TASK_STATE_EVENT     9
+#define TASK_STATE_WAIT      10
 
 /****************************************************************************
  *
@@ -130,12 +260,44 @@ typedef struct TaskData
 
 } TaskData;
 
+#if TASK_STATS
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   unsigned long long total;
+   unsigned long long window;
+   unsigned long run;
+   unsigned long last;
+   unsigned long average;
+   unsigned long switches;
+
+} TaskStats;
+#endif
+
+#if TASK_LATENCY
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   unsigned long count;
+   unsigned long min;
+   unsigned long max;
+   unsigned long long sum;
+   unsigned long buckets[TASK_LATENCY_BUCKETS];
+
+} TaskLatency;
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
 typedef struct Task
 {
    struct Task* next;
+   struct Task* prev;
 
    const char* name;
    signed char priority;
@@ -143,6 +305,13 @@ typedef struct Task
    unsigned char flags;
    unsigned char cpu;
 
+   struct
+   {
+      unsigned long quantum;
+      unsigned long start;
+
+   } slice;
+
    struct
    {
       void (*fx)(void*);
@@ -155,6 +324,9 @@ typedef struct Task
       unsigned long size;
       void* base;
       void* ptr;
+#if TASK_STACK_GUARD
+      void* alloc;
+#endif
 
    } stack;
 
@@ -163,6 +335,7 @@ typedef struct Task
       unsigned long timeout;
       struct TaskPoll* poll;
       unsigned int size;
+      struct Task* child;
 
    } inactive;
 
@@ -176,6 +349,31 @@ typedef struct Task
 
    TaskData* data;
 
+#if TASK_EDF
+   struct
+   {
+      unsigned long period;
+      unsigned long deadline;
+      unsigned long release;
+      unsigned long due;
+      unsigned long jobs;
+      unsigned long misses;
+
+   } edf;
+#endif
+
+#ifdef SMP
+   unsigned long affinity;
+#endif
+
+#if TASK_STATS
+   TaskStats stats;
+#endif
+
+#if TASK_LATENCY
+   unsigned long long woken;
+#endif
+
 } Task;
 
 /****************************************************************************
@@ -184,12 +382,14 @@ typedef struct Task
 typedef struct TaskPoll
 {
    struct TaskPoll* next;
+   struct TaskPoll* prev;
 
    Task* task;
    void* source;
    bool success;
    bool arg0;
    void* arg1;
+   unsigned char type;
 
 } TaskPoll;
 
@@ -212,6 +412,109 @@ Task* taskCreate(const char* name, signed char priority,
                  unsigned long stackSize, bool freeOnExit);
 #endif
 
+#if TASK_POOLS
+/****************************************************************************
+ * Macro: TASK_POOL_CREATE
+ *    - Creates a statically allocated pool of task containers and stacks.
+ * Arguments:
+ *    stackSize - stack size in bytes of each task
+ *    count     - number of tasks in the pool
+ ****************************************************************************/
+#define TASK_POOL_CREATE(stackSize, count)           \
+{                                                    \
+   NULL,                                             \
+   stackSize,                                        \
+   count,                                            \
+   (Task[count]) {},                                 \
+   (unsigned char[(stackSize) * (count)]) {},        \
+   NULL,                                             \
+   0,                                                \
+   0,                                                \
+   0                                                 \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define TASK_POOL_CREATE_PTR(stackSize, count) \
+   ((TaskPool[1]) {TASK_POOL_CREATE(stackSize, count)})
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct TaskPool
+{
+   struct TaskPool* next;
+
+   unsigned long stackSize;
+   unsigned int count;
+   Task* tasks;
+   unsigned char* stacks;
+
+   Task* free;
+   unsigned int available;
+   unsigned long hits;
+   unsigned long misses;
+
+} TaskPool;
+
+/****************************************************************************
+ * Function: taskPoolAdd
+ *    - Adds a pool of tasks as the size class for its stack size.
+ * Arguments:
+ *    pool - pool created with TASK_POOL_CREATE()
+ * Notes:
+ *    - Only one pool per stack size should be added.
+ *    - Pools cannot be removed.
+ ****************************************************************************/
+void taskPoolAdd(TaskPool* pool);
+
+#ifdef kmalloc
+/****************************************************************************
+ * Function: taskPoolCreate
+ *    - Dynamically allocates and adds a pool of tasks.
+ * Arguments:
+ *    stackSize - stack size in bytes of each task
+ *    count     - number of tasks in the pool
+ * Returns:
+ *    - pointer to the added pool
+ * Notes:
+ *    - Should not be called from interrupt context because of kmalloc usage.
+ ****************************************************************************/
+TaskPool* taskPoolCreate(unsigned long stackSize, unsigned int count);
+#endif
+
+/****************************************************************************
+ * Function: taskPoolTake
+ *    - Takes a task container from the smallest size class that fits.
+ * Arguments:
+ *    name      - name of task (must be const, non-local pointer)
+ *    priority  - lower integer values represent higher priorities
+ *                unless TASK_PRIORITY_POLARITY = 1
+ *    stackSize - minimum stack size in bytes
+ * Returns:
+ *    - pointer to initialized task container, NULL if none is available
+ * Notes:
+ *    - The task goes back to its pool when it exits (as if it was created
+ *      with freeOnExit).
+ *    - Counts a hit or a miss on the size class.  On a miss the task is
+ *      created with taskCreate() instead (if kmalloc is available), as it
+ *      is when no size class fits.
+ *    - Should not be called from interrupt context when kmalloc is
+ *      available.
+ ****************************************************************************/
+Task* taskPoolTake(const char* name, signed char priority,
+                   unsigned long stackSize);
+
+#if TASK_LIST
+/****************************************************************************
+ * Function: taskPoolList
+ *    - Dumps the size, usage and hit/miss counts of each pool via printf().
+ ****************************************************************************/
+void taskPoolList();
+#endif
+#endif
+
 /****************************************************************************
  * Function: _taskStart
  *    - Starts a new task.
@@ -333,6 +636,123 @@ void _taskPriority(Task* task, signed char priority);
  ****************************************************************************/
 void taskPriority(Task* task, signed char priority);
 
+#if TASK_EDF
+/****************************************************************************
+ * Function: taskSetPeriod
+ *    - Makes a task periodic with an earliest deadline first release.
+ * Arguments:
+ *    task     - task to make periodic (NULL changes current task)
+ *    period   - number of system ticks between releases (0 clears)
+ *    deadline - number of system ticks after each release that a job must
+ *               complete by (0 uses the period)
+ * Notes:
+ *    - The first job is released immediately.
+ *    - Deadlines only order tasks of priority TASK_EDF_PRIORITY.  A task
+ *      at any other priority keeps its deadline and miss count but is
+ *      scheduled by priority alone.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void taskSetPeriod(Task* task, unsigned long period, unsigned long deadline);
+
+/****************************************************************************
+ * Function: taskWaitPeriod
+ *    - Completes the current job and sleeps until the next release.
+ * Notes:
+ *    - The current task must have been made periodic by taskSetPeriod().
+ *    - A job completing after its deadline increments task->edf.misses.
+ *    - A job that overruns its period is followed by an immediate release,
+ *      skipping the releases that were missed.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void taskWaitPeriod();
+#endif
+
+/****************************************************************************
+ * Function: taskSetQuantum
+ *    - Changes the time slice of a task.
+ * Arguments:
+ *    task  - task to change time slice (NULL changes current task)
+ *    ticks - number of system ticks the task may run before a ready task of
+ *            equal priority gets a turn (0 runs until the task blocks)
+ * Notes:
+ *    - Tasks start with a time slice of TASK_QUANTUM ticks.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void taskSetQuantum(Task* task, unsigned long ticks);
+
+#ifdef SMP
+/****************************************************************************
+ * Function: taskSetAffinity
+ *    - Restricts the CPUs a task may run on.
+ * Arguments:
+ *    task - task to restrict (NULL changes current task)
+ *    mask - bit n set allows CPU n (a single bit pins the task)
+ * Returns:
+ *    - true if the mask allows at least one CPU, false otherwise
+ * Notes:
+ *    - Tasks start with an affinity of 0, which allows every CPU.
+ *    - Other CPUs never steal a task whose mask excludes them.
+ *    - A task that excludes the CPU it is running on moves right away if
+ *      that CPU has another task to run, otherwise the next time it is
+ *      switched out.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+bool taskSetAffinity(Task* task, unsigned long mask);
+#endif
+
+#if TASK_STATS
+/****************************************************************************
+ * Function: taskGetStats
+ *    - Gets the CPU time accounting of a task or of a CPU's idle time.
+ * Arguments:
+ *    task  - task to inspect (NULL gets the idle time of "cpu")
+ *    cpu   - CPU whose idle time to get (only used if task is NULL)
+ *    stats - receives the accounting, brought up to date
+ * Notes:
+ *    - All times are in microseconds.  "total" is the time run since the
+ *      task started, "last" the time run in the last complete window and
+ *      "average" a moving average of "last" over TASK_STATS_WINDOWS
+ *      windows, so "last" * 100 / TASK_STATS_WINDOW is the percentage of
+ *      one CPU used.  "switches" counts the times the task was switched
+ *      in.
+ *    - Interrupts are charged to the task (or idle time) they interrupt.
+ ****************************************************************************/
+void taskGetStats(Task* task, int cpu, TaskStats* stats);
+#endif
+
+#if TASK_LATENCY
+/****************************************************************************
+ * Function: taskGetLatency
+ *    - Gets the interrupt to task latency histogram of a priority.
+ * Arguments:
+ *    priority - priority whose tasks were woken
+ *    latency  - receives the histogram
+ *    reset    - true to clear the histogram once it is read
+ * Returns:
+ *    - true if the priority is valid, false otherwise
+ * Notes:
+ *    - All times are in microseconds.  "buckets[0]" counts latencies of
+ *      0 and "buckets[i]" latencies from 2^(i-1) to 2^i - 1, except the
+ *      last bucket, which also counts everything longer.
+ *    - A latency is measured from the interrupt handing the object to the
+ *      task to the task being switched in (or resuming, if it was idling).
+ ****************************************************************************/
+bool taskGetLatency(signed char priority, TaskLatency* latency, bool reset);
+
+/****************************************************************************
+ * Function: taskLatencyPercentile
+ *    - Estimates a percentile of a latency histogram.
+ * Arguments:
+ *    latency - histogram from taskGetLatency()
+ *    percent - percentile to estimate (0 - 100)
+ * Returns:
+ *    - the upper bound of the bucket holding the percentile, but no more
+ *      than the maximum latency seen (0 if the histogram is empty)
+ ****************************************************************************/
+unsigned long taskLatencyPercentile(const TaskLatency* latency,
+                                    unsigned int percent);
+#endif
+
 /****************************************************************************
  * Function: taskSetData
  *    - Assign thread local data storage.
@@ -365,6 +785,7 @@ void* taskGetData(int id);
  *    - Preempts the current task.
  * Arguments:
  *    yield - true = preempt if current level priority (or higher) task ready
+ *                   and the time slice of the current task is used up
  *            false = preempt only if higher priority task is ready
  * Notes:
  *    - Use ONLY within interrupt context.
@@ -393,6 +814,43 @@ void _taskTick(unsigned long ticks);
  *    - Can be useful for debugging.
  ****************************************************************************/
 void taskList();
+
+#ifdef SMP
+/****************************************************************************
+ * Function: taskListCPU
+ *    - Dumps per-CPU run queue information via printf().
+ * Notes:
+ *    - Shows the task running on each CPU, the number of tasks ready on
+ *      each CPU's run queue, how many tasks each CPU has stolen from the
+ *      run queues of other CPUs and how many times other CPUs have
+ *      interrupted it to reschedule.
+ ****************************************************************************/
+void taskListCPU();
+#endif
+
+#if TASK_STATS
+/****************************************************************************
+ * Function: taskTop
+ *    - Dumps the CPU usage of each task and the idle time of each CPU via
+ *      printf().
+ * Notes:
+ *    - Locks the kernel for an insanely long time.
+ *    - Percentages are of one CPU over the last window and averaged over
+ *      TASK_STATS_WINDOWS windows.
+ ****************************************************************************/
+void taskTop();
+#endif
+
+#if TASK_LATENCY
+/****************************************************************************
+ * Function: taskListLatency
+ *    - Dumps the interrupt to task latency of each priority via printf().
+ * Notes:
+ *    - Locks the kernel for an insanely long time.
+ *    - Priorities without any latency measured are skipped.
+ ****************************************************************************/
+void taskListLatency();
+#endif
 #endif
 
 /****************************************************************************
@@ -478,6 +936,34 @@ void taskIdle();
 unsigned long taskStackUsage(Task* task);
 #endif
 
+#if TASK_STACK_GUARD
+/****************************************************************************
+ * Function: taskStackGuard
+ *    - Callback to make a stack guard fault on any access, or to make it
+ *      ordinary memory again before it is freed.
+ * Arguments:
+ *    guard  - TASK_STACK_GUARD aligned start of the guard
+ *    enable - true to make the guard fault, false to restore it
+ * Returns:
+ *    - true if successful, false otherwise (the stack is left unguarded
+ *      and is never restored)
+ ****************************************************************************/
+bool taskStackGuard(void* guard, bool enable);
+
+/****************************************************************************
+ * Function: taskStackFault
+ *    - Checks if a faulting data address is in the stack guard of the task
+ *      running on this processor.
+ * Arguments:
+ *    addr - faulting data address
+ * Returns:
+ *    - the task that overflowed its stack, NULL if addr is not in a guard
+ * Notes:
+ *    - Meant for the data abort (or equivalent) handler.
+ ****************************************************************************/
+Task* taskStackFault(void* addr);
+#endif
+
 /****************************************************************************
  * Function: taskScheduleTick
  *    - Callback to schedule a system tick.
@@ -497,6 +983,21 @@ unsigned long taskStackUsage(Task* task);
  ****************************************************************************/
 unsigned long taskScheduleTick(bool adj, unsigned long ticks);
 
+#if TASK_STATS || TASK_LATENCY || KERNEL_TRACE
+/****************************************************************************
+ * Function: taskClock
+ *    - Callback to read a free running clock for CPU time accounting.
+ * Returns:
+ *    - microseconds since the clock was started
+ * Notes:
+ *    - Called with the kernel locked at every task switch (and for every
+ *      trace record), so it should be cheap (a cycle counter or the
+ *      hrtimer clocksource).
+ *    - In SMP, every CPU must read the same clock.
+ ****************************************************************************/
+unsigned long long taskClock();
+#endif
+
 /****************************************************************************
  * Function: kernelLocked
  *    - Callback to determine if the kernel is locked.
@@ -542,6 +1043,135 @@ void kernelUnlock();
 #define cpuWake(id)
 #endif
 
+/****************************************************************************
+ * Macro: cpuPreempt
+ *    - Interrupts a busy CPU so that it calls _taskPreempt(true).
+ * Arguments:
+ *    id - ID of CPU to interrupt
+ * Notes:
+ *    - Only used with TASK_PREEMPTION.
+ *    - Sent only to the CPU that should run a task that was just made
+ *      ready, or whose time slice is over with a task of equal priority
+ *      waiting, so tick interrupts need not be forwarded to other CPUs.
+ ****************************************************************************/
+#ifndef cpuPreempt
+#define cpuPreempt(id)
+#endif
+
+/****************************************************************************
+ * Macro: memoryBarrier
+ *    - Orders memory accesses before the barrier against memory accesses
+ *      after it, as seen by other CPUs.
+ * Notes:
+ *    - Without SMP a compiler barrier is enough (interrupts observe the
+ *      CPU's accesses in program order).
+ ****************************************************************************/
+#ifndef memoryBarrier
+#define memoryBarrier() __asm__ __volatile__("" : : : "memory")
+#endif
+
+/****************************************************************************
+ * KERNEL_TRACE - Records task switches, wake ups, blocking, idling,
+ *                interrupts and timer expiries into a per-CPU ring that
+ *                keeps the last KERNEL_TRACE_RECORDS (a power of 2) records.
+ *                Time stamps come from taskClock().
+ ****************************************************************************/
+#ifndef KERNEL_TRACE
+#define KERNEL_TRACE 0
+#endif
+
+#if KERNEL_TRACE
+#ifndef KERNEL_TRACE_RECORDS
+#define KERNEL_TRACE_RECORDS 256
+#endif
+
+/****************************************************************************
+ * Trace events (meaning of a record's "data" and "arg")
+ ****************************************************************************/
+#define TRACE_SWITCH    0 /* state left in,        name of next task */
+#define TRACE_WAKE      1 /* priority,             name of woken task */
+#define TRACE_BLOCK     2 /* TASK_STATE_*,         name of blocked task */
+#define TRACE_IDLE      3 /* 0,                    name of idling task */
+#define TRACE_RESUME    4 /* 0,                    name of idling task */
+#define TRACE_IRQ_ENTER 5 /* interrupt number,     handler */
+#define TRACE_IRQ_EXIT  6 /* interrupt number,     NULL */
+#define TRACE_TIMER     7 /* 0 timer / 1 hrtimer,  timer function */
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   unsigned long long time;
+   unsigned short event;
+   unsigned short data;
+   const void* arg;
+
+} TraceRecord;
+
+/****************************************************************************
+ * Function: kernelTrace
+ *    - Records an event in the current CPU's trace ring.
+ * Arguments:
+ *    event - TRACE_* event
+ *    data  - event specific value
+ *    arg   - event specific pointer (must stay valid, like task names)
+ * Notes:
+ *    - Call with interrupts disabled (kernel locked or interrupt context).
+ *      Each CPU only writes its own ring, so no lock is taken.
+ *    - The oldest record is overwritten when the ring is full.
+ *    - Compiles to nothing without KERNEL_TRACE, so drivers can call it
+ *      unconditionally.
+ ****************************************************************************/
+void kernelTrace(unsigned short event, unsigned short data, const void* arg);
+
+/****************************************************************************
+ * Function: kernelTraceEnable
+ *    - Starts or stops recording (for example, to freeze the rings right
+ *      after a fault is detected).
+ * Arguments:
+ *    enable - true to record events, false to stop
+ * Returns:
+ *    - true if recording was enabled before the call, false otherwise
+ ****************************************************************************/
+bool kernelTraceEnable(bool enable);
+
+/****************************************************************************
+ * Function: kernelTraceRead
+ *    - Copies the most recent records of a CPU's trace ring.
+ * Arguments:
+ *    cpu     - CPU whose ring to read
+ *    records - receives the records, oldest first
+ *    count   - maximum number of records to copy
+ * Returns:
+ *    - number of records copied
+ * Notes:
+ *    - Does not stop the writers.  Records overwritten while they were
+ *      copied are dropped, so the copy is always consistent.
+ *    - Records are in the target's native layout.  "arg" is a target
+ *      address (resolve handlers and timer functions with the map file).
+ ****************************************************************************/
+unsigned int kernelTraceRead(int cpu, TraceRecord* records,
+                             unsigned int count);
+
+/****************************************************************************
+ * Function: kernelTraceDump
+ *    - Dumps the trace rings via printf() in the JSON Trace Event Format,
+ *      which the Perfetto UI (ui.perfetto.dev) and chrome://tracing load.
+ * Notes:
+ *    - Recording stops while the rings are printed.
+ *    - Each CPU gets a task track and an interrupt track.  Task and idle
+ *      periods are complete ("X") events, interrupts are begin/end ("B" and
+ *      "E") events and wake ups, blocking and timer expiries are instant
+ *      ("i") events.  Timestamps are microseconds from the oldest record.
+ *    - An interrupt that preempts a task only ends when the task resumes,
+ *      because that is when its handler returns.
+ ****************************************************************************/
+void kernelTraceDump();
+#else
+#define kernelTrace(event, data, arg)
+#endif
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -549,6 +1179,23 @@ void kernelUnlock();
 #define TIMERS 1
 #endif
 
+/****************************************************************************
+ * TIMER_WHEEL_LEVELS - 0 keeps timers in a sorted delta list (O(n) add and
+ *                      cancel, smallest footprint).  Otherwise timers are
+ *                      kept in a hierarchical timing wheel with this many
+ *                      levels (O(1) add and cancel).
+ * TIMER_WHEEL_SLOTS  - Slots per wheel level (power of two, 32 max).  The
+ *                      wheel spans TIMER_WHEEL_SLOTS^TIMER_WHEEL_LEVELS
+ *                      ticks; longer timers are cascaded more than once.
+ ****************************************************************************/
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS 0
+#endif
+
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS 32
+#endif
+
 #if TIMERS
 /****************************************************************************
  * Macro: TIMER_CREATE
@@ -562,12 +1209,14 @@ void kernelUnlock();
  ****************************************************************************/
 #define TIMER_CREATE(flags, timeout, task) \
 {                                          \
+   NULL,                                   \
    NULL,                                   \
    flags,                                  \
    {timeout, timeout},                     \
    task,                                   \
    NULL,                                   \
-   NULL                                    \
+   NULL,                                   \
+   {}                                      \
 }
 
 /****************************************************************************
@@ -596,6 +1245,7 @@ void kernelUnlock();
 typedef struct Timer
 {
    struct Timer* next;
+   struct Timer* prev;
 
    volatile unsigned char flags;
    unsigned long timeout[2];
@@ -603,6 +1253,14 @@ typedef struct Timer
    void (*fx)(struct Timer* timer);
    void* arg;
 
+   struct
+   {
+#if TIMER_WHEEL_LEVELS > 0
+      unsigned long expire;
+      unsigned short slot;
+#endif
+   } wheel;
+
 } Timer;
 
 #ifdef kmalloc
@@ -682,7 +1340,137 @@ void timerCancel(Timer* timer);
 #endif
 
 /****************************************************************************
- *
+ * HRTIMERS - High resolution one-shot timers (microseconds) that run off
+ *            their own clock event instead of the system tick.  The board
+ *            must provide hrtimerClock() and hrtimerSchedule() and call
+ *            _hrtimerExpire() from the clock event interrupt.
+ ****************************************************************************/
+#ifndef HRTIMERS
+#define HRTIMERS 0
+#endif
+
+#if HRTIMERS
+/****************************************************************************
+ * Macro: HRTIMER_CREATE
+ *    - Creates a statically allocated high resolution timer.
+ ****************************************************************************/
+#define HRTIMER_CREATE() \
+{                        \
+   NULL,                 \
+   NULL,                 \
+   0,                    \
+   NULL,                 \
+   NULL                  \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define HRTIMER_CREATE_PTR() ((HRTimer[1]) {HRTIMER_CREATE()})
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct HRTimer
+{
+   struct HRTimer* next;
+   struct HRTimer* prev;
+
+   unsigned long long deadline;
+   void (*fx)(struct HRTimer* timer);
+   void* arg;
+
+} HRTimer;
+
+/****************************************************************************
+ * Function: hrtimerClock
+ *    - Callback to read the high resolution clocksource.
+ * Returns:
+ *    - microseconds since the clocksource was started
+ * Notes:
+ *    - Must be monotonic and must not wrap (64-bit).
+ *    - May be called from any context.
+ ****************************************************************************/
+unsigned long long hrtimerClock();
+
+/****************************************************************************
+ * Function: hrtimerSchedule
+ *    - Callback to program the high resolution clock event.
+ * Arguments:
+ *    deadline - hrtimerClock() time of the next interrupt/event
+ *               (-1 == no event)
+ * Notes:
+ *    - If the deadline has already passed, the interrupt/event must happen
+ *      right away.
+ *    - It is possible to schedule an interrupt/event earlier than requested.
+ *    - Called with the kernel's hrtimer lock held.
+ ****************************************************************************/
+void hrtimerSchedule(unsigned long long deadline);
+
+/****************************************************************************
+ * Function: _hrtimerExpire
+ *    - Runs the high resolution timers that have expired.
+ * Notes:
+ *    - Call from the clock event interrupt handler.
+ *    - The timer functions are run in interrupt context.
+ ****************************************************************************/
+void _hrtimerExpire();
+
+/****************************************************************************
+ * Function: _hrtimerAdd
+ *    - Schedules a high resolution timer.
+ * Arguments:
+ *    timer    - timer to use
+ *    deadline - hrtimerClock() time to expire at
+ *    fx       - timer callback (run in interrupt context)
+ *    arg      - user data (stored in timer container)
+ * Notes:
+ *    - A pending timer is moved to the new deadline.
+ *    - A timer function may re-add its own timer (e.g. at
+ *      timer->deadline + period for a drift free periodic timer).
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+void _hrtimerAdd(HRTimer* timer, unsigned long long deadline,
+                 void (*fx)(HRTimer*), void* arg);
+
+/****************************************************************************
+ * Function: hrtimerAdd
+ *    - Schedules a high resolution timer.
+ * Arguments:
+ *    timer    - timer to use
+ *    deadline - hrtimerClock() time to expire at
+ *    fx       - timer callback (run in interrupt context)
+ *    arg      - user data (stored in timer container)
+ * Notes:
+ *    - A pending timer is moved to the new deadline.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void hrtimerAdd(HRTimer* timer, unsigned long long deadline,
+                void (*fx)(HRTimer*), void* arg);
+
+/****************************************************************************
+ * Function: _hrtimerCancel
+ *    - Cancels a high resolution timer.
+ * Arguments:
+ *    timer - timer to cancel
+ * Notes:
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+void _hrtimerCancel(HRTimer* timer);
+
+/****************************************************************************
+ * Function: hrtimerCancel
+ *    - Cancels a high resolution timer.
+ * Arguments:
+ *    timer - timer to cancel
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void hrtimerCancel(HRTimer* timer);
+#endif
+
+/****************************************************************************
+ *
  ****************************************************************************/
 #ifndef QUEUES
 #define QUEUES 1
@@ -730,6 +1518,9 @@ typedef struct
    unsigned int count;
    unsigned int index;
    unsigned char* buffer;
+#ifdef SMP
+   unsigned long lock;
+#endif
 
 } Queue;
 
@@ -832,6 +1623,350 @@ bool _queuePop(Queue* queue, bool head, bool peek, void* dst);
  ****************************************************************************/
 bool queuePop(Queue* queue, bool head, bool peek, void* dst,
               unsigned long ticks);
+
+/****************************************************************************
+ * Function: _queueReserve
+ *    - Reserves the element slot at the tail of a queue so a producer can
+ *      fill it in place.
+ * Arguments:
+ *    queue - queue to modify
+ * Returns:
+ *    - pointer to the slot (elementSize bytes) / NULL if the queue is full
+ * Notes:
+ *    - The slot is not visible to consumers until _queueCommit().
+ *    - Until then the queue must have no other producer and elements must
+ *      not be popped from its tail.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+void* _queueReserve(Queue* queue);
+
+/****************************************************************************
+ * Function: queueReserve
+ *    - Reserves the element slot at the tail of a queue so a producer can
+ *      fill it in place.
+ * Arguments:
+ *    queue - queue to modify
+ *    ticks - number of ticks to wait until queue space becomes available
+ *            (-1 == wait forever)
+ * Returns:
+ *    - pointer to the slot (elementSize bytes) / NULL if the queue is full
+ * Notes:
+ *    - The slot is not visible to consumers until queueCommit().
+ *    - Until then the queue must have no other producer and elements must
+ *      not be popped from its tail.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void* queueReserve(Queue* queue, unsigned long ticks);
+
+/****************************************************************************
+ * Function: _queueCommit
+ *    - Adds the element reserved with _queueReserve() to the tail of a
+ *      queue.
+ * Arguments:
+ *    queue - queue to modify
+ * Returns:
+ *    - true if committed, false if the queue is full (the element is lost)
+ * Notes:
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+bool _queueCommit(Queue* queue);
+
+/****************************************************************************
+ * Function: queueCommit
+ *    - Adds the element reserved with queueReserve() to the tail of a
+ *      queue.
+ * Arguments:
+ *    queue - queue to modify
+ * Returns:
+ *    - true if committed, false if the queue is full (the element is lost)
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+bool queueCommit(Queue* queue);
+
+/****************************************************************************
+ * Function: _queuePeekRef
+ *    - Gets a reference to the element at the head of a queue so a consumer
+ *      can read it in place.
+ * Arguments:
+ *    queue - queue to read
+ * Returns:
+ *    - pointer to the element / NULL if the queue is empty
+ * Notes:
+ *    - The element stays in the queue until _queueRelease().
+ *    - Until then the queue must have no other consumer and elements must
+ *      not be pushed to its head.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+void* _queuePeekRef(Queue* queue);
+
+/****************************************************************************
+ * Function: queuePeekRef
+ *    - Gets a reference to the element at the head of a queue so a consumer
+ *      can read it in place.
+ * Arguments:
+ *    queue - queue to read
+ *    ticks - number of ticks to wait until element becomes available
+ *            (-1 == wait forever)
+ * Returns:
+ *    - pointer to the element / NULL if the queue is empty
+ * Notes:
+ *    - The element stays in the queue until queueRelease().
+ *    - Until then the queue must have no other consumer and elements must
+ *      not be pushed to its head.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void* queuePeekRef(Queue* queue, unsigned long ticks);
+
+/****************************************************************************
+ * Function: _queueRelease
+ *    - Removes the element referenced with _queuePeekRef() from the head of
+ *      a queue.
+ * Arguments:
+ *    queue - queue to modify
+ * Notes:
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+void _queueRelease(Queue* queue);
+
+/****************************************************************************
+ * Function: queueRelease
+ *    - Removes the element referenced with queuePeekRef() from the head of
+ *      a queue.
+ * Arguments:
+ *    queue - queue to modify
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void queueRelease(Queue* queue);
+
+/****************************************************************************
+ * Function: _queuePushN
+ *    - Adds up to n elements to the tail of a queue.
+ * Arguments:
+ *    queue - queue to modify
+ *    src   - pointer to n elements
+ *    n     - number of elements
+ * Returns:
+ *    - number of elements added (fewer than n if the queue fills up)
+ * Notes:
+ *    - Takes the queue lock once and copies into the queue with at most
+ *      two memcpy calls.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+unsigned int _queuePushN(Queue* queue, const void* src, unsigned int n);
+
+/****************************************************************************
+ * Function: queuePushN
+ *    - Adds up to n elements to the tail of a queue.
+ * Arguments:
+ *    queue - queue to modify
+ *    src   - pointer to n elements
+ *    n     - number of elements
+ *    ticks - number of ticks to wait until queue space becomes available
+ *            (-1 == wait forever)
+ * Returns:
+ *    - number of elements added (fewer than n if the queue fills up)
+ * Notes:
+ *    - Only waits if no element can be added.
+ *    - Takes the queue lock once and reschedules at most once.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+unsigned int queuePushN(Queue* queue, const void* src, unsigned int n,
+                        unsigned long ticks);
+
+/****************************************************************************
+ * Function: _queuePopN
+ *    - Removes up to n elements from the head of a queue.
+ * Arguments:
+ *    queue - queue to modify
+ *    dst   - pointer to write up to n elements
+ *    n     - number of elements
+ * Returns:
+ *    - number of elements removed (fewer than n if the queue empties)
+ * Notes:
+ *    - Takes the queue lock once and copies out of the queue with at most
+ *      two memcpy calls.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+unsigned int _queuePopN(Queue* queue, void* dst, unsigned int n);
+
+/****************************************************************************
+ * Function: queuePopN
+ *    - Removes up to n elements from the head of a queue.
+ * Arguments:
+ *    queue - queue to modify
+ *    dst   - pointer to write up to n elements
+ *    n     - number of elements
+ *    ticks - number of ticks to wait until an element becomes available
+ *            (-1 == wait forever)
+ * Returns:
+ *    - number of elements removed (fewer than n if the queue empties)
+ * Notes:
+ *    - Only waits if no element can be removed.
+ *    - Takes the queue lock once and reschedules at most once.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+unsigned int queuePopN(Queue* queue, void* dst, unsigned int n,
+                       unsigned long ticks);
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifndef RINGS
+#define RINGS 1
+#endif
+
+/****************************************************************************
+ * RING_INDEX_TYPE - Type of the ring head/tail indices.  It must be read and
+ *                   written with a single instruction, so 8-bit CPUs set
+ *                   it to unsigned char.  A ring holds at most half the
+ *                   range of this type.
+ ****************************************************************************/
+#ifndef RING_INDEX_TYPE
+#define RING_INDEX_TYPE unsigned int
+#endif
+
+#if RINGS
+/****************************************************************************
+ * Macro: RING_CREATE
+ *    - Creates a statically allocated single producer/single consumer ring.
+ * Arguments:
+ *    name        - name of ring
+ *    elementSize - size of a single element in bytes
+ *    maxElements - maximum number of elements in ring (power of two)
+ * Notes:
+ *    - maxElements of elementSize array is statically allocated.
+ ****************************************************************************/
+#define RING_CREATE(name, elementSize, maxElements) \
+{                                                   \
+   NULL,                                            \
+   name,                                            \
+   elementSize,                                     \
+   maxElements,                                     \
+   0,                                               \
+   0,                                               \
+   (unsigned char[elementSize * maxElements]) {}    \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define RING_CREATE_PTR(name, elementSize, maxElements) \
+   ((Ring[1]) {RING_CREATE(name, elementSize, maxElements)})
+
+/****************************************************************************
+ * A ring has exactly one producer and one consumer.  The producer only
+ * writes head and the consumer only writes tail, so neither side takes a
+ * lock to move data.  The lock (SMP) only covers the blocked consumer.
+ ****************************************************************************/
+typedef struct
+{
+   TaskPoll* volatile poll;
+   const char* name;
+   unsigned int size;
+   unsigned int max;
+   volatile RING_INDEX_TYPE head;
+   volatile RING_INDEX_TYPE tail;
+   unsigned char* buffer;
+#ifdef SMP
+   unsigned long lock;
+#endif
+
+} Ring;
+
+#ifdef kmalloc
+/****************************************************************************
+ * Function: ringCreate
+ *    - Dynamically allocates a new ring.
+ * Arguments:
+ *    name        - name of ring
+ *    elementSize - size of a single element in bytes
+ *    maxElements - maximum number of elements in ring (power of two)
+ * Returns:
+ *    - pointer to initialized ring structure
+ * Notes:
+ *    - Must be destroyed with ringDestroy().
+ *    - Should not be called from interrupt context because of kmalloc usage.
+ ****************************************************************************/
+Ring* ringCreate(const char* name, unsigned int elementSize,
+                 unsigned int maxElements);
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ * Function: ringDestroy
+ *    - Destroys/frees a previously dynamically allocated ring.
+ * Arguments:
+ *    ring - ring previously allocated with ringCreate()
+ * Notes:
+ *    - Must not be called on an active ring.
+ *    - Should not be called from interrupt context because of kfree usage.
+ ****************************************************************************/
+void ringDestroy(Ring* ring);
+#endif
+
+/****************************************************************************
+ * Function: _ringPush
+ *    - Adds an element to the tail of a ring.
+ * Arguments:
+ *    ring - ring to modify
+ *    src  - pointer to data
+ * Returns:
+ *    - true if successful (if space in ring) / false otherwise
+ * Notes:
+ *    - elementSize bytes of data at src is memory copied into the ring.
+ *    - Only takes a lock if the consumer is blocked on the ring.
+ *    - Use ONLY within interrupt context (producer side).
+ ****************************************************************************/
+bool _ringPush(Ring* ring, const void* src);
+
+/****************************************************************************
+ * Function: ringPush
+ *    - Adds an element to the tail of a ring.
+ * Arguments:
+ *    ring - ring to modify
+ *    src  - pointer to data
+ * Returns:
+ *    - true if successful (if space in ring) / false otherwise
+ * Notes:
+ *    - elementSize bytes of data at src is memory copied into the ring.
+ *    - Never blocks.
+ *    - Do NOT use within interrupt context (producer side).
+ ****************************************************************************/
+bool ringPush(Ring* ring, const void* src);
+
+/****************************************************************************
+ * Function: _ringPop
+ *    - Removes an element from the head of a ring.
+ * Arguments:
+ *    ring - ring to modify
+ *    dst  - pointer to write data
+ * Returns:
+ *    - true if successful / false otherwise
+ * Notes:
+ *    - elementSize bytes of data copied from the ring to dst.
+ *    - Use ONLY within interrupt context (consumer side).
+ ****************************************************************************/
+bool _ringPop(Ring* ring, void* dst);
+
+/****************************************************************************
+ * Function: ringPop
+ *    - Removes an element from the head of a ring.
+ * Arguments:
+ *    ring  - ring to modify
+ *    dst   - pointer to write data
+ *    ticks - number of ticks to wait until element becomes available
+ *            (-1 == wait forever)
+ * Returns:
+ *    - true if successful / false otherwise
+ * Notes:
+ *    - elementSize bytes of data copied from the ring to dst.
+ *    - Only takes a lock if the ring is empty and ticks > 0.
+ *    - Do NOT use within interrupt context (consumer side).
+ ****************************************************************************/
+bool ringPop(Ring* ring, void* dst, unsigned long ticks);
 #endif
 
 /****************************************************************************
@@ -873,6 +2008,9 @@ typedef struct
    const char* name;
    unsigned int count;
    unsigned int max;
+#ifdef SMP
+   unsigned long lock;
+#endif
 
 } Semaphore;
 
@@ -1001,6 +2139,9 @@ typedef struct
    unsigned int count;
    signed char priority;
    Task* owner;
+#ifdef SMP
+   unsigned long lock;
+#endif
 
 } Mutex;
 
@@ -1059,4 +2200,448 @@ bool mutexLock(Mutex* mutex, unsigned long ticks);
 void mutexUnlock(Mutex* mutex);
 #endif
 
+#if QUEUES || SEMAPHORES || MUTEXES
+/****************************************************************************
+ * KERNEL_WAIT_SEMAPHORE  - Take a semaphore.
+ * KERNEL_WAIT_MUTEX      - Lock a mutex.
+ * KERNEL_WAIT_QUEUE_POP  - Pop the head of a queue into "data" (queue is
+ *                          readable).
+ * KERNEL_WAIT_QUEUE_PUSH - Push "data" to the tail of a queue (queue is
+ *                          writable).
+ ****************************************************************************/
+#define KERNEL_WAIT_SEMAPHORE  0
+#define KERNEL_WAIT_MUTEX      1
+#define KERNEL_WAIT_QUEUE_POP  2
+#define KERNEL_WAIT_QUEUE_PUSH 3
+
+/****************************************************************************
+ * Macro: KERNEL_WAIT
+ *    - Initializes one entry of a kernelWait() array.
+ * Arguments:
+ *    type   - KERNEL_WAIT_xxx
+ *    object - queue, semaphore or mutex to wait on
+ *    data   - element to push/pop for queues (NULL for semaphores/mutexes)
+ ****************************************************************************/
+#define KERNEL_WAIT(type, object, data) \
+{                                       \
+   NULL,                                \
+   NULL,                                \
+   NULL,                                \
+   object,                              \
+   false,                               \
+   false,                               \
+   data,                                \
+   type                                 \
+}
+
+/****************************************************************************
+ * Function: kernelWait
+ *    - Waits until one of several queues, semaphores or mutexes is ready.
+ * Arguments:
+ *    poll  - array of TaskPoll structures initialized with KERNEL_WAIT()
+ *    size  - size of poll array
+ *    ticks - number of ticks to wait until an object becomes ready
+ *            (-1 == wait forever)
+ * Returns:
+ *    - index of the ready object / -1 if timeout
+ * Notes:
+ *    - The ready object is consumed just like semaphoreTake(), mutexLock(),
+ *      queuePop(head) or queuePush(tail) would.  A queue entry with "data"
+ *      NULL only reports that the queue is readable/writable and leaves the
+ *      queue alone.
+ *    - Exactly one object is consumed.  If multiple objects are ready, the
+ *      lowest index object is used and that index returned.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+int kernelWait(TaskPoll* poll, int size, unsigned long ticks);
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifndef EVENT_GROUPS
+#define EVENT_GROUPS 1
+#endif
+
+#if EVENT_GROUPS
+/****************************************************************************
+ * Macro: EVENT_GROUP_CREATE
+ *    - Creates a statically allocated event group.
+ * Arguments:
+ *    name  - name of event group
+ *    flags - initial event flags
+ ****************************************************************************/
+#define EVENT_GROUP_CREATE(name, flags) \
+{                                       \
+   NULL,                                \
+   name,                                \
+   flags                                \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define EVENT_GROUP_CREATE_PTR(name, flags) \
+   ((EventGroup[1]) {EVENT_GROUP_CREATE(name, flags)})
+
+/****************************************************************************
+ * EVENT_GROUP_WAIT_ANY   - Wait for any of the flags to be set.
+ * EVENT_GROUP_WAIT_ALL   - Wait for all of the flags to be set.
+ * EVENT_GROUP_WAIT_CLEAR - Clear the flags waited for when the wait is
+ *                          satisfied.
+ ****************************************************************************/
+#define EVENT_GROUP_WAIT_ANY   0x00
+#define EVENT_GROUP_WAIT_ALL   0x01
+#define EVENT_GROUP_WAIT_CLEAR 0x02
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   TaskPoll* poll;
+   const char* name;
+   unsigned long flags;
+#ifdef SMP
+   unsigned long lock;
+#endif
+
+} EventGroup;
+
+#ifdef kmalloc
+/****************************************************************************
+ * Function: eventGroupCreate
+ *    - Dynamically allocates a new event group.
+ * Arguments:
+ *    name  - name of event group
+ *    flags - initial event flags
+ * Returns:
+ *    - pointer to initialized event group
+ * Notes:
+ *    - Must be destroyed with eventGroupDestroy().
+ *    - Should not be called from interrupt context because of kmalloc usage.
+ ****************************************************************************/
+EventGroup* eventGroupCreate(const char* name, unsigned long flags);
+#endif
+
+#ifdef kfree
+/****************************************************************************
+ * Function: eventGroupDestroy
+ *    - Destroys/frees a previously dynamically allocated event group.
+ * Arguments:
+ *    group - event group previously allocated with eventGroupCreate()
+ * Notes:
+ *    - Must not be called on an active event group.
+ *    - Should not be called from interrupt context because of kfree usage.
+ ****************************************************************************/
+void eventGroupDestroy(EventGroup* group);
+#endif
+
+/****************************************************************************
+ * Function: _eventGroupSet
+ *    - Sets event flags and wakes every task whose wait is now satisfied.
+ * Arguments:
+ *    group - event group to modify
+ *    flags - flags to set
+ * Returns:
+ *    - event flags after the woken tasks' flags were cleared
+ * Notes:
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+unsigned long _eventGroupSet(EventGroup* group, unsigned long flags);
+
+/****************************************************************************
+ * Function: eventGroupSet
+ *    - Sets event flags and wakes every task whose wait is now satisfied.
+ * Arguments:
+ *    group - event group to modify
+ *    flags - flags to set
+ * Returns:
+ *    - event flags after the woken tasks' flags were cleared
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+unsigned long eventGroupSet(EventGroup* group, unsigned long flags);
+
+/****************************************************************************
+ * Function: _eventGroupClear
+ *    - Clears event flags.
+ * Arguments:
+ *    group - event group to modify
+ *    flags - flags to clear
+ * Returns:
+ *    - event flags before they were cleared
+ * Notes:
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+unsigned long _eventGroupClear(EventGroup* group, unsigned long flags);
+
+/****************************************************************************
+ * Function: eventGroupClear
+ *    - Clears event flags.
+ * Arguments:
+ *    group - event group to modify
+ *    flags - flags to clear
+ * Returns:
+ *    - event flags before they were cleared
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+unsigned long eventGroupClear(EventGroup* group, unsigned long flags);
+
+/****************************************************************************
+ * Function: eventGroupWait
+ *    - Waits for any or all of a set of event flags.
+ * Arguments:
+ *    group - event group to wait on
+ *    flags - flags to wait for (non-zero)
+ *    mode  - EVENT_GROUP_WAIT_ANY or EVENT_GROUP_WAIT_ALL, optionally or'ed
+ *            with EVENT_GROUP_WAIT_CLEAR
+ *    ticks - number of ticks to wait until the flags are set
+ *            (-1 == wait forever)
+ * Returns:
+ *    - event flags that satisfied the wait (before they were cleared)
+ *    - 0 if the wait timed out
+ * Notes:
+ *    - A waiting task sits on one wait list no matter how many flags it
+ *      waits for.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+unsigned long eventGroupWait(EventGroup* group, unsigned long flags,
+                             unsigned char mode, unsigned long ticks);
+#endif
+
+/****************************************************************************
+ * WORK_QUEUES - Deferred work (bottom halves).  Each work queue has a worker
+ *               task on every CPU, and work submitted to it runs (in
+ *               submission order) on the worker of the submitting CPU.
+ *               Requires SEMAPHORES.
+ ****************************************************************************/
+#ifndef WORK_QUEUES
+#define WORK_QUEUES 0
+#endif
+
+#if WORK_QUEUES
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifdef SMP
+#define WORK_QUEUE_CPUS SMP
+#else
+#define WORK_QUEUE_CPUS 1
+#endif
+
+/****************************************************************************
+ * Macro: WORK_CREATE
+ *    - Creates a statically allocated work item.
+ * Arguments:
+ *    fx  - work function (runs in task context on a worker task)
+ *    arg - user data (stored in work item)
+ ****************************************************************************/
+#define WORK_CREATE(fx, arg) \
+{                            \
+   NULL,                     \
+   NULL,                     \
+   fx,                       \
+   arg,                      \
+   NULL,                     \
+   0,                        \
+   0                         \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define WORK_CREATE_PTR(fx, arg) ((Work[1]) {WORK_CREATE(fx, arg)})
+
+/****************************************************************************
+ * Macro: WORK_QUEUE_CREATE
+ *    - Creates a statically allocated work queue.
+ * Arguments:
+ *    name      - name of the work queue and its workers
+ *    priority  - priority of the workers
+ *    stackSize - stack size in bytes of each worker
+ * Notes:
+ *    - Must be started with workQueueStart().
+ ****************************************************************************/
+#define WORK_QUEUE_CREATE(name, priority, stackSize)  \
+{                                                     \
+   name,                                              \
+   priority,                                          \
+   stackSize,                                         \
+   (Task[WORK_QUEUE_CPUS]) {},                        \
+   (unsigned char[(stackSize) * WORK_QUEUE_CPUS]) {}, \
+   {}                                                 \
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define WORK_QUEUE_CREATE_PTR(name, priority, stackSize) \
+   ((WorkQueue[1]) {WORK_QUEUE_CREATE(name, priority, stackSize)})
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct Work
+{
+   struct Work* next;
+   struct Work* prev;
+
+   void (*fx)(struct Work* work);
+   void* arg;
+   struct WorkQueue* queue;
+   unsigned char flags;
+   unsigned char cpu;
+
+#if TIMERS
+   Timer timer;
+#endif
+
+} Work;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct WorkQueue
+{
+   const char* name;
+   signed char priority;
+   unsigned long stackSize;
+   Task* tasks;
+   unsigned char* stacks;
+
+   struct
+   {
+      Work* head;
+      Work* tail;
+      Semaphore semaphore;
+
+   } cpu[WORK_QUEUE_CPUS];
+
+#ifdef SMP
+   unsigned long lock;
+#endif
+
+} WorkQueue;
+
+#ifdef kmalloc
+/****************************************************************************
+ * Function: workQueueCreate
+ *    - Dynamically allocates and starts a new work queue.
+ * Arguments:
+ *    name      - name of the work queue and its workers
+ *    priority  - priority of the workers
+ *    stackSize - stack size in bytes of each worker
+ * Returns:
+ *    - pointer to started work queue
+ * Notes:
+ *    - Work queues cannot be destroyed.
+ *    - Should not be called from interrupt context because of kmalloc usage.
+ ****************************************************************************/
+WorkQueue* workQueueCreate(const char* name, signed char priority,
+                           unsigned long stackSize);
+#endif
+
+/****************************************************************************
+ * Function: workQueueStart
+ *    - Starts the workers of a statically allocated work queue.
+ * Arguments:
+ *    queue - work queue created with WORK_QUEUE_CREATE()
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+void workQueueStart(WorkQueue* queue);
+
+/****************************************************************************
+ * Function: _workSubmit
+ *    - Submits work to run on this CPU's worker.
+ * Arguments:
+ *    queue - work queue to use
+ *    work  - work item to run
+ * Returns:
+ *    - true if submitted, false if the work item is already pending
+ * Notes:
+ *    - A work item is pending from submission until its function is
+ *      called, so it may resubmit itself.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+bool _workSubmit(WorkQueue* queue, Work* work);
+
+/****************************************************************************
+ * Function: workSubmit
+ *    - Submits work to run on this CPU's worker.
+ * Arguments:
+ *    queue - work queue to use
+ *    work  - work item to run
+ * Returns:
+ *    - true if submitted, false if the work item is already pending
+ * Notes:
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+bool workSubmit(WorkQueue* queue, Work* work);
+
+#if TIMERS
+/****************************************************************************
+ * Function: _workSubmitDelayed
+ *    - Submits work after a delay, using the timer in the work item.
+ * Arguments:
+ *    queue - work queue to use
+ *    work  - work item to run
+ *    ticks - number of system ticks to wait before submitting
+ * Returns:
+ *    - true if submitted, false if the work item is already pending
+ * Notes:
+ *    - The work runs on the worker of the CPU the timer expires on.
+ *    - Fails while the timer of a cancelled submission has expired but its
+ *      callback has not run yet.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+bool _workSubmitDelayed(WorkQueue* queue, Work* work, unsigned long ticks);
+
+/****************************************************************************
+ * Function: workSubmitDelayed
+ *    - Submits work after a delay, using the timer in the work item.
+ * Arguments:
+ *    queue - work queue to use
+ *    work  - work item to run
+ *    ticks - number of system ticks to wait before submitting
+ * Returns:
+ *    - true if submitted, false if the work item is already pending
+ * Notes:
+ *    - The work runs on the worker of the CPU the timer expires on.
+ *    - Fails while the timer of a cancelled submission has expired but its
+ *      callback has not run yet.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+bool workSubmitDelayed(WorkQueue* queue, Work* work, unsigned long ticks);
+#endif
+
+/****************************************************************************
+ * Function: _workCancel
+ *    - Cancels pending work.
+ * Arguments:
+ *    work - work item to cancel
+ * Returns:
+ *    - true if the work was pending, false otherwise
+ * Notes:
+ *    - Does not wait for a work function that is already running.
+ *    - Use ONLY within interrupt context.
+ ****************************************************************************/
+bool _workCancel(Work* work);
+
+/****************************************************************************
+ * Function: workCancel
+ *    - Cancels pending work.
+ * Arguments:
+ *    work - work item to cancel
+ * Returns:
+ *    - true if the work was pending, false otherwise
+ * Notes:
+ *    - Does not wait for a work function that is already running.
+ *    - Do NOT use within interrupt context.
+ ****************************************************************************/
+bool workCancel(Work* work);
+#endif
+
 #endif
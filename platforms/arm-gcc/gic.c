@@ -27,6 +27,7 @@
  ****************************************************************************/
 #include <stdio.h>
 #include "gic.h"
+#include "kernel.h"
 
 /****************************************************************************
  *
@@ -115,10 +116,14 @@ void gicIRQ(unsigned int _n, void* _gic)
    if (n >= 1020)
       return;
 
+   kernelTrace(TRACE_IRQ_ENTER, n, gic->vector[n]);
+
    if (gic->vector[n] != NULL)
       gic->vector[n](n, gic->arg[n]);
    else
       puts("unhandled irq");
+
+   kernelTrace(TRACE_IRQ_EXIT, n, NULL);
 }
 
 #ifdef SMP
@@ -26,6 +26,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  ****************************************************************************/
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include "kernel.h"
 #include "platform.h"
@@ -43,6 +44,9 @@ static struct
 #ifdef SMP
    unsigned long spin;
    bool iFlag[SMP];
+#if SMP_LOCK_STATS
+   SMPLockStats stats[SMP];
+#endif
 #else
    bool iFlag;
 #endif
@@ -58,15 +62,69 @@ void __taskSwitch(void** current, void* next);
 /****************************************************************************
  *
  ****************************************************************************/
-int testAndSet(unsigned long* ptr, unsigned long a, unsigned long b);
+unsigned long fetchAndAdd(unsigned long* ptr, unsigned long value);
+
+/****************************************************************************
+ * Ticket lock: the upper half of the lock word hands out tickets and the
+ * lower half is the ticket being served, so CPUs get the lock in the order
+ * they asked for it.  Waiters sleep in WFE until the owner signals them with
+ * SEV on unlock.
+ ****************************************************************************/
+void _spinLock(unsigned long* spin)
+{
+   volatile unsigned short* owner = (volatile unsigned short*) spin;
+   unsigned short ticket = fetchAndAdd(spin, 0x10000) >> 16;
+#if SMP_LOCK_STATS
+   unsigned long spins = 0;
+   unsigned long cycles = 0;
+
+   if (*owner != ticket)
+      cycles = _cycleCount();
+#endif
+
+   while (*owner != ticket)
+   {
+      __asm__ __volatile__("wfe");
+#if SMP_LOCK_STATS
+      spins++;
+#endif
+   }
+
+   __asm__ __volatile__("dmb" : : : "memory");
+
+#if SMP_LOCK_STATS
+   SMPLockStats* stats = &lock.stats[cpuID()];
+
+   stats->acquisitions++;
+
+   if (spins > 0)
+   {
+      cycles = _cycleCount() - cycles;
+      stats->spins += spins;
+
+      if (cycles > stats->maxWait)
+         stats->maxWait = cycles;
+   }
+#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _spinUnlock(unsigned long* spin)
+{
+   __asm__ __volatile__("dmb" : : : "memory");
+   (*(volatile unsigned short*) spin)++;
+   __asm__ __volatile__("dsb\n"
+                        "sev" : : : "memory");
+}
 
 /****************************************************************************
  *
  ****************************************************************************/
 void _smpLock()
 {
-   while (!testAndSet(&lock.spin, 0, 1));
-   __asm__ __volatile__("" : : : "memory");
+   _spinLock(&lock.spin);
 }
 
 /****************************************************************************
@@ -74,9 +132,25 @@ void _smpLock()
  ****************************************************************************/
 void _smpUnlock()
 {
-   lock.spin = 0;
-   __asm__ __volatile__("" : : : "memory");
+   _spinUnlock(&lock.spin);
 }
+
+#if SMP_LOCK_STATS
+/****************************************************************************
+ *
+ ****************************************************************************/
+void smpLockStats(int cpu, SMPLockStats* stats, bool reset)
+{
+   kernelLock();
+
+   *stats = lock.stats[cpu];
+
+   if (reset)
+      memset(&lock.stats[cpu], 0, sizeof(SMPLockStats));
+
+   kernelUnlock();
+}
+#endif
 #endif
 
 /****************************************************************************
@@ -162,7 +236,14 @@ unsigned long taskStackUsage(Task* task)
  ****************************************************************************/
 void _taskEntry(Task* task)
 {
+#ifdef SMP
+   /* the task that switched to us may have locked through kernelEnter(),
+      which does not save the interrupt state in lock.iFlag */
+   _smpUnlock();
+   enableInterrupts();
+#else
    kernelUnlock();
+#endif
 }
 
 /****************************************************************************
@@ -191,6 +272,12 @@ void _taskInit(Task* task, void* stackBase, unsigned long stackSize)
    task->stack.base = stackBase;
    task->stack.size = stackSize;
 
+#if defined(SMP) && SMP_LOCK_STATS
+   /* each CPU runs this once, start its PMU cycle counter */
+   __asm__ __volatile__("mcr p15, 0, %0, c9, c12, 0" : : "r" (1));
+   __asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" : : "r" (0x80000000));
+#endif
+
    stack = task->stack.base;
 
    /* cannot use memset here */
@@ -227,6 +314,20 @@ void WEAK __attribute__((interrupt("ABORT"))) _prefetchAbort()
  ****************************************************************************/
 void WEAK __attribute__((interrupt("ABORT"))) _dataAbort()
 {
+#if TASK_STACK_GUARD
+   void* addr;
+   Task* task;
+
+   __asm__ __volatile__("mrc p15, 0, %0, c6, c0, 0" : "=r" (addr));
+   task = taskStackFault(addr);
+
+   /* keep it light, this runs on the small abort mode stack */
+   if (task != NULL)
+   {
+      fputs("stack overflow: ", stdout);
+      puts(task->name);
+   }
+#endif
    for (;;);
 }
 
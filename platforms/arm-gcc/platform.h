@@ -102,6 +102,14 @@
 #define FIQ_STACK_SIZE 1024
 #endif
 
+/****************************************************************************
+ * SMP_LOCK_STATS - Count acquisitions, WFE spins and the longest wait (in
+ *                  PMU cycles) of the spin locks on each CPU.
+ ****************************************************************************/
+#ifndef SMP_LOCK_STATS
+#define SMP_LOCK_STATS 0
+#endif
+
 #ifndef __ASM__
 /****************************************************************************
  *
@@ -210,6 +218,18 @@ static inline unsigned long bSwap32(unsigned long value)
    return value;
 }
 
+/****************************************************************************
+ *
+ ****************************************************************************/
+static inline unsigned char _countLeadingZeros(unsigned long value)
+{
+   unsigned long n;
+   __asm__("clz %0, %1" : "=r" (n) : "r" (value));
+   return (unsigned char) n;
+}
+
+#define countLeadingZeros(x) _countLeadingZeros(x)
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -225,6 +245,14 @@ static inline int _cpuID()
 }
 
 #ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+static inline void _memoryBarrier()
+{
+   __asm__ __volatile__("dmb" : : : "memory");
+}
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -234,6 +262,66 @@ void _smpLock();
  *
  ****************************************************************************/
 void _smpUnlock();
+
+/****************************************************************************
+ * Function: _spinLock
+ *    - Acquires a ticket spin lock (the lock word must start out zero).
+ *      Interrupts must be disabled by the caller.
+ * Arguments:
+ *    spin - lock word
+ ****************************************************************************/
+void _spinLock(unsigned long* spin);
+
+/****************************************************************************
+ * Function: _spinTryLock
+ *    - Acquires a ticket spin lock if it is free.
+ * Arguments:
+ *    spin - lock word
+ * Returns:
+ *    true if the lock was acquired
+ ****************************************************************************/
+bool _spinTryLock(unsigned long* spin);
+
+/****************************************************************************
+ * Function: _spinUnlock
+ *    - Releases a ticket spin lock.
+ * Arguments:
+ *    spin - lock word
+ ****************************************************************************/
+void _spinUnlock(unsigned long* spin);
+
+#if SMP_LOCK_STATS
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   unsigned long acquisitions;
+   unsigned long spins;
+   unsigned long maxWait;
+
+} SMPLockStats;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static inline unsigned long _cycleCount()
+{
+   unsigned long count;
+   __asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r" (count));
+   return count;
+}
+
+/****************************************************************************
+ * Function: smpLockStats
+ *    - Reads the spin lock contention counters of a CPU.
+ * Arguments:
+ *    cpu   - CPU to read
+ *    stats - where to copy the counters
+ *    reset - clear the counters after reading them
+ ****************************************************************************/
+void smpLockStats(int cpu, SMPLockStats* stats, bool reset);
+#endif
 #endif
 #endif
 
@@ -26,6 +26,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  ****************************************************************************/
 #include <stdio.h>
+#include "kernel.h"
 #include "vic.h"
 
 /****************************************************************************
@@ -106,10 +107,14 @@ void vicIRQ(unsigned int n, void* _vic)
    {
       if (status & 1)
       {
+         kernelTrace(TRACE_IRQ_ENTER, i, vic->vector[i]);
+
          if (vic->vector[i] != NULL)
             vic->vector[i](i, vic->arg[i]);
          else
             puts("unhandled irq");
+
+         kernelTrace(TRACE_IRQ_EXIT, i, NULL);
       }
 
       status >>= 1;
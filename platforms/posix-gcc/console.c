@@ -0,0 +1,176 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "console.h"
+#include "platform.h"
+
+/****************************************************************************
+ * pushed to the rx queue at the end of input, ^D from a terminal too
+ ****************************************************************************/
+#define EOT 0x04
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static struct termios termios;
+static int flags = -1;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static bool tx(CharDev* dev, int c)
+{
+   unsigned char c8 = (unsigned char) c;
+   return write(STDOUT_FILENO, &c8, 1) == 1;
+}
+
+/****************************************************************************
+ * SIGIO is only raised when new input arrives, so before sleeping on an
+ * empty queue the reader raises it on CPU 0 itself to have the handler read
+ * whatever the queue had no room for (or a file, which never raises it).
+ ****************************************************************************/
+static int rx(CharDev* dev, bool blocking)
+{
+   Console* console = (Console*) dev;
+   unsigned char c8;
+   int c = EOF;
+
+   if (kernelLocked())
+   {
+      if (_queuePop(console->queue.rx, true, false, &c8))
+         c = c8;
+   }
+   else if (queuePop(console->queue.rx, true, false, &c8, 0))
+   {
+      c = c8;
+   }
+   else if (blocking)
+   {
+      cpuSignal(0, SIGIO);
+
+      if (queuePop(console->queue.rx, true, false, &c8,
+                   console->dev.timeout.rx))
+      {
+         c = c8;
+      }
+   }
+
+   return (c == EOT) ? EOF : c;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void restore()
+{
+   if (flags != -1)
+      fcntl(STDIN_FILENO, F_SETFL, flags);
+
+   if (isatty(STDIN_FILENO))
+      tcsetattr(STDIN_FILENO, TCSANOW, &termios);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void terminate(int sig)
+{
+   restore();
+   signal(sig, SIG_DFL);
+   raise(sig);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void consoleIRQ(int sig, void* _console)
+{
+   Console* console = (Console*) _console;
+   Queue* queue = console->queue.rx;
+   struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+
+   while (queue->count < queue->max)
+   {
+      unsigned char c;
+
+      if ((poll(&fd, 1, 0) != 1) || (fd.revents == 0))
+         break;
+
+      if (read(STDIN_FILENO, &c, 1) != 1)
+      {
+         c = EOT;
+         _queuePush(queue, true, &c);
+         break;
+      }
+
+      _queuePush(queue, true, &c);
+   }
+
+   _taskPreempt(false);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void consoleInit(Console* console)
+{
+   struct f_owner_ex owner = {F_OWNER_TID, cpuThread(0)};
+
+   console->dev.ioctl = NULL;
+   console->dev.tx = tx;
+   console->dev.rx = rx;
+   console->dev.timeout.tx = -1;
+   console->dev.timeout.rx = -1;
+
+   if (isatty(STDIN_FILENO))
+   {
+      struct termios raw;
+
+      tcgetattr(STDIN_FILENO, &termios);
+      raw = termios;
+      raw.c_lflag &= ~(ICANON | ECHO);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+   }
+
+   /* deliver SIGIO to CPU 0 for new input */
+   flags = fcntl(STDIN_FILENO, F_GETFL);
+   fcntl(STDIN_FILENO, F_SETOWN_EX, &owner);
+   fcntl(STDIN_FILENO, F_SETFL, flags | O_ASYNC);
+
+   atexit(restore);
+   signal(SIGINT, terminate);
+   signal(SIGTERM, terminate);
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "char_dev.h"
+#include "kernel.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define CONSOLE_CREATE(rxQueue) {{}, {rxQueue}}
+
+/****************************************************************************
+ * A CharDev on stdin/stdout.  Input is read by consoleIRQ() (the SIGIO
+ * handler) into the rx queue, end of input reads as EOF.  A terminal is
+ * switched to raw mode (readline does the echo) until the process exits.
+ ****************************************************************************/
+typedef struct
+{
+   CharDev dev;
+
+   struct
+   {
+      Queue* rx;
+
+   } queue;
+
+} Console;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void consoleIRQ(int sig, void* console);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void consoleInit(Console* console);
+
+#endif
@@ -0,0 +1,195 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include "kernel.h"
+#include "libc_glue.h"
+#include "platform.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static CharDev* _dev = NULL;
+static unsigned long randState = 1;
+
+/****************************************************************************
+ * glibc's allocator takes a lock that is not recursive, so a task
+ * preempted while holding it would hang the next task of that CPU that
+ * allocates.  Keep interrupts (and so preemption) off while it runs, which
+ * is what __malloc_lock() does for the newlib ports.
+ ****************************************************************************/
+void* WEAK malloc(size_t size)
+{
+   bool iFlag = disableInterrupts();
+   void* ptr = __libc_malloc(size);
+
+   if (iFlag)
+      enableInterrupts();
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* WEAK calloc(size_t n, size_t size)
+{
+   bool iFlag = disableInterrupts();
+   void* ptr = __libc_calloc(n, size);
+
+   if (iFlag)
+      enableInterrupts();
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void* WEAK realloc(void* ptr, size_t size)
+{
+   bool iFlag = disableInterrupts();
+
+   ptr = __libc_realloc(ptr, size);
+
+   if (iFlag)
+      enableInterrupts();
+
+   return ptr;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void WEAK free(void* ptr)
+{
+   bool iFlag = disableInterrupts();
+
+   __libc_free(ptr);
+
+   if (iFlag)
+      enableInterrupts();
+}
+
+/****************************************************************************
+ * The tests call rand() from interrupt handlers, which is fine with newlib
+ * but glibc's rand() takes a lock.
+ ****************************************************************************/
+int WEAK rand()
+{
+   randState = randState * 1103515245 + 12345;
+   return (int) ((randState >> 16) & 0x7FFF);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void WEAK srand(unsigned int seed)
+{
+   randState = seed;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static ssize_t consoleWrite(void* cookie, const char* buffer, size_t count)
+{
+   CharDev* dev = taskGetData(TASK_CONSOLE_ID);
+   size_t i;
+
+   if (dev == NULL)
+      dev = _dev;
+
+   for (i = 0; i < count; i++)
+      dev->tx(dev, (unsigned char) buffer[i]);
+
+   return (ssize_t) count;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static ssize_t consoleRead(void* cookie, char* buffer, size_t count)
+{
+   CharDev* dev = taskGetData(TASK_CONSOLE_ID);
+   size_t i;
+
+   if (dev == NULL)
+      dev = _dev;
+
+   for (i = 0; i < count; i++)
+   {
+      int c = dev->rx(dev, i ? false : true);
+
+      if (c == EOF)
+         break;
+
+      if (c == '\r')
+         c = '\n';
+
+      buffer[i] = (char) c;
+   }
+
+   return (ssize_t) i;
+}
+
+/****************************************************************************
+ * stdin and stdout are replaced by streams on the console device, so that
+ * a task reading the console blocks in the kernel instead of blocking the
+ * whole CPU thread in read().  Tasks switch in the middle of stdio calls,
+ * which would confuse the FILE locks (they are owned by threads, not
+ * tasks), so the console streams do not lock and stdout is unbuffered.
+ ****************************************************************************/
+void WEAK libcInit(CharDev* __dev)
+{
+   static const cookie_io_functions_t io =
+   {
+      consoleRead, consoleWrite, NULL, NULL
+   };
+
+   _dev = __dev;
+
+   fflush(stdout);
+
+   stdin = fopencookie(NULL, "r", io);
+   stdout = fopencookie(NULL, "w", io);
+   setvbuf(stdout, NULL, _IONBF, 0);
+
+   __fsetlocking(stdin, FSETLOCKING_BYCALLER);
+   __fsetlocking(stdout, FSETLOCKING_BYCALLER);
+}
@@ -0,0 +1,517 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "kernel.h"
+#include "platform.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define STACK_MARKER '-'
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#ifdef SMP
+#define NUM_CPUS SMP
+#else
+#define NUM_CPUS 1
+#endif
+
+/****************************************************************************
+ * the SIGSEGV handler cannot run on the stack that overflowed
+ ****************************************************************************/
+#define FAULT_STACK_SIZE 65536
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static struct
+{
+#ifdef SMP
+   unsigned long spin;
+   bool iFlag[SMP];
+#else
+   bool iFlag;
+#endif
+
+} lock;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static struct
+{
+   sigset_t mask;
+   void (*fx[NSIG])(int, void*);
+   void* arg[NSIG];
+   volatile bool pending[NUM_CPUS];
+
+} irq;
+
+/****************************************************************************
+ * the first task of each CPU runs on its thread's own stack, this is where
+ * its context is saved while another task runs
+ ****************************************************************************/
+static struct
+{
+   ucontext_t context;
+   pthread_t thread;
+   pid_t tid;
+#if TASK_STACK_GUARD
+   unsigned char faultStack[FAULT_STACK_SIZE];
+#endif
+
+} cpu[NUM_CPUS];
+
+#if TASK_STACK_GUARD
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void segvHandler(int sig, siginfo_t* info, void* context)
+{
+   Task* task = taskStackFault(info->si_addr);
+
+   if (task != NULL)
+   {
+      static const char MSG[] = "stack overflow: ";
+
+      write(STDERR_FILENO, MSG, sizeof(MSG) - 1);
+      write(STDERR_FILENO, task->name, strlen(task->name));
+      write(STDERR_FILENO, "\n", 1);
+   }
+
+   signal(sig, SIG_DFL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void faultStackInit(int id)
+{
+   stack_t stack;
+
+   stack.ss_sp = cpu[id].faultStack;
+   stack.ss_size = FAULT_STACK_SIZE;
+   stack.ss_flags = 0;
+
+   sigaltstack(&stack, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void faultInit()
+{
+   struct sigaction action;
+
+   memset(&action, 0, sizeof(action));
+   action.sa_sigaction = segvHandler;
+   action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+
+   sigaction(SIGSEGV, &action, NULL);
+}
+
+/****************************************************************************
+ * The guard must be a multiple of the host page size.  A stack that runs
+ * into it takes a SIGSEGV, which reports the task and then kills the
+ * process as usual (returning retries the access with the default action).
+ ****************************************************************************/
+bool taskStackGuard(void* guard, bool enable)
+{
+   int prot = enable ? PROT_NONE : (PROT_READ | PROT_WRITE);
+   return mprotect(guard, TASK_STACK_GUARD, prot) == 0;
+}
+#else
+#define faultStackInit(id)
+#define faultInit()
+#endif
+
+#ifdef SMP
+/****************************************************************************
+ * Tasks migrate between CPU threads, so the CPU ID is read through a call
+ * every time instead of letting the compiler keep the address of a thread
+ * local variable across a task switch.
+ ****************************************************************************/
+static __thread int id;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+int __attribute__((noinline)) _cpuID()
+{
+   return *(volatile int*) &id;
+}
+
+/****************************************************************************
+ * Ticket lock: the upper half of the lock word hands out tickets and the
+ * lower half is the ticket being served.  The CPUs are threads that the host
+ * may deschedule, so waiters yield instead of spinning.
+ ****************************************************************************/
+void _spinLock(unsigned long* spin)
+{
+   volatile unsigned short* owner = (volatile unsigned short*) spin;
+   unsigned short ticket = __atomic_fetch_add(spin, 0x10000,
+                                              __ATOMIC_ACQUIRE) >> 16;
+
+   while (__atomic_load_n(owner, __ATOMIC_ACQUIRE) != ticket)
+      sched_yield();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool _spinTryLock(unsigned long* spin)
+{
+   unsigned long value = __atomic_load_n(spin, __ATOMIC_RELAXED);
+
+   if ((unsigned short) (value >> 16) != (unsigned short) value)
+      return false;
+
+   return __atomic_compare_exchange_n(spin, &value, value + 0x10000, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _spinUnlock(unsigned long* spin)
+{
+   __atomic_add_fetch((unsigned short*) spin, 1, __ATOMIC_RELEASE);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _smpLock()
+{
+   _spinLock(&lock.spin);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _smpUnlock()
+{
+   _spinUnlock(&lock.spin);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void (*smpMain)();
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void* cpuMain(void* arg)
+{
+   id = (int) (intptr_t) arg;
+   cpu[id].tid = (pid_t) syscall(SYS_gettid);
+   faultStackInit(id);
+   smpMain();
+
+   return NULL;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void smpStart(void (*fx)())
+{
+   bool iFlag = disableInterrupts();
+   intptr_t i;
+
+   smpMain = fx;
+
+   /* the threads inherit the signal mask, so they start with interrupts
+      disabled */
+   for (i = 1; i < SMP; i++)
+      pthread_create(&cpu[i].thread, NULL, cpuMain, (void*) i);
+
+   if (iFlag)
+      enableInterrupts();
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void irqDispatch(int sig)
+{
+   irq.pending[cpuID()] = true;
+
+   if (irq.fx[sig] != NULL)
+      irq.fx[sig](sig, irq.arg[sig]);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void irqAddHandler(int sig, void (*fx)(int, void*), void* arg)
+{
+   struct sigaction action;
+
+   irq.fx[sig] = fx;
+   irq.arg[sig] = arg;
+
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = irqDispatch;
+   action.sa_mask = irq.mask;
+   action.sa_flags = SA_RESTART;
+
+   sigaction(sig, &action, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool interruptsEnabled()
+{
+   sigset_t mask;
+   pthread_sigmask(SIG_BLOCK, NULL, &mask);
+   return sigismember(&mask, SIGALRM) ? false : true;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool disableInterrupts()
+{
+   sigset_t mask;
+   pthread_sigmask(SIG_BLOCK, &irq.mask, &mask);
+   return sigismember(&mask, SIGALRM) ? false : true;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void enableInterrupts()
+{
+   pthread_sigmask(SIG_UNBLOCK, &irq.mask, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void waitForInterrupt()
+{
+   sigset_t mask;
+
+   pthread_sigmask(SIG_BLOCK, &irq.mask, &mask);
+
+   if (!irq.pending[cpuID()])
+   {
+      sigdelset(&mask, SIGALRM);
+      sigsuspend(&mask);
+   }
+
+   irq.pending[cpuID()] = false;
+   pthread_sigmask(SIG_SETMASK, &mask, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+pid_t cpuThread(int id)
+{
+   return cpu[id].tid;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void cpuSignal(int id, int sig)
+{
+   int i;
+
+   /* a CPU that has no thread ID yet has not entered the kernel */
+   for (i = 0; i < NUM_CPUS; i++)
+   {
+      if ((id >= 0) ? (i != id) : (i == cpuID()))
+         continue;
+
+      if (cpu[i].tid != 0)
+         pthread_kill(cpu[i].thread, sig);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool kernelLocked()
+{
+   return !interruptsEnabled();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelLock()
+{
+#ifdef SMP
+   bool iFlag = disableInterrupts();
+   lock.iFlag[cpuID()] = iFlag;
+   _smpLock();
+#else
+   lock.iFlag = disableInterrupts();
+#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelUnlock()
+{
+#ifdef SMP
+   bool iFlag = lock.iFlag[cpuID()];
+   _smpUnlock();
+   if (iFlag)
+      enableInterrupts();
+#else
+   if (lock.iFlag)
+      enableInterrupts();
+#endif
+}
+
+/****************************************************************************
+ * The context is kept at the top of the stack and the task runs below it.
+ * A task starts with interrupts disabled, _taskEntry() enables them.
+ ****************************************************************************/
+void taskSetup(Task* task, void (*fx)())
+{
+   uintptr_t top = (uintptr_t) task->stack.base + task->stack.size;
+   ucontext_t* context = (ucontext_t*) ((top - sizeof(ucontext_t)) &
+                                         ~(uintptr_t) 15);
+   size_t size = (uint8_t*) context - (uint8_t*) task->stack.base;
+
+#if TASK_STACK_USAGE
+   memset(task->stack.base, STACK_MARKER, size);
+#endif
+
+   getcontext(context);
+   sigorset(&context->uc_sigmask, &context->uc_sigmask, &irq.mask);
+   context->uc_stack.ss_sp = task->stack.base;
+   context->uc_stack.ss_size = size;
+   context->uc_link = NULL;
+   makecontext(context, fx, 0);
+
+   task->stack.ptr = context;
+}
+
+#if TASK_STACK_USAGE
+/****************************************************************************
+ *
+ ****************************************************************************/
+unsigned long taskStackUsage(Task* task)
+{
+   uint8_t* stack = task->stack.base;
+   unsigned long i = 0;
+
+   /* the first task of a CPU runs on the stack of its thread */
+   if (stack == NULL)
+      return 0;
+
+   while (stack[i] == STACK_MARKER)
+      i++;
+
+   return task->stack.size - i;
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskEntry(Task* task)
+{
+#ifdef SMP
+   /* the task that switched to us may have locked through kernelEnter(),
+      which does not save the interrupt state in lock.iFlag */
+   _smpUnlock();
+   enableInterrupts();
+#else
+   kernelUnlock();
+#endif
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskExit(Task* task) {}
+
+/****************************************************************************
+ * swapcontext() also saves and restores the signal mask, which is always
+ * the interrupts disabled mask here since the kernel is locked
+ ****************************************************************************/
+void _taskSwitch(Task* current, Task* next)
+{
+   swapcontext(current->stack.ptr, next->stack.ptr);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _taskInit(Task* task, void* stackBase, unsigned long stackSize)
+{
+   task->stack.base = stackBase;
+   task->stack.size = stackBase ? stackSize : 0;
+   task->stack.ptr = &cpu[cpuID()].context;
+}
+
+/****************************************************************************
+ * Like a CPU coming out of reset, the boot thread starts with interrupts
+ * disabled.
+ ****************************************************************************/
+static void __attribute__((constructor)) platformInit()
+{
+   int sig;
+
+   sigemptyset(&irq.mask);
+
+   for (sig = 1; sig < NSIG; sig++)
+   {
+      if (IRQ_SIGNAL(sig))
+         sigaddset(&irq.mask, sig);
+   }
+
+   cpu[0].thread = pthread_self();
+   cpu[0].tid = (pid_t) syscall(SYS_gettid);
+   faultStackInit(0);
+   faultInit();
+
+   pthread_sigmask(SIG_BLOCK, &irq.mask, NULL);
+}
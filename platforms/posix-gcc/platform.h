@@ -0,0 +1,209 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#include <endian.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "board.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define NORETURN __attribute__((noreturn))
+#define WEAK __attribute__((weak))
+#define ALIGNED(n) __attribute__((aligned(n)))
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define U8_F  "c"
+#define S8_F  "c"
+#define X8_F  "x"
+#define U16_F "u"
+#define S16_F "d"
+#define X16_F "x"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+#define SZT_F "z"
+
+/****************************************************************************
+ * Interrupts are signals.  SIGALRM, SIGIO, SIGUSR1, SIGUSR2 and the
+ * real-time signals are the interrupt lines: disableInterrupts() blocks all
+ * of them on the calling CPU (thread) and a handler runs with all of them
+ * blocked, like an IRQ handler on a CPU without nested interrupts.  Other
+ * signals (SIGINT, SIGSEGV, ...) keep their usual meaning.
+ ****************************************************************************/
+#define IRQ_SIGNAL(sig) \
+   (((sig) == SIGALRM) || ((sig) == SIGIO) || ((sig) == SIGUSR1) || \
+    ((sig) == SIGUSR2) || (((sig) >= SIGRTMIN) && ((sig) <= SIGRTMAX)))
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool interruptsEnabled();
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+bool disableInterrupts();
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void enableInterrupts();
+
+/****************************************************************************
+ * Function: irqAddHandler
+ *    - Installs the handler of an interrupt signal.
+ * Arguments:
+ *    sig - signal number (see IRQ_SIGNAL)
+ *    fx  - handler, called with the signal number and arg
+ *    arg - handler argument
+ ****************************************************************************/
+void irqAddHandler(int sig, void (*fx)(int, void*), void* arg);
+
+/****************************************************************************
+ * Function: waitForInterrupt
+ *    - Sleeps the calling CPU until an interrupt is handled on it.  Returns
+ *      right away if one was handled since the last call, so a wake-up that
+ *      lands just before the CPU goes to sleep is not lost.
+ ****************************************************************************/
+void waitForInterrupt();
+
+/****************************************************************************
+ * Function: cpuThread
+ *    - Gets the Linux thread ID of a CPU, for routing process wide signal
+ *      sources (timers, SIGIO) to it.
+ * Arguments:
+ *    cpu - CPU ID
+ * Returns:
+ *    thread ID
+ ****************************************************************************/
+pid_t cpuThread(int cpu);
+
+/****************************************************************************
+ * Function: cpuSignal
+ *    - Raises an interrupt signal on another CPU (an inter-processor
+ *      interrupt).
+ * Arguments:
+ *    cpu - CPU ID, -1 for all CPUs except the calling one
+ *    sig - signal number
+ ****************************************************************************/
+void cpuSignal(int cpu, int sig);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define countLeadingZeros(x) \
+   ((unsigned char) __builtin_clz((unsigned int) (x)))
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static inline void _memoryBarrier()
+{
+   __sync_synchronize();
+}
+
+#ifdef SMP
+/****************************************************************************
+ *
+ ****************************************************************************/
+int _cpuID();
+
+/****************************************************************************
+ * Function: smpStart
+ *    - Starts a thread for each of CPUs 1 to SMP - 1.  Each of them calls
+ *      fx() with interrupts disabled, and fx() must not return.
+ * Arguments:
+ *    fx - CPU entry point
+ ****************************************************************************/
+void smpStart(void (*fx)());
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _smpLock();
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void _smpUnlock();
+
+/****************************************************************************
+ * Function: _spinLock
+ *    - Acquires a ticket spin lock (the lock word must start out zero).
+ *      Interrupts must be disabled by the caller.
+ * Arguments:
+ *    spin - lock word
+ ****************************************************************************/
+void _spinLock(unsigned long* spin);
+
+/****************************************************************************
+ * Function: _spinTryLock
+ *    - Acquires a ticket spin lock if it is free.
+ * Arguments:
+ *    spin - lock word
+ * Returns:
+ *    true if the lock was acquired
+ ****************************************************************************/
+bool _spinTryLock(unsigned long* spin);
+
+/****************************************************************************
+ * Function: _spinUnlock
+ *    - Releases a ticket spin lock.
+ * Arguments:
+ *    spin - lock word
+ ****************************************************************************/
+void _spinUnlock(unsigned long* spin);
+#else
+/****************************************************************************
+ *
+ ****************************************************************************/
+static inline int _cpuID()
+{
+   return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include "board.h"
+#include "edf_test.h"
+#include "kernel.h"
+#include "platform.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Task task1 = TASK_CREATE("edf_test1", TASK_EDF_PRIORITY,
+                                EDF_TEST1_STACK_SIZE);
+static Task task2 = TASK_CREATE("edf_test2", TASK_EDF_PRIORITY,
+                                EDF_TEST2_STACK_SIZE);
+static Task task3 = TASK_CREATE("edf_test3", TASK_LOW_PRIORITY,
+                                EDF_TEST3_STACK_SIZE);
+static unsigned long errors = 0;
+
+/****************************************************************************
+ * Shares its period with task2 but has the later deadline, so whenever
+ * both are released together task2 must have gone first.
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      if ((task2.state == TASK_STATE_READY) &&
+          ((long) (task2.edf.release - task1.edf.release) <= 0))
+      {
+         errors++;
+      }
+
+      if (kernelLocked())
+         puts("edf error 1");
+
+      taskWaitPeriod();
+   }
+}
+
+/****************************************************************************
+ * A short deadline that should never be missed.
+ ****************************************************************************/
+static void taskFx2(void* arg)
+{
+   for (;;)
+      taskWaitPeriod();
+}
+
+/****************************************************************************
+ * Every job outlasts both its deadline and its period.  It runs outside of
+ * the EDF band (so its overdue jobs cannot preempt task2 part way through a
+ * job) but still counts its misses.
+ ****************************************************************************/
+static void taskFx3(void* arg)
+{
+   for (;;)
+   {
+      taskSleep(15);
+      taskWaitPeriod();
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void edfTestCmd(int argc, char* argv[])
+{
+   Task* task[3] = {&task1, &task2, &task3};
+
+   for (int i = 0; i < 3; i++)
+   {
+      printf("%s: jobs %lu, misses %lu\n", task[i]->name, task[i]->edf.jobs,
+             task[i]->edf.misses);
+   }
+
+   printf("errors: %lu\n", errors);
+
+   if ((errors == 0) && (task1.edf.jobs > 0) && (task2.edf.jobs > 0) &&
+       (task2.edf.misses == 0) && (task3.edf.jobs > 0) &&
+       (task3.edf.misses + 1 >= task3.edf.jobs))
+   {
+      puts("edf ok");
+   }
+   else
+   {
+      puts("edf error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void edfTest()
+{
+   taskSetPeriod(&task1, 50, 40);
+   taskSetPeriod(&task2, 50, 5);
+   taskSetPeriod(&task3, 10, 0);
+
+   taskStart(&task1, taskFx1, NULL);
+   taskStart(&task2, taskFx2, NULL);
+   taskStart(&task3, taskFx3, NULL);
+}
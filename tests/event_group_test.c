@@ -0,0 +1,205 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "event_group_test.h"
+#include "kernel.h"
+#include "platform.h"
+
+/****************************************************************************
+ * Each flag is only set by one context and only while it is clear, so the
+ * number of times it was set and the number of times a wait consumed it
+ * never drift apart (one pending plus one being counted).
+ ****************************************************************************/
+#define EVENT1 0x00000001
+#define EVENT2 0x00000100
+#define EVENT3 0x00010000
+#define EVENT4 0x01000000
+#define EVENT5 0x80000000
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static EventGroup group = EVENT_GROUP_CREATE("event_group_test", 0);
+static Task task1 = TASK_CREATE("event_group_test1",
+                                TASK_LOW_PRIORITY,
+                                EVENT_GROUP_TEST1_STACK_SIZE);
+static Task task2 = TASK_CREATE("event_group_test2",
+                                TASK_HIGH_PRIORITY,
+                                EVENT_GROUP_TEST2_STACK_SIZE);
+static Task task3 = TASK_CREATE("event_group_test3",
+                                TASK_HIGH_PRIORITY,
+                                EVENT_GROUP_TEST3_STACK_SIZE);
+static Timer timer = TIMER_CREATE(0, 0, NULL);
+static unsigned long x[4] = {0, 0, 0, 0};
+static unsigned long y[3] = {0, 0, 0};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerFx(Timer* timer)
+{
+   if ((group.flags & EVENT1) == 0)
+   {
+      x[0]++;
+      _eventGroupSet(&group, EVENT1);
+   }
+
+   if (((group.flags & EVENT3) == 0) && (rand() % 2))
+   {
+      x[2]++;
+      _eventGroupSet(&group, EVENT3);
+   }
+
+   timer->timeout[0] = rand() % 250;
+   timer->timeout[1] = timer->timeout[0];
+
+   _timerAdd(timer, timerFx, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      unsigned long flags = eventGroupWait(&group, EVENT1 | EVENT2,
+                                           EVENT_GROUP_WAIT_ANY |
+                                           EVENT_GROUP_WAIT_CLEAR,
+                                           rand() % 250);
+
+      if (flags != 0)
+      {
+         if ((flags & (EVENT1 | EVENT2)) == 0)
+            puts("event group error 1");
+
+         if (flags & EVENT1)
+            y[0]++;
+
+         if (flags & EVENT2)
+            y[1]++;
+      }
+
+      taskSleep(rand() % 100);
+
+      if (kernelLocked())
+         puts("event group error 2");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx2(void* arg)
+{
+   for (;;)
+   {
+      unsigned long flags = eventGroupWait(&group, EVENT3 | EVENT4,
+                                           EVENT_GROUP_WAIT_ALL |
+                                           EVENT_GROUP_WAIT_CLEAR,
+                                           rand() % 500);
+
+      if (flags != 0)
+      {
+         if ((flags & (EVENT3 | EVENT4)) != (EVENT3 | EVENT4))
+            puts("event group error 3");
+
+         y[2]++;
+      }
+
+      if (kernelLocked())
+         puts("event group error 4");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx3(void* arg)
+{
+   for (;;)
+   {
+      if ((group.flags & EVENT2) == 0)
+      {
+         x[1]++;
+         eventGroupSet(&group, EVENT2);
+      }
+
+      if (((group.flags & EVENT4) == 0) && (rand() % 2))
+      {
+         x[3]++;
+         eventGroupSet(&group, EVENT4);
+      }
+
+      eventGroupSet(&group, EVENT5);
+
+      if ((eventGroupClear(&group, EVENT5) & EVENT5) == 0)
+         puts("event group error 5");
+
+      taskSleep(rand() % 250);
+
+      if (kernelLocked())
+         puts("event group error 6");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void eventGroupTestCmd(int argc, char* argv[])
+{
+   printf("sets: %lu, %lu, %lu, %lu\n", x[0], x[1], x[2], x[3]);
+   printf("waits: %lu, %lu, %lu\n", y[0], y[1], y[2]);
+
+   if (((x[0] - y[0]) <= 2) && ((x[1] - y[1]) <= 2) &&
+       ((x[2] - y[2]) <= 2) && ((x[3] - y[2]) <= 2))
+   {
+      puts("event group ok");
+   }
+   else
+   {
+      puts("event group error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void eventGroupTest()
+{
+   timer.timeout[0] = rand() % 250;
+   timer.timeout[1] = timer.timeout[0];
+
+   timerAdd(&timer, timerFx, NULL);
+
+   taskStart(&task1, taskFx1, NULL);
+   taskStart(&task2, taskFx2, NULL);
+   taskStart(&task3, taskFx3, NULL);
+}
@@ -0,0 +1,162 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "hrtimer_test.h"
+#include "kernel.h"
+#include "platform.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define PERIOD 500
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static HRTimer timer1 = HRTIMER_CREATE();
+static HRTimer timer2 = HRTIMER_CREATE();
+static HRTimer timer3 = HRTIMER_CREATE();
+static Task task1 = TASK_CREATE("hrtimer_test1", TASK_HIGH_PRIORITY,
+                                HRTIMER_TEST1_STACK_SIZE);
+static unsigned long long start = 0;
+static unsigned long fires = 0;
+static unsigned long early = 0;
+static unsigned long lateMax = 0;
+static unsigned long long lateSum = 0;
+static unsigned long periods = 0;
+static volatile unsigned long x[2] = {0, 0};
+static unsigned long errors = 0;
+
+/****************************************************************************
+ * One-shot timers at random sub-tick delays, to measure how late they fire.
+ ****************************************************************************/
+static void timerFx1(HRTimer* timer)
+{
+   unsigned long long now = hrtimerClock();
+
+   if (now < timer->deadline)
+   {
+      early++;
+   }
+   else
+   {
+      unsigned long late = now - timer->deadline;
+
+      if (late > lateMax)
+         lateMax = late;
+
+      lateSum += late;
+   }
+
+   fires++;
+
+   _hrtimerAdd(timer, now + 20 + rand() % 1000, timerFx1, NULL);
+}
+
+/****************************************************************************
+ * Drift free periodic timer.
+ ****************************************************************************/
+static void timerFx2(HRTimer* timer)
+{
+   periods++;
+   _hrtimerAdd(timer, timer->deadline + PERIOD, timerFx2, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerFx3(HRTimer* timer)
+{
+   x[1]++;
+}
+
+/****************************************************************************
+ * Arms timer3 and cancels it before or after it fires; once cancelled it
+ * must stay quiet.
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      hrtimerAdd(&timer3, hrtimerClock() + rand() % 2000, timerFx3, NULL);
+      x[0]++;
+
+      taskSleep(rand() % 3);
+      hrtimerCancel(&timer3);
+
+      /* a callback already running on another CPU may still count */
+      taskSleep(1);
+
+      unsigned long count = x[1];
+      taskSleep(3);
+
+      if (x[1] != count)
+         errors++;
+
+      if (kernelLocked())
+         puts("hrtimer error 1");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerTestCmd(int argc, char* argv[])
+{
+   unsigned long expected = (hrtimerClock() - start) / PERIOD;
+
+   printf("fires: %lu, early: %lu, late (us): avg %lu, max %lu\n", fires,
+          early, fires ? (unsigned long) (lateSum / fires) : 0, lateMax);
+   printf("periods: %lu of %lu\n", periods, expected);
+   printf("cancels: %lu, fired: %lu, errors: %lu\n", x[0], x[1], errors);
+
+   if ((early == 0) && (errors == 0) && (fires > 0) &&
+       (periods + 2 >= expected) && (periods <= expected + 2))
+   {
+      puts("hrtimer ok");
+   }
+   else
+   {
+      puts("hrtimer error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void hrtimerTest()
+{
+   start = hrtimerClock();
+
+   hrtimerAdd(&timer1, start + 20 + rand() % 1000, timerFx1, NULL);
+   hrtimerAdd(&timer2, start + PERIOD, timerFx2, NULL);
+
+   taskStart(&task1, taskFx1, NULL);
+}
@@ -0,0 +1,416 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "kernel.h"
+#include "kernel_bench.h"
+#include "platform.h"
+
+/****************************************************************************
+ * The benchmarks run in a task of their own (plus a helper task for the
+ * ones that need a peer), both at TASK_HIGH_PRIORITY and kept on the CPU
+ * that runs the command.  Yields hand the CPU to any other ready task, so
+ * the numbers are only comparable on an otherwise quiet system (see the
+ * "bench" build target, which runs them before anything else starts).
+ ****************************************************************************/
+typedef struct
+{
+   const char* name;
+   unsigned int size;
+   unsigned long (*fx)(void* arg, unsigned long n);
+   void* arg;
+
+} BenchCase;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Task task1 = TASK_CREATE("kernel_bench1", TASK_HIGH_PRIORITY,
+                                KERNEL_BENCH1_STACK_SIZE);
+static Task task2 = TASK_CREATE("kernel_bench2", TASK_HIGH_PRIORITY,
+                                KERNEL_BENCH2_STACK_SIZE);
+static Semaphore done = SEMAPHORE_CREATE("kernel_bench", 0, 1);
+static Semaphore semaphore1 = SEMAPHORE_CREATE("kernel_bench1", 0, 1);
+static Semaphore semaphore2 = SEMAPHORE_CREATE("kernel_bench2", 0, 1);
+static Mutex mutex = MUTEX_CREATE("kernel_bench");
+static Timer timer = TIMER_CREATE(0, TASK_TICK_HZ, NULL);
+static Timer tick = TIMER_CREATE(TIMER_FLAG_PERIODIC, 1, NULL);
+
+static Queue queues[] =
+{
+   QUEUE_CREATE("kernel_bench1", 1, KERNEL_BENCH_QUEUE_DEPTH),
+   QUEUE_CREATE("kernel_bench4", 4, KERNEL_BENCH_QUEUE_DEPTH),
+   QUEUE_CREATE("kernel_bench16", 16, KERNEL_BENCH_QUEUE_DEPTH),
+   QUEUE_CREATE("kernel_bench64", 64, KERNEL_BENCH_QUEUE_DEPTH)
+};
+
+static unsigned char src[64];
+static unsigned char dst[64];
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static struct
+{
+   const BenchCase* bench;
+   volatile bool stop;
+   unsigned long n;
+   unsigned long ops;
+   unsigned long start;
+   unsigned long end;
+   volatile unsigned long stamp;
+   unsigned long min;
+   unsigned long max;
+
+} results;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void helperStart(void (*fx)(void*), void* arg)
+{
+   taskStart(&task2, fx, arg);
+   results.start = kernelBenchClock();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void switchFx(void* arg)
+{
+   while (!results.stop)
+      taskYield();
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchSwitch(void* arg, unsigned long n)
+{
+   helperStart(switchFx, NULL);
+
+   for (unsigned long i = 0; i < n; i++)
+      taskYield();
+
+   results.end = kernelBenchClock();
+   results.stop = true;
+
+   return n * 2;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void semaphoreFx(void* arg)
+{
+   for (unsigned long i = 0; i < results.n; i++)
+   {
+      semaphoreTake(&semaphore1, -1);
+      semaphoreGive(&semaphore2);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchSemaphore(void* arg, unsigned long n)
+{
+   helperStart(semaphoreFx, NULL);
+
+   for (unsigned long i = 0; i < n; i++)
+   {
+      semaphoreGive(&semaphore1);
+      semaphoreTake(&semaphore2, -1);
+   }
+
+   results.end = kernelBenchClock();
+
+   return n;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void queueFx(void* arg)
+{
+   for (unsigned long i = 0; i < results.n; i++)
+      queuePush(arg, true, src, -1);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchQueue(void* arg, unsigned long n)
+{
+   helperStart(queueFx, arg);
+
+   for (unsigned long i = 0; i < n; i++)
+      queuePop(arg, true, false, dst, -1);
+
+   results.end = kernelBenchClock();
+
+   return n;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchMutex(void* arg, unsigned long n)
+{
+   results.start = kernelBenchClock();
+
+   for (unsigned long i = 0; i < n; i++)
+   {
+      mutexLock(&mutex, -1);
+      mutexUnlock(&mutex);
+   }
+
+   results.end = kernelBenchClock();
+
+   return n;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void mutexFx(void* arg)
+{
+   do
+   {
+      mutexLock(&mutex, -1);
+      mutexUnlock(&mutex);
+
+   } while (!results.stop);
+}
+
+/****************************************************************************
+ * Once the helper is blocked on the mutex, every unlock hands it over and
+ * the lock that follows blocks until it is handed back.
+ ****************************************************************************/
+static unsigned long benchMutexContended(void* arg, unsigned long n)
+{
+   mutexLock(&mutex, -1);
+   helperStart(mutexFx, NULL);
+   taskYield();
+
+   results.start = kernelBenchClock();
+
+   for (unsigned long i = 0; i < n; i++)
+   {
+      mutexUnlock(&mutex);
+      mutexLock(&mutex, -1);
+   }
+
+   results.end = kernelBenchClock();
+   results.stop = true;
+   mutexUnlock(&mutex);
+
+   return n * 2;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerFx(Timer* timer)
+{
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchTimer(void* arg, unsigned long n)
+{
+   results.start = kernelBenchClock();
+
+   for (unsigned long i = 0; i < n; i++)
+   {
+      timerAdd(&timer, timerFx, NULL);
+      timerCancel(&timer);
+   }
+
+   results.end = kernelBenchClock();
+
+   return n;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void tickFx(Timer* timer)
+{
+   timer->flags &= ~TIMER_FLAG_EXPIRED;
+   results.stamp = kernelBenchClock();
+   _semaphoreGive(&semaphore1);
+}
+
+/****************************************************************************
+ * Samples the time from a timer (interrupt context) giving a semaphore to
+ * the task taking it running, once a tick.  "start" to "end" sums the
+ * samples.
+ ****************************************************************************/
+static unsigned long benchLatency(void* arg, unsigned long n)
+{
+   n = (n + 9) / 10;
+
+   results.start = 0;
+   results.end = 0;
+   results.min = -1;
+   results.max = 0;
+
+   timerAdd(&tick, tickFx, NULL);
+
+   for (unsigned long i = 0; i < n; i++)
+   {
+      semaphoreTake(&semaphore1, -1);
+
+      unsigned long latency = kernelBenchClock() - results.stamp;
+
+      if (latency < results.min)
+         results.min = latency;
+      if (latency > results.max)
+         results.max = latency;
+
+      results.end += latency;
+   }
+
+   timerCancel(&tick);
+
+   /* the tick may have given once more */
+   semaphoreTake(&semaphore1, 0);
+
+   return n;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static const BenchCase BENCH_CASES[] =
+{
+   {"ctx_switch", 0, benchSwitch, NULL},
+   {"sem_pingpong", 0, benchSemaphore, NULL},
+   {"queue", 1, benchQueue, &queues[0]},
+   {"queue", 4, benchQueue, &queues[1]},
+   {"queue", 16, benchQueue, &queues[2]},
+   {"queue", 64, benchQueue, &queues[3]},
+   {"mutex", 0, benchMutex, NULL},
+   {"mutex_contended", 0, benchMutexContended, NULL},
+   {"timer_add_cancel", 0, benchTimer, NULL},
+   {"irq_latency", 0, benchLatency, NULL},
+};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void benchFx(void* arg)
+{
+   results.ops = results.bench->fx(results.bench->arg, results.n);
+
+   while (task2.state != TASK_STATE_INIT)
+      taskSleep(1);
+
+   semaphoreGive(&done);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void benchRun(const BenchCase* bench, unsigned long n)
+{
+   results.bench = bench;
+   results.stop = false;
+   results.n = n;
+
+#ifdef SMP
+   taskSetAffinity(&task1, 1UL << cpuID());
+   taskSetAffinity(&task2, 1UL << cpuID());
+#endif
+
+   taskStart(&task1, benchFx, NULL);
+   semaphoreTake(&done, -1);
+
+   while (task1.state != TASK_STATE_INIT)
+      taskSleep(1);
+
+   unsigned long us = results.end - results.start;
+
+   printf("{\"bench\":\"%s\",\"size\":%u,\"ops\":%lu,\"us\":%lu,"
+          "\"ns_per_op\":%lu", bench->name, bench->size, results.ops, us,
+          (unsigned long) ((unsigned long long) us * 1000 / results.ops));
+
+   if (bench->fx == benchLatency)
+      printf(",\"min_us\":%lu,\"max_us\":%lu", results.min, results.max);
+
+   puts("}");
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelBenchCmd(int argc, char* argv[])
+{
+   unsigned long n = KERNEL_BENCH_ITERATIONS;
+   const char* name = "all";
+   bool found = false;
+
+   if (argc > 1)
+      name = argv[1];
+
+   if (argc > 2)
+      n = strtoul(argv[2], NULL, 0);
+
+   if (n == 0)
+      n = 1;
+
+   for (unsigned int i = 0; i < sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]);
+        i++)
+   {
+      if ((strcmp(name, "all") == 0) ||
+          (strcmp(name, BENCH_CASES[i].name) == 0))
+      {
+         benchRun(&BENCH_CASES[i], n);
+         found = true;
+      }
+   }
+
+   if (!found)
+      printf("unknown benchmark: %s\n", name);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void kernelBench()
+{
+   for (unsigned int i = 0; i < sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]);
+        i++)
+   {
+      benchRun(&BENCH_CASES[i], KERNEL_BENCH_ITERATIONS);
+   }
+}
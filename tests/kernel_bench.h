@@ -0,0 +1,71 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#ifndef KERNEL_BENCH_H
+#define KERNEL_BENCH_H
+
+/****************************************************************************
+ * Iterations each benchmark runs unless the command gives a count (the
+ * interrupt latency benchmark takes a tick per sample, so it runs a tenth
+ * as many).
+ ****************************************************************************/
+#ifndef KERNEL_BENCH_ITERATIONS
+#define KERNEL_BENCH_ITERATIONS 1000
+#endif
+
+/****************************************************************************
+ * Elements each queue of the queue throughput benchmark holds.
+ ****************************************************************************/
+#ifndef KERNEL_BENCH_QUEUE_DEPTH
+#define KERNEL_BENCH_QUEUE_DEPTH 8
+#endif
+
+/****************************************************************************
+ * Runs the kernel micro-benchmarks and prints one JSON object per line:
+ *
+ *    {"bench":"sem_pingpong","size":0,"ops":1000,"us":850,"ns_per_op":850}
+ *
+ * "size" is the element size of the queue benchmarks (0 otherwise) and
+ * "us" the time the "ops" operations took.  The irq_latency lines also
+ * have "min_us" and "max_us", and their "us" sums the latencies.
+ *
+ *    kernel_bench [name|all] [iterations]
+ ****************************************************************************/
+void kernelBenchCmd(int argc, char* argv[]);
+
+/****************************************************************************
+ * Runs every benchmark with KERNEL_BENCH_ITERATIONS iterations.
+ ****************************************************************************/
+void kernelBench();
+
+/****************************************************************************
+ * Callback to read a free running clock in microseconds (wrapping is fine,
+ * as only differences are used).
+ ****************************************************************************/
+unsigned long kernelBenchClock();
+
+#endif
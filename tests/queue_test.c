@@ -52,12 +52,54 @@ static uint8_t x2[2] = {0, 0};
 static void timerFx(Timer* timer)
 {
    bool peek = (rand() % 10) == 0;
+   bool success;
    uint8_t x = 0;
+   uint8_t* ptr;
 
-   if (_queuePush(&queue1, true, &x1[0]))
-      x1[0]++;
+   switch (rand() % 3)
+   {
+      case 0:
+         ptr = _queueReserve(&queue1);
+
+         if (ptr != NULL)
+         {
+            *ptr = x1[0]++;
+            _queueCommit(&queue1);
+         }
+         break;
+
+      case 1:
+         if (_queuePush(&queue1, true, &x1[0]))
+            x1[0]++;
+         break;
+
+      default:
+      {
+         uint8_t burst[3] = {x1[0], x1[0] + 1, x1[0] + 2};
+         x1[0] += _queuePushN(&queue1, burst, 1 + rand() % 3);
+         break;
+      }
+   }
 
-   if (_queuePop(&queue2, true, peek, &x))
+   if ((rand() % 2) == 0)
+   {
+      ptr = _queuePeekRef(&queue2);
+      success = ptr != NULL;
+
+      if (success)
+      {
+         x = *ptr;
+
+         if (!peek)
+            _queueRelease(&queue2);
+      }
+   }
+   else
+   {
+      success = _queuePop(&queue2, true, peek, &x);
+   }
+
+   if (success)
    {
       if (x != x2[1])
       {
@@ -84,17 +126,44 @@ static void taskFx1(void* arg)
    for (;;)
    {
       bool peek = (rand() % 10) == 0;
-      uint8_t x;
+      unsigned int n = 0;
+      uint8_t x[3];
+      uint8_t* ptr;
 
       if (kernelLocked())
          puts("queue error 2");
 
-      if (queuePop(&queue1, true, peek, &x, rand() % 50))
+      switch (rand() % 3)
+      {
+         case 0:
+            ptr = queuePeekRef(&queue1, rand() % 50);
+
+            if (ptr != NULL)
+            {
+               x[n++] = *ptr;
+
+               if (!peek)
+                  queueRelease(&queue1);
+            }
+            break;
+
+         case 1:
+            if (queuePop(&queue1, true, peek, &x[0], rand() % 50))
+               n = 1;
+            break;
+
+         default:
+            peek = false;
+            n = queuePopN(&queue1, x, 1 + rand() % 3, rand() % 50);
+            break;
+      }
+
+      for (unsigned int i = 0; i < n; i++)
       {
-         if (x != x1[1])
+         if (x[i] != x1[1])
          {
             puts("queue error 3");
-            x1[1] = x;
+            x1[1] = x[i];
          }
          else if (!peek)
          {
@@ -102,12 +171,34 @@ static void taskFx1(void* arg)
          }
       }
 
-      if (queuePush(&queue2, true, &x2[0], 0))
-         x2[0]++;
+      switch (rand() % 3)
+      {
+         case 0:
+            ptr = queueReserve(&queue2, 0);
+
+            if (ptr != NULL)
+            {
+               *ptr = x2[0]++;
+               queueCommit(&queue2);
+            }
+            break;
+
+         case 1:
+            if (queuePush(&queue2, true, &x2[0], 0))
+               x2[0]++;
+            break;
+
+         default:
+         {
+            uint8_t burst[2] = {x2[0], x2[0] + 1};
+            x2[0] += queuePushN(&queue2, burst, 2, 0);
+            break;
+         }
+      }
 
-      if (queuePop(&queue3, true, false, &x, 0))
+      if (queuePop(&queue3, true, false, &x[0], 0))
       {
-         if (x != 0)
+         if (x[0] != 0)
             puts("queue error 4");
       }
       else
@@ -0,0 +1,319 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "kernel.h"
+#include "platform.h"
+#include "ring_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Ring ring1 = RING_CREATE("ring_test1", 1, 4);
+static Ring ring2 = RING_CREATE("ring_test2", 1, 4);
+static Task task1 = TASK_CREATE("ring_test1", TASK_HIGH_PRIORITY,
+                                RING_TEST1_STACK_SIZE);
+static Timer timer = TIMER_CREATE(0, 0, NULL);
+static uint8_t x1[2] = {0, 0};
+static uint8_t x2[2] = {0, 0};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerFx(Timer* timer)
+{
+   int n = rand() % 4;
+   uint8_t x;
+
+   while (n-- > 0)
+   {
+      if (_ringPush(&ring1, &x1[0]))
+         x1[0]++;
+   }
+
+   if (_ringPop(&ring2, &x))
+   {
+      if (x != x2[1])
+      {
+         puts("ring error 1");
+         x2[1] = x;
+      }
+
+      x2[1]++;
+   }
+
+   timer->timeout[0] = rand() % 100;
+   timer->timeout[1] = timer->timeout[0];
+
+   _timerAdd(timer, timerFx, NULL);
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      uint8_t x;
+
+      if (kernelLocked())
+         puts("ring error 2");
+
+      if (ringPop(&ring1, &x, rand() % 50))
+      {
+         if (x != x1[1])
+         {
+            puts("ring error 3");
+            x1[1] = x;
+         }
+
+         x1[1]++;
+      }
+
+      if (ringPush(&ring2, &x2[0]))
+         x2[0]++;
+
+      if ((rand() % 4) == 0)
+         taskSleep(rand() % 100);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void ringTestCmd(int argc, char* argv[])
+{
+   printf("x1: %u %u\n", x1[0], x1[1]);
+   printf("x2: %u %u\n", x2[0], x2[1]);
+
+   if ((((uint8_t) (x1[0] - x1[1])) <= 4) &&
+       (((uint8_t) (x2[0] - x2[1])) <= 4))
+   {
+      puts("ring ok");
+   }
+   else
+   {
+      puts("ring error!");
+   }
+}
+
+#if TASK_PREEMPTION
+/****************************************************************************
+ * The benchmark moves RING_BENCH_BURST elements per tick from a timer
+ * (interrupt context) to a blocked task, while the lowest priority task
+ * counts loops.  The loops lost against a run without traffic, divided by
+ * the elements moved, is the cost of an element in loop iterations.
+ ****************************************************************************/
+#define RING_BENCH_BURST 8
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+typedef struct
+{
+   void* data;
+   unsigned short size;
+   unsigned short flags;
+
+} Descriptor;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Queue benchQueue[] =
+{
+   QUEUE_CREATE("bench_byte", 1, 16),
+   QUEUE_CREATE("bench_desc", sizeof(Descriptor), 16)
+};
+
+static Ring benchRing[] =
+{
+   RING_CREATE("bench_byte", 1, 16),
+   RING_CREATE("bench_desc", sizeof(Descriptor), 16)
+};
+
+static Task benchTask1 = TASK_CREATE("ring_bench1", TASK_HIGH_PRIORITY,
+                                     RING_TEST2_STACK_SIZE);
+static Task benchTask2 = TASK_CREATE("ring_bench2", TASK_LOW_PRIORITY,
+                                     RING_TEST3_STACK_SIZE);
+static Timer benchTimer = TIMER_CREATE(TIMER_FLAG_PERIODIC, 1, NULL);
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static struct
+{
+   volatile bool stop;
+   Queue* queue;
+   Ring* ring;
+   Descriptor src;
+   volatile unsigned long elements;
+   volatile unsigned long loops;
+
+} bench;
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void benchTimerFx(Timer* timer)
+{
+   timer->flags &= ~TIMER_FLAG_EXPIRED;
+
+   for (int i = 0; i < RING_BENCH_BURST; i++)
+   {
+      if (bench.ring != NULL)
+         _ringPush(bench.ring, &bench.src);
+      else
+         _queuePush(bench.queue, true, &bench.src);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void benchTaskFx1(void* arg)
+{
+   Descriptor dst;
+
+   while (!bench.stop)
+   {
+      bool success;
+
+      if (bench.ring != NULL)
+         success = ringPop(bench.ring, &dst, 10);
+      else
+         success = queuePop(bench.queue, true, false, &dst, 10);
+
+      if (success)
+         bench.elements++;
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void benchTaskFx2(void* arg)
+{
+   while (!bench.stop)
+      bench.loops++;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static unsigned long benchRun(Queue* queue, Ring* ring, unsigned long ticks)
+{
+   Descriptor dst;
+
+   bench.stop = false;
+   bench.queue = queue;
+   bench.ring = ring;
+   bench.elements = 0;
+   bench.loops = 0;
+
+   taskStart(&benchTask2, benchTaskFx2, NULL);
+
+   if ((queue != NULL) || (ring != NULL))
+   {
+      taskStart(&benchTask1, benchTaskFx1, NULL);
+      timerAdd(&benchTimer, benchTimerFx, NULL);
+   }
+
+   taskSleep(ticks);
+
+   bench.stop = true;
+   timerCancel(&benchTimer);
+
+   while ((benchTask1.state != TASK_STATE_INIT) ||
+          (benchTask2.state != TASK_STATE_INIT))
+   {
+      taskSleep(1);
+   }
+
+   if (ring != NULL)
+      while (ringPop(ring, &dst, 0));
+   else if (queue != NULL)
+      while (queuePop(queue, true, false, &dst, 0));
+
+   return bench.loops;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void ringBenchCmd(int argc, char* argv[])
+{
+   static const char* WORKLOADS[] = {"byte", "desc"};
+   unsigned long ticks = TASK_TICK_HZ;
+
+   if (argc > 1)
+      ticks = strtoul(argv[1], NULL, 0);
+
+   unsigned long base = benchRun(NULL, NULL, ticks);
+
+   printf("%-10s%-11s%-12s%-12s%s\n", "WORKLOAD", "PRIMITIVE", "ELEMENTS",
+          "LOOPS", "LOOPS/ELEMENT");
+   printf("%-10s%-11s%-12lu%-12lu%lu\n", "-", "none", 0UL, base, 0UL);
+
+   for (int i = 0; i < 2; i++)
+   {
+      for (int j = 0; j < 2; j++)
+      {
+         unsigned long loops;
+
+         if (j == 0)
+            loops = benchRun(&benchQueue[i], NULL, ticks);
+         else
+            loops = benchRun(NULL, &benchRing[i], ticks);
+
+         unsigned long cost = 0;
+
+         if ((bench.elements > 0) && (loops < base))
+            cost = (base - loops) / bench.elements;
+
+         printf("%-10s%-11s%-12lu%-12lu%lu\n", WORKLOADS[i],
+                (j == 0) ? "queue" : "ring", bench.elements, loops, cost);
+      }
+   }
+}
+#endif
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void ringTest()
+{
+   timer.timeout[0] = rand() % 100;
+   timer.timeout[1] = timer.timeout[0];
+
+   timerAdd(&timer, timerFx, NULL);
+
+   taskStart(&task1, taskFx1, NULL);
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "kernel.h"
+#include "platform.h"
+#include "task_list_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Task task1 = TASK_CREATE("task_list_test1", TASK_HIGH_PRIORITY,
+                                TASK_LIST_TEST1_STACK_SIZE);
+static Task task2 = TASK_CREATE("task_list_test2", TASK_HIGH_PRIORITY,
+                                TASK_LIST_TEST2_STACK_SIZE);
+static Task task3 = TASK_CREATE("task_list_test3", TASK_LOW_PRIORITY,
+                                TASK_LIST_TEST3_STACK_SIZE);
+static unsigned long x[3] = {0, 0, 0};
+
+/****************************************************************************
+ * Short random sleeps keep tasks going in and out of the sleep heap (and
+ * onto the ready lists) while the lists are walked.
+ ****************************************************************************/
+static void taskFx(void* arg)
+{
+   for (;;)
+   {
+      x[(unsigned long) arg]++;
+      taskSleep(rand() % 4);
+   }
+}
+
+/****************************************************************************
+ * Lists the tasks a number of times (5 by default).  A broken walk of the
+ * sleep heap shows up as tasks listed twice or as a hang.
+ ****************************************************************************/
+void taskListTestCmd(int argc, char* argv[])
+{
+   unsigned long y[3] = {x[0], x[1], x[2]};
+   int count = (argc > 1) ? atoi(argv[1]) : 5;
+
+   for (int i = 0; i < count; i++)
+   {
+      taskList();
+      taskSleep(rand() % 3);
+   }
+
+   printf("x: %lu, %lu, %lu\n", x[0] - y[0], x[1] - y[1], x[2] - y[2]);
+
+   if ((x[0] != y[0]) && (x[1] != y[1]) && (x[2] != y[2]))
+      puts("task list ok");
+   else
+      puts("task list error!");
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskListTest()
+{
+   taskStart(&task1, taskFx, (void*) 0);
+   taskStart(&task2, taskFx, (void*) 1);
+   taskStart(&task3, taskFx, (void*) 2);
+}
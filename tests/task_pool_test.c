@@ -0,0 +1,129 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include "board.h"
+#include "kernel.h"
+#include "platform.h"
+#include "task_pool_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+#define POOL_SIZE  4
+#define BURST_SIZE 6
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static TaskPool pool = TASK_POOL_CREATE(TASK_POOL_TEST2_STACK_SIZE,
+                                        POOL_SIZE);
+static Task task1 = TASK_CREATE("task_pool_test1", TASK_LOW_PRIORITY,
+                                TASK_POOL_TEST1_STACK_SIZE);
+static unsigned long x[2] = {0, 0};
+static unsigned long y[2] = {0, 0};
+static unsigned long errors = 0;
+
+/****************************************************************************
+ * Lives for a tick, so a whole burst is alive at once and outnumbers the
+ * pool.
+ ****************************************************************************/
+static void taskFx2(void* arg)
+{
+   taskSleep(1);
+
+   kernelLock();
+   y[(unsigned long) arg]++;
+   kernelUnlock();
+}
+
+/****************************************************************************
+ * Spawns bursts of short lived tasks, some of which have to come from the
+ * heap.
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      for (int i = 0; i < BURST_SIZE; i++)
+      {
+         Task* task = taskPoolTake("task_pool_test2", TASK_LOW_PRIORITY,
+                                   TASK_POOL_TEST2_STACK_SIZE / 2);
+         unsigned long pooled;
+
+         if (task == NULL)
+         {
+            errors++;
+            continue;
+         }
+
+         pooled = (task >= pool.tasks) && (task < pool.tasks + POOL_SIZE);
+
+         if (task->stack.size < TASK_POOL_TEST2_STACK_SIZE / 2)
+            errors++;
+
+         x[pooled]++;
+         taskStart(task, taskFx2, (void*) pooled);
+      }
+
+      if (kernelLocked())
+         puts("task pool error 1");
+
+      taskSleep(5);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskPoolTestCmd(int argc, char* argv[])
+{
+   taskPoolList();
+
+   printf("x: %lu(%lu), y: %lu(%lu), errors: %lu\n", x[1], x[0], y[1], y[0],
+          errors);
+
+   if ((errors == 0) && (x[1] > 0) && (x[0] > 0) &&
+       (x[1] == pool.hits) && (x[0] == pool.misses) &&
+       (x[0] + x[1] - y[0] - y[1] <= BURST_SIZE))
+   {
+      puts("task pool ok");
+   }
+   else
+   {
+      puts("task pool error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void taskPoolTest()
+{
+   taskPoolAdd(&pool);
+   taskStart(&task1, taskFx1, NULL);
+}
@@ -0,0 +1,195 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "kernel.h"
+#include "platform.h"
+#include "wait_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Queue queue1 = QUEUE_CREATE("wait_test1", sizeof(unsigned long), 2);
+static Queue queue2 = QUEUE_CREATE("wait_test2", sizeof(unsigned long), 1);
+static Semaphore semaphore = SEMAPHORE_CREATE("wait_test", 0, 1);
+static Mutex mutex = MUTEX_CREATE("wait_test");
+static Task task1 = TASK_CREATE("wait_test1", TASK_LOW_PRIORITY,
+                                WAIT_TEST1_STACK_SIZE);
+static Task task2 = TASK_CREATE("wait_test2", TASK_HIGH_PRIORITY,
+                                WAIT_TEST2_STACK_SIZE);
+static Task task3 = TASK_CREATE("wait_test3", TASK_HIGH_PRIORITY,
+                                WAIT_TEST3_STACK_SIZE);
+static Timer timer = TIMER_CREATE(0, 0, NULL);
+static unsigned long x[4] = {0, 0, 0, 0};
+static unsigned long y[4] = {0, 0, 0, 0};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void timerFx(Timer* timer)
+{
+   if (_queuePush(&queue1, true, &x[0]))
+      x[0]++;
+
+   if ((rand() % 2) && _semaphoreGive(&semaphore))
+      x[1]++;
+
+   timer->timeout[0] = rand() % 100;
+   timer->timeout[1] = timer->timeout[0];
+
+   _timerAdd(timer, timerFx, NULL);
+}
+
+/****************************************************************************
+ * Waits on all four objects at once.  Every object handed over must be
+ * counted exactly once, so the counts of both sides never drift apart.
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      unsigned long in = -1;
+      unsigned long out = y[2];
+
+      TaskPoll poll[4] =
+      {
+         KERNEL_WAIT(KERNEL_WAIT_QUEUE_POP, &queue1, &in),
+         KERNEL_WAIT(KERNEL_WAIT_SEMAPHORE, &semaphore, NULL),
+         KERNEL_WAIT(KERNEL_WAIT_QUEUE_PUSH, &queue2, &out),
+         KERNEL_WAIT(KERNEL_WAIT_MUTEX, &mutex, NULL)
+      };
+
+      switch (kernelWait(poll, 4, rand() % 250))
+      {
+         case 0:
+            if (in != y[0])
+               puts("wait error 1");
+
+            y[0]++;
+            break;
+
+         case 1:
+            y[1]++;
+            break;
+
+         case 2:
+            y[2]++;
+            break;
+
+         case 3:
+            if (mutex.owner != &task1)
+               puts("wait error 2");
+
+            y[3]++;
+            mutexUnlock(&mutex);
+            taskSleep(rand() % 10);
+            break;
+      }
+
+      if (kernelLocked())
+         puts("wait error 3");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx2(void* arg)
+{
+   for (;;)
+   {
+      mutexLock(&mutex, -1);
+      taskSleep(rand() % 100);
+      mutexUnlock(&mutex);
+
+      x[3]++;
+      taskSleep(rand() % 10);
+
+      if (kernelLocked())
+         puts("wait error 4");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static void taskFx3(void* arg)
+{
+   for (;;)
+   {
+      unsigned long value;
+
+      if (queuePop(&queue2, true, false, &value, rand() % 250))
+      {
+         if (value != x[2])
+            puts("wait error 5");
+
+         x[2]++;
+      }
+
+      taskSleep(rand() % 100);
+
+      if (kernelLocked())
+         puts("wait error 6");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void waitTestCmd(int argc, char* argv[])
+{
+   printf("x: %lu, %lu, %lu, %lu\n", x[0], x[1], x[2], x[3]);
+   printf("y: %lu, %lu, %lu, %lu\n", y[0], y[1], y[2], y[3]);
+
+   if (((x[0] - y[0]) <= 3) && ((x[1] - y[1]) <= 2) &&
+       ((y[2] - x[2]) <= 2) && (x[3] > 0) && (y[3] > 0))
+   {
+      puts("wait ok");
+   }
+   else
+   {
+      puts("wait error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void waitTest()
+{
+   timer.timeout[0] = rand() % 100;
+   timer.timeout[1] = timer.timeout[0];
+
+   timerAdd(&timer, timerFx, NULL);
+
+   taskStart(&task1, taskFx1, NULL);
+   taskStart(&task2, taskFx2, NULL);
+   taskStart(&task3, taskFx3, NULL);
+}
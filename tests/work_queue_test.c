@@ -0,0 +1,140 @@
+/****************************************************************************
+ * Copyright (c) 2015, Christopher Karle
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   - Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   - Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   - Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER, AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "kernel.h"
+#include "platform.h"
+#include "work_queue_test.h"
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static WorkQueue queue = WORK_QUEUE_CREATE("work_queue_test",
+                                           TASK_HIGH_PRIORITY,
+                                           WORK_QUEUE_TEST2_STACK_SIZE);
+static Task task1 = TASK_CREATE("work_queue_test1", TASK_LOW_PRIORITY,
+                                WORK_QUEUE_TEST1_STACK_SIZE);
+static Timer timer = TIMER_CREATE(0, 0, NULL);
+static unsigned long x[3] = {0, 0, 0};
+static unsigned long y[2] = {0, 0};
+static unsigned long errors = 0;
+
+/****************************************************************************
+ * Work runs on the worker of the CPU it was queued on.
+ ****************************************************************************/
+static void workFx(Work* work)
+{
+   if (work->cpu != cpuID())
+      errors++;
+
+   if (kernelLocked())
+      puts("work queue error 1");
+
+   y[(unsigned long) work->arg]++;
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+static Work work1 = WORK_CREATE(workFx, (void*) 0);
+static Work work2 = WORK_CREATE(workFx, (void*) 1);
+
+/****************************************************************************
+ * Submits from interrupt context.  The worker may not have run since the
+ * last submission, so a refused submission is fine, but the worker cannot
+ * run before this returns.
+ ****************************************************************************/
+static void timerFx(Timer* timer)
+{
+   if (_workSubmit(&queue, &work1))
+   {
+      x[0]++;
+
+      if (_workSubmit(&queue, &work1))
+         errors++;
+   }
+
+   timer->timeout[0] = rand() % 5;
+   timer->timeout[1] = timer->timeout[0];
+
+   _timerAdd(timer, timerFx, NULL);
+}
+
+/****************************************************************************
+ * Submits delayed work and sometimes cancels it before it runs.
+ ****************************************************************************/
+static void taskFx1(void* arg)
+{
+   for (;;)
+   {
+      if (workSubmitDelayed(&queue, &work2, 1 + rand() % 10))
+      {
+         x[1]++;
+
+         if ((rand() % 4 == 0) && workCancel(&work2))
+            x[2]++;
+      }
+
+      taskSleep(rand() % 10);
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void workQueueTestCmd(int argc, char* argv[])
+{
+   printf("x: %lu, %lu(%lu), y: %lu, %lu, errors: %lu\n", x[0], x[1], x[2],
+          y[0], y[1], errors);
+
+   if ((errors == 0) && (y[0] > 0) && (y[1] > 0) && (x[2] > 0) &&
+       (x[0] - y[0] <= 1) && (x[1] - x[2] - y[1] <= 1))
+   {
+      puts("work queue ok");
+   }
+   else
+   {
+      puts("work queue error!");
+   }
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+void workQueueTest()
+{
+   workQueueStart(&queue);
+
+   timer.timeout[0] = rand() % 5;
+   timer.timeout[1] = timer.timeout[0];
+
+   timerAdd(&timer, timerFx, NULL);
+
+   taskStart(&task1, taskFx1, NULL);
+}